@@ -1,6 +1,3 @@
-import java.awt.Robot;
-import java.awt.AWTException;
-
 public class Main {
     static {
         System.loadLibrary("robot");
@@ -9,23 +6,10 @@ public class Main {
 
     public static native void entry_point(String[] args);
 
+    /* "undo" rewinds the last game, from its session log (see
+     * rewind_session in test/main.cpp), natively like the rest.
+     */
     public static void main(String[] args) {
-        if (args.length >= 1 && args[0].equals("undo")) {
-          try {
-            Robot robot = new Robot();
-            for (int i = 0 ; i < 300 ; i++) {
-              robot.mousePress(16);
-              robot.mouseRelease(16);
-              Thread.sleep(10);
-            }
-          } catch (AWTException e) {
-
-          } catch (InterruptedException e) {
-
-          }
-          return;
-        }
-
         entry_point(args);
     }
 }
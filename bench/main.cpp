@@ -0,0 +1,856 @@
+/* Plays seeded games against the simulator (see test/simulator.hpp) and
+ * reports win rate, decision latency and allocations per phase.
+ *
+ * Usage: bench [--games=N] [--seed=S] [--alloc-budget=PATH]
+ *              [--write-alloc-budget] [--tolerance=FRACTION]
+ *              [--solver-corpus] [--solver-reveals=N]
+ *              [--beam-width=K] [--beam-depth=D] [--beam-threads=T]
+ *              [--engine=NAME] [--deadline-ms=MS] [--ab=A,B]
+ *              [--verify-pruning] [--verify-positions=N]
+ *              [--rollouts=N] [--peek] [--peek-max-gestures=N]
+ *              [--read-flight-recorder=PATH]
+ *
+ * When built with ALLOC_PROFILE, allocations per decision of every phase
+ * are checked against the budget file, and the bench exits with a non-zero
+ * status if any phase goes over budget by more than [tolerance].
+ *
+ * With --solver-corpus, the positions the strategy decided at are kept,
+ * with their face down cards sampled from the belief, and the solver (see
+ * test/solver.hpp) is run on all of them with each move ordering, to
+ * turn over [solver-reveals] cards. --rollouts plays each of those
+ * positions out [rollouts] times with the rollout policy (see
+ * test/rollout.hpp) instead, to measure its speed. Built with
+ * ALLOC_PROFILE, both also count exceptions thrown, and the bench fails if
+ * a search threw any.
+ *
+ * --engine picks the decision engine strategy_step asks before the Rule 3
+ * heuristics (see test/engine.hpp), with [deadline-ms] per decision. With
+ * --ab, engines A and B each play the same [games] deals, and the
+ * differences in win rate and latency are reported with 95% confidence
+ * intervals over the paired games; allocations aren't checked.
+ *
+ * --peek lets the strategy peek under Rule 2 moves, spending at most
+ * [peek-max-gestures] per game (see test/peek.hpp). Gestures are reported
+ * per game and per won game, as they cost time on screen.
+ *
+ * With --verify-pruning, every pruning rule (see test/prune.hpp) is
+ * checked against an unpruned search for a win, on [verify-positions]
+ * small random positions with every card known: a rule is unsound if it
+ * loses a win the unpruned search finds. Every search keeps an exact
+ * visited set, so that none drops lines to Bloom filter false positives.
+ * Nodes saved are reported per rule.
+ *
+ * --read-flight-recorder prints a dump of the bot's flight recorder (see
+ * test/recorder.hpp) rather than playing.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+#include "interact.hpp"
+#include "strategy.hpp"
+#include "simulator.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "alloc_profile.hpp"
+#include "solver.hpp"
+#include "prune.hpp"
+#include "rollout.hpp"
+#include "engine.hpp"
+#include "recorder.hpp"
+
+/* Positions kept for --solver-corpus, at most. */
+static const uint32_t MAX_CORPUS_SIZE = 2000;
+
+/* Pruning verification positions: cards left out of the foundations, and
+ * face down cards per column, at most. Searches past the node budget are
+ * left out of the comparison.
+ */
+static const uint32_t VERIFY_MIN_LEFT = 3;
+static const uint32_t VERIFY_MAX_LEFT = 6;
+static const uint32_t VERIFY_MAX_DOWN = 3;
+static const uint64_t VERIFY_MAX_NODES = 1000000;
+
+/* Moves per playout, at most: a won game is fewer than 200. */
+static const uint32_t ROLLOUT_MAX_MOVES = 500;
+
+struct bench_options_t {
+  uint32_t games;
+  uint64_t seed;
+  std::string alloc_budget;
+  bool write_alloc_budget;
+  double tolerance;
+  bool solver_corpus;
+  uint32_t solver_reveals;
+  std::string engine;
+  engine_options_t engines;
+  std::string ab_engines[2];  /* Empty unless --ab. */
+  peek_options_t peek;
+  uint32_t rollouts;
+  bool verify_pruning;
+  uint32_t verify_positions;
+  std::string flight_recorder;  /* Empty unless --read-flight-recorder. */
+};
+
+struct budget_t {
+  double allocations;
+  double bytes;
+};
+
+static bench_options_t parse_options(int argc, const char *argv[])
+{
+  bench_options_t options;
+
+  options.games = 100;
+  options.seed = 1;
+  options.alloc_budget = "bench/alloc_budget.txt";
+  options.write_alloc_budget = false;
+  options.tolerance = 0.1;
+  options.solver_corpus = false;
+  options.solver_reveals = 1;
+  options.engine = "rules";
+  options.engines = engine_default_options();
+  options.peek = peek_default_options();
+  options.rollouts = 0;
+  options.verify_pruning = false;
+  options.verify_positions = 2000;
+
+  for (int i = 1 ; i < argc ; i++) {
+    const char *arg = argv[i];
+
+    if (strncmp(arg, "--games=", 8) == 0) {
+      options.games = strtoul(arg + 8, NULL, 10);
+    } else if (strncmp(arg, "--seed=", 7) == 0) {
+      options.seed = strtoull(arg + 7, NULL, 10);
+    } else if (strncmp(arg, "--alloc-budget=", 15) == 0) {
+      options.alloc_budget = arg + 15;
+    } else if (strcmp(arg, "--write-alloc-budget") == 0) {
+      options.write_alloc_budget = true;
+    } else if (strncmp(arg, "--tolerance=", 12) == 0) {
+      options.tolerance = strtod(arg + 12, NULL);
+    } else if (strcmp(arg, "--solver-corpus") == 0) {
+      options.solver_corpus = true;
+    } else if (strncmp(arg, "--solver-reveals=", 17) == 0) {
+      options.solver_reveals = strtoul(arg + 17, NULL, 10);
+    } else if (strncmp(arg, "--beam-width=", 13) == 0) {
+      options.engines.beam.width = strtoul(arg + 13, NULL, 10);
+    } else if (strncmp(arg, "--beam-depth=", 13) == 0) {
+      options.engines.beam.depth = strtoul(arg + 13, NULL, 10);
+    } else if (strncmp(arg, "--beam-threads=", 15) == 0) {
+      options.engines.beam.threads = strtoul(arg + 15, NULL, 10);
+    } else if (strncmp(arg, "--engine=", 9) == 0) {
+      options.engine = arg + 9;
+    } else if (strncmp(arg, "--deadline-ms=", 14) == 0) {
+      options.engines.deadline_ms = strtoul(arg + 14, NULL, 10);
+    } else if (strncmp(arg, "--ab=", 5) == 0) {
+      const char *comma = strchr(arg + 5, ',');
+
+      if (comma == NULL) {
+        fprintf(stderr, "--ab takes two engines, as in --ab=rules,beam\n");
+        exit(2);
+      }
+
+      options.ab_engines[0] = std::string(arg + 5, comma);
+      options.ab_engines[1] = comma + 1;
+    } else if (strcmp(arg, "--peek") == 0) {
+      options.peek.enabled = true;
+    } else if (strncmp(arg, "--peek-max-gestures=", 20) == 0) {
+      options.peek.max_gestures = strtoul(arg + 20, NULL, 10);
+    } else if (strncmp(arg, "--rollouts=", 11) == 0) {
+      options.rollouts = strtoul(arg + 11, NULL, 10);
+    } else if (strcmp(arg, "--verify-pruning") == 0) {
+      options.verify_pruning = true;
+    } else if (strncmp(arg, "--verify-positions=", 19) == 0) {
+      options.verify_positions = strtoul(arg + 19, NULL, 10);
+    } else if (strncmp(arg, "--read-flight-recorder=", 23) == 0) {
+      options.flight_recorder = arg + 23;
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", arg);
+      exit(2);
+    }
+  }
+
+  options.engines.portfolio.beam = options.engines.beam;
+  return options;
+}
+
+static bool is_won(const game_state_t & state)
+{
+  for (int i = 0 ; i < 4 ; i++) {
+    if (!state.foundation[i].is_some()
+        || state.foundation[i].get().number != KING) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Keeps [state], with a deal of its face down cards, for the solver. */
+static void add_to_corpus(
+    const game_state_t & state,
+    uint64_t *rng,
+    std::vector<packed_state_t> *corpus)
+{
+  belief_t belief = strategy_belief();
+  belief_sample_t sample;
+
+  if (corpus->size() >= MAX_CORPUS_SIZE) {
+    return;
+  }
+
+  try {
+    belief.update(state, strategy_stock_pile().mask());
+    belief.sample(rng, &sample);
+    corpus->push_back(
+        packed_state_of(state, strategy_stock_pile().mask(), &sample));
+  } catch (BeliefException & e) {
+  } catch (SolverException & e) {
+  }
+}
+
+struct game_result_t {
+  bool won;
+  uint64_t decisions;
+  uint64_t elapsed_us;
+  uint64_t gestures;
+  uint64_t peek_gestures;  /* Of [gestures]. */
+};
+
+/* The same loop as entry_point, against the simulator. */
+static bool play_game(
+    uint64_t seed,
+    uint64_t *decisions,
+    std::vector<packed_state_t> *corpus)
+{
+  uint64_t rng = seed;
+
+  simulator_deal(seed);
+
+  game_state_t state = load_initial_game_state();
+
+  try {
+    state = strategy_init(state);
+    bool moved;
+
+    do {
+      if (corpus != NULL) {
+        add_to_corpus(state, &rng, corpus);
+      }
+
+      state = strategy_step(state, &moved);
+      (*decisions)++;
+    } while (moved);
+  } catch (std::exception & e) {
+  }
+
+  try {
+    state = strategy_term(state);
+  } catch (std::exception & e) {
+  }
+
+  return is_won(state);
+}
+
+/* Plays the bench's games with [engine] deciding. */
+static std::vector<game_result_t> play_games(
+    const bench_options_t & options,
+    const std::string & engine,
+    std::vector<packed_state_t> *corpus)
+{
+  std::vector<game_result_t> results;
+
+  try {
+    strategy_set_engine(
+        engine_create(engine, options.engines), options.engines.deadline_ms);
+  } catch (EngineException & e) {
+    fprintf(stderr, "Unknown engine %s, pick one of:", engine.c_str());
+
+    for (const char *const *known = ENGINE_NAMES ; *known != NULL ; known++) {
+      fprintf(stderr, " %s", *known);
+    }
+
+    fprintf(stderr, "\n");
+    exit(2);
+  }
+
+  strategy_set_peek_options(options.peek);
+
+  for (uint32_t i = 0 ; i < options.games ; i++) {
+    game_result_t result;
+    const uint64_t start = metrics_now_us();
+    const uint64_t gestures = interact_num_gestures();
+
+    result.decisions = 0;
+    result.won = play_game(options.seed + i, &result.decisions, corpus);
+    result.elapsed_us = metrics_now_us() - start;
+    result.gestures = interact_num_gestures() - gestures;
+    result.peek_gestures = strategy_peek_gestures();
+    results.push_back(result);
+  }
+
+  strategy_set_engine(NULL, 0);
+  strategy_set_peek_options(peek_default_options());
+  return results;
+}
+
+static double per_decision(const game_result_t & result)
+{
+  return result.decisions
+    ? double(result.elapsed_us) / double(result.decisions)
+    : 0.0;
+}
+
+/* Mean of [samples], and half the width of its 95% confidence interval
+ * (normal approximation).
+ */
+static void mean_and_margin(
+    const std::vector<double> & samples, double *mean, double *margin)
+{
+  const double n = samples.size();
+  double sum = 0;
+  double squares = 0;
+
+  for (double sample : samples) {
+    sum += sample;
+  }
+
+  *mean = n ? sum / n : 0.0;
+
+  for (double sample : samples) {
+    squares += (sample - *mean) * (sample - *mean);
+  }
+
+  *margin = n > 1 ? 1.96 * sqrt(squares / (n - 1) / n) : 0.0;
+}
+
+/* Plays the same deals with both --ab engines, and reports B - A. */
+static void run_ab(const bench_options_t & options)
+{
+  std::vector<game_result_t> results[2];
+
+  for (uint32_t e = 0 ; e < 2 ; e++) {
+    results[e] = play_games(options, options.ab_engines[e], NULL);
+  }
+
+  std::vector<double> wins;
+  std::vector<double> latencies;
+  uint32_t only[2] = { 0, 0 };
+
+  for (uint32_t i = 0 ; i < options.games ; i++) {
+    const game_result_t & a = results[0][i];
+    const game_result_t & b = results[1][i];
+
+    wins.push_back(double(b.won) - double(a.won));
+    latencies.push_back(per_decision(b) - per_decision(a));
+
+    if (a.won != b.won) {
+      only[b.won]++;
+    }
+  }
+
+  printf(">> A/B over %u paired games\n", options.games);
+
+  for (uint32_t e = 0 ; e < 2 ; e++) {
+    uint32_t won = 0;
+    uint64_t decisions = 0;
+    uint64_t elapsed = 0;
+
+    for (const game_result_t & result : results[e]) {
+      won += result.won;
+      decisions += result.decisions;
+      elapsed += result.elapsed_us;
+    }
+
+    printf("%c %-10s won = %u (%.1f%%), %.1f us / decision\n",
+        "AB"[e], options.ab_engines[e].c_str(), won,
+        options.games ? 100.0 * won / options.games : 0.0,
+        decisions ? double(elapsed) / double(decisions) : 0.0);
+  }
+
+  double mean;
+  double margin;
+
+  mean_and_margin(wins, &mean, &margin);
+  printf("win rate B - A = %+.1f%% +/- %.1f%% (A only %u, B only %u)\n",
+      100 * mean, 100 * margin, only[0], only[1]);
+  mean_and_margin(latencies, &mean, &margin);
+  printf("us / decision B - A = %+.1f +/- %.1f\n", mean, margin);
+  printf("<< End of A/B\n");
+}
+
+static std::map<std::string, budget_t> read_budget(const std::string & path)
+{
+  std::map<std::string, budget_t> budget;
+  std::ifstream in(path.c_str());
+  std::string line;
+
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    std::string phase;
+    budget_t b;
+
+    if (fields >> phase >> b.allocations >> b.bytes) {
+      budget[phase] = b;
+    }
+  }
+
+  return budget;
+}
+
+static void write_budget(const std::string & path, uint64_t decisions)
+{
+  std::ofstream out(path.c_str());
+
+  out << "# phase allocations/decision bytes/decision\n";
+  out << "# Generated by bench --write-alloc-budget, built with "
+    << "ALLOC_PROFILE=1.\n";
+
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    alloc_stats_t stats = alloc_profile_phase_stats(trace_phase_t(i));
+
+    out << trace_phase_name(trace_phase_t(i)) << " "
+      << double(stats.allocations) / double(decisions) << " "
+      << double(stats.bytes) / double(decisions) << "\n";
+  }
+}
+
+/* Returns the number of phases over budget. */
+static uint32_t check_budget(
+    const std::map<std::string, budget_t> & budget,
+    uint64_t decisions,
+    double tolerance)
+{
+  uint32_t regressions = 0;
+
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    const char *phase = trace_phase_name(trace_phase_t(i));
+    alloc_stats_t stats = alloc_profile_phase_stats(trace_phase_t(i));
+    const double allocations = double(stats.allocations) / double(decisions);
+    const double bytes = double(stats.bytes) / double(decisions);
+    budget_t b = { 0, 0 };
+
+    if (budget.count(phase)) {
+      b = budget.at(phase);
+    }
+
+    if (allocations > b.allocations * (1 + tolerance)
+        || bytes > b.bytes * (1 + tolerance)) {
+      fprintf(stderr,
+          "REGRESSION %s: %.1f allocations / %.1f bytes per decision, "
+          "budget is %.1f / %.1f\n",
+          phase, allocations, bytes, b.allocations, b.bytes);
+      regressions++;
+    }
+  }
+
+  return regressions;
+}
+
+/* Prints the exceptions thrown since [before] (see alloc_profile.hpp), and
+ * returns them: searches should never unwind.
+ */
+static uint64_t report_throws(uint64_t before)
+{
+  if (!alloc_profile_enabled()) {
+    printf("throws not counted (see ALLOC_PROFILE)\n");
+    return 0;
+  }
+
+  const uint64_t throws = alloc_profile_throws() - before;
+
+  printf("throws = %lu\n", (unsigned long) throws);
+  return throws;
+}
+
+/* Returns the exceptions thrown. */
+static uint64_t run_solver_corpus(
+    const std::vector<packed_state_t> & corpus, uint32_t reveals)
+{
+  static const struct {
+    const char *name;
+    uint32_t ordering;
+  } orderings[] = {
+    { "none", SOLVER_ORDER_NONE },
+    { "static", SOLVER_ORDER_STATIC },
+    { "static+killers", SOLVER_ORDER_STATIC | SOLVER_ORDER_KILLERS },
+    { "static+killers+history", SOLVER_ORDER_ALL },
+  };
+
+  const uint64_t throws = alloc_profile_throws();
+
+  printf(">> Solver corpus: %lu positions, %u reveal(s)\n",
+      (unsigned long) corpus.size(), reveals);
+  printf("%-24s %8s %10s %12s %14s %14s %14s\n",
+      "ordering", "found", "exhausted", "out of nodes", "nodes",
+      "nodes (found)", "us / position");
+
+  for (const auto & o : orderings) {
+    solver_options_t options = solver_default_options();
+    uint32_t outcomes[NUM_SOLVER_OUTCOMES] = { 0 };
+    uint64_t nodes = 0;
+    uint64_t found_nodes = 0;
+
+    options.reveals = reveals;
+    options.ordering = o.ordering;
+
+    std::unique_ptr<solver_t> solver(new solver_t(options));
+    const uint64_t start = metrics_now_us();
+
+    for (const packed_state_t & position : corpus) {
+      const solver_result_t result = solver->solve(position);
+
+      outcomes[result.outcome]++;
+      nodes += result.nodes;
+
+      if (result.outcome == SOLVER_FOUND) {
+        found_nodes += result.nodes;
+      }
+    }
+
+    const uint64_t elapsed = metrics_now_us() - start;
+
+    printf("%-24s %8u %10u %12u %14lu %14lu %14.1f\n",
+        o.name, outcomes[SOLVER_FOUND], outcomes[SOLVER_EXHAUSTED],
+        outcomes[SOLVER_OUT_OF_NODES], (unsigned long) nodes,
+        (unsigned long) found_nodes,
+        corpus.empty() ? 0.0 : double(elapsed) / double(corpus.size()));
+  }
+
+  const uint64_t thrown = report_throws(throws);
+
+  printf("<< End of solver corpus\n");
+  return thrown;
+}
+
+/* Plays every position of [corpus] out [rollouts] times, seeded by the
+ * position and the playout. Returns a checksum of the end states.
+ */
+static uint64_t play_rollouts(
+    const std::vector<packed_state_t> & corpus,
+    uint32_t rollouts,
+    uint64_t *moves,
+    uint32_t *won,
+    uint32_t *stuck)
+{
+  uint64_t checksum = 0;
+
+  for (uint32_t i = 0 ; i < corpus.size() ; i++) {
+    for (uint32_t j = 0 ; j < rollouts ; j++) {
+      rollout_policy_t policy(corpus[i].hash + j);
+      packed_state_t state = corpus[i];
+      const rollout_result_t result = policy.play(&state, ROLLOUT_MAX_MOVES);
+
+      *moves += result.num_moves;
+      *won += result.won;
+      *stuck += result.stuck;
+      checksum = checksum * 31 + state.hash;
+    }
+  }
+
+  return checksum;
+}
+
+/* Returns the exceptions thrown. */
+static uint64_t run_rollouts(
+    const std::vector<packed_state_t> & corpus, uint32_t rollouts)
+{
+  const uint64_t throws = alloc_profile_throws();
+  uint64_t moves = 0;
+  uint32_t won = 0;
+  uint32_t stuck = 0;
+  uint64_t replay_moves = 0;
+  uint32_t replay_won = 0;
+  uint32_t replay_stuck = 0;
+  const uint64_t start = metrics_now_us();
+  const uint64_t checksum =
+    play_rollouts(corpus, rollouts, &moves, &won, &stuck);
+  const uint64_t elapsed = metrics_now_us() - start;
+  const uint32_t playouts = corpus.size() * rollouts;
+
+  printf(">> Rollouts: %lu positions, %u playouts each\n",
+      (unsigned long) corpus.size(), rollouts);
+  printf("playouts = %u, won = %u, stuck = %u, %.1f moves / playout\n",
+      playouts, won, stuck, playouts ? double(moves) / playouts : 0.0);
+  printf("%.2f M moves / s, %.2f us / playout\n",
+      elapsed ? double(moves) / double(elapsed) : 0.0,
+      playouts ? double(elapsed) / playouts : 0.0);
+  printf("replay %s\n",
+      play_rollouts(corpus, rollouts, &replay_moves, &replay_won,
+        &replay_stuck) == checksum
+      ? "matches" : "DIFFERS");
+
+  const uint64_t thrown = report_throws(throws);
+
+  printf("<< End of rollouts\n");
+  return thrown;
+}
+
+/* A late game position, small enough to search exhaustively: the top
+ * few cards of every suite are left, some dealt to the columns (face down
+ * under one face up card) and the rest in the pile.
+ */
+static packed_state_t random_position(uint64_t *rng)
+{
+  const uint32_t left = VERIFY_MIN_LEFT
+    + splitmix64_next(rng) % (VERIFY_MAX_LEFT - VERIFY_MIN_LEFT + 1);
+  std::vector<uint32_t> cards;
+  game_state_t state;
+  belief_sample_t sample;
+  uint64_t pile = 0;
+
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    state.foundation[suite] = Option<card_t>(
+        card_of_index(suite * 13 + 12 - left));
+
+    for (uint32_t number = 13 - left ; number < 13 ; number++) {
+      cards.push_back(suite * 13 + number);
+    }
+  }
+
+  for (uint32_t i = cards.size() - 1 ; i > 0 ; i--) {
+    std::swap(cards[i], cards[splitmix64_next(rng) % (i + 1)]);
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    tableau_deck_t & column = state.tableau[deck];
+    const uint32_t down = splitmix64_next(rng) % (VERIFY_MAX_DOWN + 2);
+
+    /* One in VERIFY_MAX_DOWN + 2 columns is left empty. */
+    column.num_down_cards = 0;
+
+    if (down == VERIFY_MAX_DOWN + 1 || cards.size() < down + 1) {
+      continue;
+    }
+
+    for (uint32_t depth = 0 ; depth < down ; depth++) {
+      sample.cards[deck][depth] = cards.back();
+      cards.pop_back();
+    }
+
+    column.num_down_cards = down;
+    column.cards.push_back(card_of_index(cards.back()));
+    cards.pop_back();
+  }
+
+  for (uint32_t card : cards) {
+    pile |= uint64_t(1) << card;
+  }
+
+  state.stock_pile_size = 0;
+  state.remaining_pile_size = cards.size();
+
+  return packed_state_of(state, pile, &sample);
+}
+
+/* Returns the number of unsound rules. */
+static uint32_t verify_pruning(uint64_t seed, uint32_t num_positions)
+{
+  static const prune_rule_t rules[] = {
+    PRUNE_NONE,
+    PRUNE_KING_SHUFFLE,
+    PRUNE_REVERSAL,
+    PRUNE_SPLIT_RUN,
+    PRUNE_ALL,
+  };
+  const uint32_t num_rules = sizeof(rules) / sizeof(rules[0]);
+  std::vector<std::unique_ptr<solver_t>> solvers;
+  std::vector<packed_state_t> positions;
+  uint64_t rng = seed;
+
+  for (uint32_t i = 0 ; i < num_rules ; i++) {
+    solver_options_t options = solver_default_options();
+
+    options.goal = SOLVER_GOAL_WIN;
+    options.max_depth = SOLVER_MAX_DEPTH;
+    options.max_nodes = VERIFY_MAX_NODES;
+    options.pruning = rules[i];
+    options.exact_visited = true;
+    solvers.push_back(std::unique_ptr<solver_t>(new solver_t(options)));
+  }
+
+  for (uint32_t i = 0 ; i < num_positions ; i++) {
+    positions.push_back(random_position(&rng));
+  }
+
+  /* Per rule, over the positions every search finished. */
+  std::vector<uint64_t> nodes(num_rules, 0);
+  std::vector<uint32_t> wins(num_rules, 0);
+  std::vector<uint32_t> lost(num_rules, 0);
+  uint32_t conclusive = 0;
+
+  for (const packed_state_t & position : positions) {
+    solver_result_t results[sizeof(rules) / sizeof(rules[0])];
+    bool finished = true;
+
+    for (uint32_t i = 0 ; i < num_rules ; i++) {
+      results[i] = solvers[i]->solve(position);
+      finished = finished && results[i].outcome != SOLVER_OUT_OF_NODES;
+    }
+
+    if (!finished) {
+      continue;
+    }
+
+    conclusive++;
+
+    for (uint32_t i = 0 ; i < num_rules ; i++) {
+      const bool won = results[i].outcome == SOLVER_FOUND;
+
+      nodes[i] += results[i].nodes;
+      wins[i] += won;
+      lost[i] += !won && results[0].outcome == SOLVER_FOUND;
+    }
+  }
+
+  uint32_t unsound = 0;
+
+  printf(">> Pruning verification: %u positions, %u searched to the end\n",
+      num_positions, conclusive);
+  printf("%-14s %8s %10s %14s %10s\n",
+      "rules", "wins", "lost wins", "nodes", "vs none");
+
+  for (uint32_t i = 0 ; i < num_rules ; i++) {
+    printf("%-14s %8u %10u %14lu %9.1f%%\n",
+        prune_rule_name(rules[i]), wins[i], lost[i],
+        (unsigned long) nodes[i],
+        nodes[0] ? 100.0 * double(nodes[i]) / double(nodes[0]) : 0.0);
+
+    if (lost[i] != 0) {
+      unsound++;
+    }
+  }
+
+  printf("<< End of pruning verification\n");
+  return unsound;
+}
+
+int main(int argc, const char *argv[])
+{
+  bench_options_t options = parse_options(argc, argv);
+
+  if (options.verify_pruning) {
+    return verify_pruning(options.seed, options.verify_positions) ? 1 : 0;
+  }
+
+  if (!options.flight_recorder.empty()) {
+    if (!recorder_print_dump(options.flight_recorder, std::cout)) {
+      fprintf(stderr, "%s is not a flight recorder dump\n",
+          options.flight_recorder.c_str());
+      return 1;
+    }
+
+    return 0;
+  }
+
+  /* The strategy is chatty; keep the bench's output readable. */
+  std::ofstream null_stream("/dev/null");
+  std::streambuf *stdout_buffer = std::cout.rdbuf(null_stream.rdbuf());
+
+  set_sandbox_mode(true);
+
+  if (!options.ab_engines[0].empty()) {
+    run_ab(options);
+    std::cout.rdbuf(stdout_buffer);
+    return 0;
+  }
+
+  trace_begin_game();
+  alloc_profile_reset();
+
+  uint32_t wins = 0;
+  uint64_t decisions = 0;
+  uint64_t elapsed = 0;
+  uint64_t gestures = 0;
+  uint64_t won_gestures = 0;
+  uint64_t peek_gestures = 0;
+  std::vector<packed_state_t> corpus;
+  const std::vector<game_result_t> results = play_games(
+      options, options.engine,
+      options.solver_corpus || options.rollouts ? &corpus : NULL);
+
+  for (const game_result_t & result : results) {
+    wins += result.won;
+    decisions += result.decisions;
+    elapsed += result.elapsed_us;
+    gestures += result.gestures;
+    won_gestures += result.won ? result.gestures : 0;
+    peek_gestures += result.peek_gestures;
+  }
+
+  std::cout.rdbuf(stdout_buffer);
+
+  printf("games = %u, won = %u (%.1f%%), decisions = %lu, "
+      "%.1f us / decision\n",
+      options.games, wins, 100.0 * wins / options.games,
+      (unsigned long) decisions,
+      decisions ? double(elapsed) / double(decisions) : 0.0);
+  printf("gestures = %.1f / game, %.1f / won game, %.1f / game peeking\n",
+      options.games ? double(gestures) / options.games : 0.0,
+      wins ? double(won_gestures) / wins : 0.0,
+      options.games ? double(peek_gestures) / options.games : 0.0);
+  trace_print_game_report(std::cout);
+  alloc_profile_print_report(std::cout, decisions);
+
+  if (options.engine == "portfolio") {
+    portfolio_print_stats(std::cout);
+  }
+
+  uint64_t search_throws = 0;
+
+  if (options.solver_corpus) {
+    search_throws += run_solver_corpus(corpus, options.solver_reveals);
+  }
+
+  if (options.rollouts) {
+    search_throws += run_rollouts(corpus, options.rollouts);
+  }
+
+  if (search_throws != 0) {
+    fprintf(stderr, "%lu exception(s) thrown in searches\n",
+        (unsigned long) search_throws);
+    return 1;
+  }
+
+  if (!alloc_profile_enabled() || decisions == 0) {
+    return 0;
+  }
+
+  if (options.write_alloc_budget) {
+    write_budget(options.alloc_budget, decisions);
+    printf("Wrote allocation budget to %s\n", options.alloc_budget.c_str());
+    return 0;
+  }
+
+  std::map<std::string, budget_t> budget = read_budget(options.alloc_budget);
+
+  if (budget.empty()) {
+    printf("No allocation budget at %s, not checking\n",
+        options.alloc_budget.c_str());
+    return 0;
+  }
+
+  uint32_t regressions = check_budget(budget, decisions, options.tolerance);
+
+  if (regressions != 0) {
+    fprintf(stderr, "%u phase(s) over allocation budget\n", regressions);
+    return 1;
+  }
+
+  printf("All phases within allocation budget\n");
+  return 0;
+}
@@ -24,6 +24,22 @@ typedef struct {
 } rectangle_t;
 
 
+/* Running totals of everything that went through the robot since start up.
+ * Updated atomically, so they can be read from any thread.
+ */
+typedef struct {
+    uint64_t screenshots;
+    uint64_t screenshot_pixels;
+    uint64_t screenshot_bytes;   /* Written to the caller's buffers. */
+    uint64_t screenshot_nanos;
+    uint64_t mouse_moves;
+    uint64_t mouse_presses;
+    uint64_t mouse_releases;
+    uint64_t key_presses;
+    uint64_t key_releases;
+} robot_stats_t;
+
+
 const int ROBOT_BUTTON1_DOWN_MASK = 1024;
 const int ROBOT_BUTTON1_MASK = 16;
 const int ROBOT_BUTTON2_DOWN_MASK = 2048;
@@ -36,6 +52,31 @@ void robot_jvm_init(JNIEnv *env);
 
 robot_h robot_init();
 
+/* Where the game window is, relative to where it was when the coordinates
+ * used by callers were measured. Every capture and mouse move is
+ * translated by this offset, (0, 0) to start with, so a moved window only
+ * needs the offset updated.
+ */
+void robot_set_origin_offset(int dx, int dy);
+void robot_get_origin_offset(/* output */ int *dx, /* output */ int *dy);
+
+/* [rect] translated by the origin offset, clamped to the screen. */
+rectangle_t robot_translate_rectangle(const rectangle_t rect);
+
+typedef enum {
+    /* One uint32_t per pixel, 0xAARRGGBB, as java.awt.Robot captures. */
+    ROBOT_PIXEL_ARGB32 = 0,
+
+    /* One uint8_t per pixel. */
+    ROBOT_PIXEL_GRAY8 = 1,
+
+    /* One bit per pixel, set when the gray level is above the threshold.
+     * Most significant bit first, rows padded to a whole byte.
+     */
+    ROBOT_PIXEL_BINARY1 = 2
+} robot_pixel_format_t;
+
+
 /* display */
 void robot_screenshot(
     robot_h robot, 
@@ -43,6 +84,85 @@ void robot_screenshot(
     /* output */ uint32_t *dest
 );
 
+/* Captures [rect] in [format], converted in the native layer so only the
+ * requested bytes get written to [dest], which must hold
+ * robot_screenshot_size(rect, format) bytes. [threshold] is only used by
+ * ROBOT_PIXEL_BINARY1.
+ */
+void robot_screenshot_format(
+    robot_h robot,
+    const rectangle_t rect,
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    /* output */ void *dest
+);
+/* As robot_screenshot_format, [rect] being in screen coordinates, ie. not
+ * translated by the origin offset.
+ */
+void robot_screenshot_absolute(
+    robot_h robot,
+    const rectangle_t rect,
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    /* output */ void *dest
+);
+size_t robot_screenshot_size(
+    const rectangle_t rect,
+    robot_pixel_format_t format
+);
+
+/* screen changes
+ *
+ * On X11 built with HAVE_XDAMAGE, waits block on Damage events of the root
+ * window, so they take no CPU and return as soon as the screen is updated.
+ * Otherwise (or without a display / the extension), [rect] is captured
+ * and compared every few milliseconds instead.
+ *
+ * These are not thread safe.
+ */
+typedef enum {
+    ROBOT_WAIT_CHANGED = 0,
+    ROBOT_WAIT_QUIET = 1,
+    ROBOT_WAIT_TIMED_OUT = 2
+} robot_wait_result_t;
+
+typedef struct {
+    rectangle_t rect;
+    uint64_t since_nanos;
+    uint64_t fingerprint;  /* Contents of [rect], when polling. */
+} robot_watch_t;
+
+/* Non-zero when waits are driven by damage events rather than polling. */
+int robot_damage_events_available();
+
+/* Starts watching [rect]; call this before the input that should change it,
+ * so updates that land before robot_wait_for_change are not missed.
+ */
+void robot_watch_begin(
+    robot_h robot,
+    const rectangle_t rect,
+    /* output */ robot_watch_t *watch
+);
+
+/* Returns ROBOT_WAIT_CHANGED once [watch->rect] has changed since
+ * robot_watch_begin, ROBOT_WAIT_TIMED_OUT after [timeout_ms].
+ */
+robot_wait_result_t robot_wait_for_change(
+    robot_h robot,
+    const robot_watch_t *watch,
+    uint32_t timeout_ms
+);
+
+/* Returns ROBOT_WAIT_QUIET once [rect] hasn't changed for [quiet_ms],
+ * ROBOT_WAIT_TIMED_OUT after [timeout_ms].
+ */
+robot_wait_result_t robot_wait_for_quiet(
+    robot_h robot,
+    const rectangle_t rect,
+    uint32_t quiet_ms,
+    uint32_t timeout_ms
+);
+
 /* keyboard */
 void robot_key_press(robot_h robot, int keycode);
 void robot_key_release(robot_h robot, int keycode);
@@ -53,6 +173,9 @@ void robot_mouse_press(robot_h robot, int button);
 void robot_mouse_release(robot_h robot, int button);
 void robot_free(robot_h robot);
 
+/* stats */
+void robot_get_stats(robot_stats_t *stats);
+
 
 #ifdef __cplusplus
 }
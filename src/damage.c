@@ -0,0 +1,320 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_XDAMAGE
+#include <sys/select.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#endif
+
+#include "robot.h"
+
+/* Without damage events, how often the screen gets sampled instead. */
+#define POLL_INTERVAL_MS 10
+
+/* Damage seen since the oldest watch still waiting; more than enough for the
+ * handful of rectangles a card animation produces.
+ */
+#define NUM_DAMAGE_RECORDS 256
+
+
+static uint64_t monotonic_nanos()
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int intersects(const rectangle_t a, const rectangle_t b)
+{
+        return a.x < b.x + b.width && b.x < a.x + a.width
+            && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+/* FNV-1a over a gray capture of [rect], to tell whether it changed between
+ * two polls.
+ */
+static uint64_t fingerprint(robot_h robot, const rectangle_t rect)
+{
+        const size_t size = robot_screenshot_size(rect, ROBOT_PIXEL_GRAY8);
+        uint8_t *pixels = malloc(size);
+        uint64_t hash = 0xcbf29ce484222325ull;
+
+        robot_screenshot_format(robot, rect, ROBOT_PIXEL_GRAY8, 0, pixels);
+
+        for (size_t i = 0 ; i < size ; i++) {
+                hash = (hash ^ pixels[i]) * 0x100000001b3ull;
+        }
+
+        free(pixels);
+        return hash;
+}
+
+
+#ifdef HAVE_XDAMAGE
+
+typedef struct {
+        uint64_t nanos;
+        rectangle_t area;
+} damage_record_t;
+
+static Display *display;
+static Damage damage;
+static int damage_event_base;
+
+/* Ring buffer of the latest damage, in screen coordinates. */
+static damage_record_t records[NUM_DAMAGE_RECORDS];
+static uint32_t num_records;
+
+/* Time of the newest record overwritten in [records]. Watches older than
+ * that can't tell anymore, so they are reported as changed.
+ */
+static uint64_t lost_nanos;
+
+static void open_display()
+{
+        static int tried = 0;
+        int error_base;
+
+        if (tried) {
+                return;
+        }
+        tried = 1;
+
+        display = XOpenDisplay(NULL);
+
+        if (display == NULL) {
+                puts("No X display, waiting on screen changes by polling");
+                return;
+        }
+
+        if (!XDamageQueryExtension(display, &damage_event_base, &error_base)) {
+                puts("No XDamage extension, waiting on screen changes by polling");
+                XCloseDisplay(display);
+                display = NULL;
+                return;
+        }
+
+        /* The game is drawn in a browser window we don't know the id of;
+         * damage to the root window covers it, and is already in the screen
+         * coordinates the robot uses.
+         */
+        damage = XDamageCreate(
+            display, DefaultRootWindow(display), XDamageReportRawRectangles);
+        XFlush(display);
+}
+
+static void drain_damage_events()
+{
+        while (XPending(display)) {
+                XEvent event;
+
+                XNextEvent(display, &event);
+
+                if (event.type != damage_event_base + XDamageNotify) {
+                        continue;
+                }
+
+                const XDamageNotifyEvent *notify =
+                    (const XDamageNotifyEvent *) &event;
+                damage_record_t *record =
+                    &records[num_records % NUM_DAMAGE_RECORDS];
+
+                if (num_records >= NUM_DAMAGE_RECORDS) {
+                        lost_nanos = record->nanos;
+                }
+
+                record->nanos = monotonic_nanos();
+                record->area.x = notify->area.x < 0 ? 0 : notify->area.x;
+                record->area.y = notify->area.y < 0 ? 0 : notify->area.y;
+                record->area.width = notify->area.width;
+                record->area.height = notify->area.height;
+                num_records++;
+        }
+}
+
+/* Returns the time of the latest damage to [rect] since [since], or 0. */
+static uint64_t latest_damage(const rectangle_t window_rect, uint64_t since)
+{
+        const rectangle_t rect = robot_translate_rectangle(window_rect);
+        const uint32_t n = num_records < NUM_DAMAGE_RECORDS
+            ? num_records : NUM_DAMAGE_RECORDS;
+        uint64_t latest = 0;
+
+        if (lost_nanos >= since) {
+                return lost_nanos;
+        }
+
+        for (uint32_t i = 0 ; i < n ; i++) {
+                const damage_record_t *record = &records[i];
+
+                if (record->nanos >= since
+                    && record->nanos > latest
+                    && intersects(record->area, rect)) {
+                        latest = record->nanos;
+                }
+        }
+
+        return latest;
+}
+
+/* Sleeps until the X server has something for us, or [deadline]. */
+static void wait_for_events(uint64_t deadline)
+{
+        const uint64_t now = monotonic_nanos();
+        const int fd = ConnectionNumber(display);
+        struct timeval timeout;
+        fd_set fds;
+
+        if (now >= deadline) {
+                return;
+        }
+
+        timeout.tv_sec = (deadline - now) / 1000000000ull;
+        timeout.tv_usec = ((deadline - now) % 1000000000ull) / 1000;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        select(fd + 1, &fds, NULL, NULL, &timeout);
+}
+
+#endif
+
+
+int robot_damage_events_available()
+{
+#ifdef HAVE_XDAMAGE
+        open_display();
+        return display != NULL;
+#else
+        return 0;
+#endif
+}
+
+
+void robot_watch_begin(
+    robot_h robot,
+    const rectangle_t rect,
+    robot_watch_t *watch
+)
+{
+        watch->rect = rect;
+        watch->since_nanos = monotonic_nanos();
+        watch->fingerprint = 0;
+
+#ifdef HAVE_XDAMAGE
+        open_display();
+
+        if (display != NULL) {
+                /* Anything already queued predates the watch. */
+                drain_damage_events();
+                return;
+        }
+#endif
+
+        watch->fingerprint = fingerprint(robot, rect);
+}
+
+
+robot_wait_result_t robot_wait_for_change(
+    robot_h robot,
+    const robot_watch_t *watch,
+    uint32_t timeout_ms
+)
+{
+        const uint64_t deadline =
+            monotonic_nanos() + (uint64_t) timeout_ms * 1000000ull;
+
+#ifdef HAVE_XDAMAGE
+        if (display != NULL) {
+                while (1) {
+                        drain_damage_events();
+
+                        if (latest_damage(watch->rect, watch->since_nanos)) {
+                                return ROBOT_WAIT_CHANGED;
+                        }
+
+                        if (monotonic_nanos() >= deadline) {
+                                return ROBOT_WAIT_TIMED_OUT;
+                        }
+
+                        wait_for_events(deadline);
+                }
+        }
+#endif
+
+        while (fingerprint(robot, watch->rect) == watch->fingerprint) {
+                if (monotonic_nanos() >= deadline) {
+                        return ROBOT_WAIT_TIMED_OUT;
+                }
+
+                usleep(POLL_INTERVAL_MS * 1000);
+        }
+
+        return ROBOT_WAIT_CHANGED;
+}
+
+
+robot_wait_result_t robot_wait_for_quiet(
+    robot_h robot,
+    const rectangle_t rect,
+    uint32_t quiet_ms,
+    uint32_t timeout_ms
+)
+{
+        const uint64_t start = monotonic_nanos();
+        const uint64_t quiet = (uint64_t) quiet_ms * 1000000ull;
+        const uint64_t deadline = start + (uint64_t) timeout_ms * 1000000ull;
+
+#ifdef HAVE_XDAMAGE
+        open_display();
+
+        if (display != NULL) {
+                while (1) {
+                        drain_damage_events();
+
+                        uint64_t last_change = latest_damage(rect, start);
+                        uint64_t quiet_since = last_change ? last_change : start;
+                        uint64_t now = monotonic_nanos();
+
+                        if (now - quiet_since >= quiet) {
+                                return ROBOT_WAIT_QUIET;
+                        }
+
+                        if (now >= deadline) {
+                                return ROBOT_WAIT_TIMED_OUT;
+                        }
+
+                        wait_for_events(
+                            quiet_since + quiet < deadline
+                            ? quiet_since + quiet : deadline);
+                }
+        }
+#endif
+
+        uint64_t last = fingerprint(robot, rect);
+        uint64_t quiet_since = start;
+
+        while (1) {
+                uint64_t now = monotonic_nanos();
+
+                if (now - quiet_since >= quiet) {
+                        return ROBOT_WAIT_QUIET;
+                }
+
+                if (now >= deadline) {
+                        return ROBOT_WAIT_TIMED_OUT;
+                }
+
+                usleep(POLL_INTERVAL_MS * 1000);
+
+                uint64_t current = fingerprint(robot, rect);
+
+                if (current != last) {
+                        last = current;
+                        quiet_since = monotonic_nanos();
+                }
+        }
+}
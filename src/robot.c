@@ -1,6 +1,25 @@
+#include <string.h>
+#include <time.h>
+
 #include "robot.h"
 
 static JavaVM *jvm;
+static robot_stats_t stats;
+
+/* (uint32_t) dx << 32 | (uint32_t) dy, so both halves change at once. */
+static uint64_t origin_offset;
+
+#define STATS_ADD(field, n) \
+        __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+
+
+static uint64_t monotonic_nanos()
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 
 void robot_jvm_init(JNIEnv *env)
@@ -51,6 +70,7 @@ void robot_key_press(robot_h robot, int keycode)
 {
         SETUP_JAVA_ENV("keyPress", "(I)V");
         (*env)->CallVoidMethod(env, robot, method, (jint) keycode);
+        STATS_ADD(key_presses, 1);
 }
 
 
@@ -58,13 +78,53 @@ void robot_key_release(robot_h robot, int keycode)
 {
         SETUP_JAVA_ENV("keyRelease", "(I)V");
         (*env)->CallVoidMethod(env, robot, method, (jint) keycode);
+        STATS_ADD(key_releases, 1);
+}
+
+
+void robot_set_origin_offset(int dx, int dy)
+{
+        uint64_t offset = ((uint64_t) (uint32_t) dx << 32) | (uint32_t) dy;
+
+        __atomic_store_n(&origin_offset, offset, __ATOMIC_RELAXED);
+}
+
+
+void robot_get_origin_offset(int *dx, int *dy)
+{
+        uint64_t offset = __atomic_load_n(&origin_offset, __ATOMIC_RELAXED);
+
+        *dx = (int32_t) (uint32_t) (offset >> 32);
+        *dy = (int32_t) (uint32_t) offset;
+}
+
+
+rectangle_t robot_translate_rectangle(const rectangle_t rect)
+{
+        rectangle_t translated = rect;
+        int64_t x, y;
+        int dx, dy;
+
+        robot_get_origin_offset(&dx, &dy);
+        x = (int64_t) rect.x + dx;
+        y = (int64_t) rect.y + dy;
+
+        /* The window went (partly) off screen; capture what is left. */
+        translated.x = x < 0 ? 0 : (uint32_t) x;
+        translated.y = y < 0 ? 0 : (uint32_t) y;
+        return translated;
 }
 
 
 void robot_mouse_move(robot_h robot, int x, int y)
 {
+        int dx, dy;
+
         SETUP_JAVA_ENV("mouseMove", "(II)V");
-        (*env)->CallVoidMethod(env, robot, method, (jint) x, (jint) y);
+        robot_get_origin_offset(&dx, &dy);
+        (*env)->CallVoidMethod(
+            env, robot, method, (jint) (x + dx), (jint) (y + dy));
+        STATS_ADD(mouse_moves, 1);
 }
 
 
@@ -72,6 +132,7 @@ void robot_mouse_press(robot_h robot, int button)
 {
         SETUP_JAVA_ENV("mousePress", "(I)V");
         (*env)->CallVoidMethod(env, robot, method, (jint) button);
+        STATS_ADD(mouse_presses, 1);
 }
 
 
@@ -79,6 +140,7 @@ void robot_mouse_release(robot_h robot, int button)
 {
         SETUP_JAVA_ENV("mouseRelease", "(I)V");
         (*env)->CallVoidMethod(env, robot, method, (jint) button);
+        STATS_ADD(mouse_releases, 1);
 }
 
 static jobject java_rectangle_of_rectangle_t(
@@ -104,21 +166,81 @@ static jobject java_rectangle_of_rectangle_t(
         );
 }
 
+/* Same weights and rounding as OpenCV's fixed point RGBA2GRAY. Vision used
+ * to run that on the ARGB ints as bytes, i.e. with blue in the red slot,
+ * so the red and blue weights are swapped here to keep the gray levels (and
+ * the thresholds tuned on them) exactly as they were.
+ */
+static inline uint8_t gray_of_argb(uint32_t argb)
+{
+        uint32_t b = argb & 0xff;
+        uint32_t g = (argb >> 8) & 0xff;
+        uint32_t r = (argb >> 16) & 0xff;
+
+        return (uint8_t) ((b * 4899 + g * 9617 + r * 1868 + (1 << 13)) >> 14);
+}
+
+static void convert_pixels(
+    const uint32_t *argb,
+    uint32_t height,
+    uint32_t width,
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    /* output */ void *dest
+)
+{
+        const uint32_t count = height * width;
+
+        if (format == ROBOT_PIXEL_ARGB32) {
+                memcpy(dest, argb, count * sizeof(uint32_t));
+
+        } else if (format == ROBOT_PIXEL_GRAY8) {
+                uint8_t *out = (uint8_t *) dest;
+
+                for (uint32_t i = 0 ; i < count ; i++) {
+                        out[i] = gray_of_argb(argb[i]);
+                }
+
+        } else {
+                const uint32_t row_bytes = (width + 7) / 8;
+                uint8_t *out = (uint8_t *) dest;
+
+                memset(out, 0, row_bytes * height);
+
+                for (uint32_t y = 0 ; y < height ; y++) {
+                        const uint32_t *row = argb + y * width;
+                        uint8_t *out_row = out + y * row_bytes;
+
+                        for (uint32_t x = 0 ; x < width ; x++) {
+                                if (gray_of_argb(row[x]) > threshold) {
+                                        out_row[x / 8] |= 0x80 >> (x % 8);
+                                }
+                        }
+                }
+        }
+}
+
+/* Fetches all pixels with a single getRGB(IIII[III) call, rather than a
+ * JNI round trip per pixel, and converts them straight out of the Java
+ * array into [dest].
+ */
 static void copy_buffered_image_to_carray(
     JNIEnv *env,
     jobject buffered_image,
     uint32_t height,
     uint32_t width,
-    /* output */ uint32_t *dest
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    /* output */ void *dest
 )
 {
         static jmethodID method = 0;
         const char *method_name = "getRGB";
-        const char *method_signature = "(II)I";
-                                                                            
-        (*jvm)->AttachCurrentThread(jvm, (void **) &env, NULL);             
-                                                                            
-	if (method == 0) {                                                  
+        const char *method_signature = "(IIII[III)[I";
+
+        (*jvm)->AttachCurrentThread(jvm, (void **) &env, NULL);
+
+	if (method == 0) {
                 jclass klass = (*env)->FindClass(env, "java/awt/image/BufferedImage");
                 method = (*env)->GetMethodID(
                     env, klass, method_name, method_signature);
@@ -129,28 +251,86 @@ static void copy_buffered_image_to_carray(
                 }
 	}
 
-        uint32_t pos = 0;
-        for (uint32_t y = 0 ; y < height; y++) {
-          for (uint32_t x = 0 ; x < width ; x++) {
-            dest[pos] = (*env)->CallIntMethod(
-                  env, buffered_image, method, x, y);
-            pos++;
-          }
+        jintArray pixels = (*env)->NewIntArray(env, height * width);
+
+        /* getRGB hands [pixels] back as a new local reference. */
+        jobject returned = (*env)->CallObjectMethod(
+            env, buffered_image, method,
+            0, 0, (jint) width, (jint) height, pixels, 0, (jint) width);
+
+        uint32_t *argb = (uint32_t *) (*env)->GetPrimitiveArrayCritical(
+            env, pixels, NULL);
+        convert_pixels(argb, height, width, format, threshold, dest);
+        (*env)->ReleasePrimitiveArrayCritical(env, pixels, argb, JNI_ABORT);
+        (*env)->DeleteLocalRef(env, returned);
+        (*env)->DeleteLocalRef(env, pixels);
+}
+
+
+size_t robot_screenshot_size(
+    const rectangle_t rect,
+    robot_pixel_format_t format
+)
+{
+        if (format == ROBOT_PIXEL_ARGB32) {
+                return (size_t) rect.height * rect.width * sizeof(uint32_t);
+        } else if (format == ROBOT_PIXEL_GRAY8) {
+                return (size_t) rect.height * rect.width;
+        } else {
+                return (size_t) rect.height * ((rect.width + 7) / 8);
         }
 }
 
 
-void robot_screenshot(robot_h robot, const rectangle_t rect, uint32_t *dest)
+void robot_screenshot_absolute(
+    robot_h robot,
+    const rectangle_t rect,
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    void *dest
+)
 {
         SETUP_JAVA_ENV(
             "createScreenCapture",
             "(Ljava/awt/Rectangle;)Ljava/awt/image/BufferedImage;"
         );
+        uint64_t start = monotonic_nanos();
         jobject rectangle_object = java_rectangle_of_rectangle_t(env, rect);
         jobject buffered_image = (*env)->CallObjectMethod(
             env, robot, method, rectangle_object);
         copy_buffered_image_to_carray(
-            env, buffered_image, rect.height, rect.width, dest);
+            env, buffered_image, rect.height, rect.width,
+            format, threshold, dest);
+
+        /* We are called from within entry_point, which runs for the whole
+         * session, so local references would otherwise pile up.
+         */
+        (*env)->DeleteLocalRef(env, buffered_image);
+        (*env)->DeleteLocalRef(env, rectangle_object);
+
+        STATS_ADD(screenshots, 1);
+        STATS_ADD(screenshot_pixels, (uint64_t) rect.height * rect.width);
+        STATS_ADD(screenshot_bytes, robot_screenshot_size(rect, format));
+        STATS_ADD(screenshot_nanos, monotonic_nanos() - start);
+}
+
+
+void robot_screenshot_format(
+    robot_h robot,
+    const rectangle_t rect,
+    robot_pixel_format_t format,
+    uint8_t threshold,
+    void *dest
+)
+{
+        robot_screenshot_absolute(
+            robot, robot_translate_rectangle(rect), format, threshold, dest);
+}
+
+
+void robot_screenshot(robot_h robot, const rectangle_t rect, uint32_t *dest)
+{
+        robot_screenshot_format(robot, rect, ROBOT_PIXEL_ARGB32, 0, dest);
 }
 
 
@@ -158,3 +338,23 @@ void robot_free(robot_h robot)
 {
         // dealloc object?
 }
+
+
+void robot_get_stats(robot_stats_t *out)
+{
+        out->screenshots = __atomic_load_n(&stats.screenshots, __ATOMIC_RELAXED);
+        out->screenshot_pixels =
+            __atomic_load_n(&stats.screenshot_pixels, __ATOMIC_RELAXED);
+        out->screenshot_bytes =
+            __atomic_load_n(&stats.screenshot_bytes, __ATOMIC_RELAXED);
+        out->screenshot_nanos =
+            __atomic_load_n(&stats.screenshot_nanos, __ATOMIC_RELAXED);
+        out->mouse_moves = __atomic_load_n(&stats.mouse_moves, __ATOMIC_RELAXED);
+        out->mouse_presses =
+            __atomic_load_n(&stats.mouse_presses, __ATOMIC_RELAXED);
+        out->mouse_releases =
+            __atomic_load_n(&stats.mouse_releases, __ATOMIC_RELAXED);
+        out->key_presses = __atomic_load_n(&stats.key_presses, __ATOMIC_RELAXED);
+        out->key_releases =
+            __atomic_load_n(&stats.key_releases, __ATOMIC_RELAXED);
+}
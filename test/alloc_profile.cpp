@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+#ifdef ALLOC_PROFILE
+#include <dlfcn.h>
+#endif
+
+#include "alloc_profile.hpp"
+
+namespace {
+
+struct phase_allocs_t {
+  std::atomic<uint64_t> allocations;
+  std::atomic<uint64_t> frees;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> throws;
+};
+
+static phase_allocs_t allocs[NUM_TRACE_PHASES];
+
+}
+
+#ifdef ALLOC_PROFILE
+
+/* Sizes are not recorded with the allocation: memory allocated by the
+ * standard library's own operator new may end up freed here, so there is no
+ * header we could rely on. Frees are counted, bytes freed are not.
+ */
+
+static void *counted_malloc(size_t size)
+{
+  phase_allocs_t & a = allocs[trace_current_phase()];
+
+  a.allocations.fetch_add(1, std::memory_order_relaxed);
+  a.bytes.fetch_add(size, std::memory_order_relaxed);
+
+  return malloc(size ? size : 1);
+}
+
+static void counted_free(void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  allocs[trace_current_phase()].frees.fetch_add(1, std::memory_order_relaxed);
+  free(ptr);
+}
+
+static void *counted_new(size_t size)
+{
+  while (true) {
+    void *ptr = counted_malloc(size);
+
+    if (ptr != NULL) {
+      return ptr;
+    }
+
+    std::new_handler handler = std::get_new_handler();
+
+    if (handler == NULL) {
+      throw std::bad_alloc();
+    }
+
+    handler();
+  }
+}
+
+void *operator new(size_t size)
+{
+  return counted_new(size);
+}
+
+void *operator new[](size_t size)
+{
+  return counted_new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_malloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_malloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  counted_free(ptr);
+}
+
+/* Every throw goes through the C++ runtime's __cxa_throw: counted here,
+ * then passed on to the runtime's own. [type] is a std::type_info, but the
+ * compiler declares it void *.
+ */
+typedef void (*cxa_throw_t)(void *, void *, void (*)(void *));
+
+extern "C" void __cxa_throw(
+    void *thrown, void *type, void (*destructor)(void *))
+{
+  static const cxa_throw_t runtime_throw =
+    (cxa_throw_t) dlsym(RTLD_NEXT, "__cxa_throw");
+
+  allocs[trace_current_phase()].throws.fetch_add(
+      1, std::memory_order_relaxed);
+  runtime_throw(thrown, type, destructor);
+  abort();
+}
+
+#endif
+
+bool alloc_profile_enabled()
+{
+#ifdef ALLOC_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+void alloc_profile_reset()
+{
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    allocs[i].allocations = 0;
+    allocs[i].frees = 0;
+    allocs[i].bytes = 0;
+    allocs[i].throws = 0;
+  }
+}
+
+alloc_stats_t alloc_profile_phase_stats(trace_phase_t phase)
+{
+  alloc_stats_t stats;
+
+  stats.allocations = allocs[phase].allocations;
+  stats.frees = allocs[phase].frees;
+  stats.bytes = allocs[phase].bytes;
+  stats.throws = allocs[phase].throws;
+  return stats;
+}
+
+uint64_t alloc_profile_throws()
+{
+  uint64_t throws = 0;
+
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    throws += allocs[i].throws;
+  }
+
+  return throws;
+}
+
+void alloc_profile_print_report(std::ostream & out, uint64_t decisions)
+{
+  char line[200];
+  const double per = decisions ? 1.0 / double(decisions) : 0.0;
+
+  if (!alloc_profile_enabled()) {
+    out << "(allocation profiling not compiled in, see ALLOC_PROFILE)\n";
+    return;
+  }
+
+  snprintf(line, sizeof(line), "%-16s %14s %14s %16s %16s %8s\n",
+      "phase", "allocations", "bytes", "allocs/decision", "bytes/decision",
+      "throws");
+  out << ">> Allocation report over " << decisions << " decisions\n" << line;
+
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    alloc_stats_t stats = alloc_profile_phase_stats(trace_phase_t(i));
+
+    if (stats.allocations == 0 && stats.throws == 0) {
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "%-16s %14lu %14lu %16.1f %16.1f %8lu\n",
+        trace_phase_name(trace_phase_t(i)),
+        (unsigned long) stats.allocations,
+        (unsigned long) stats.bytes,
+        double(stats.allocations) * per,
+        double(stats.bytes) * per,
+        (unsigned long) stats.throws);
+    out << line;
+  }
+
+  out << "<< End of allocation report\n";
+}
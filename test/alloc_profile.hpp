@@ -0,0 +1,40 @@
+#ifndef ALLOC_PROFILE_HPP
+#define ALLOC_PROFILE_HPP
+
+#include <stdint.h>
+
+#include <iostream>
+
+#include "trace.hpp"
+
+/* Heap allocation counts per trace phase (see trace.hpp).
+ *
+ * Built with ALLOC_PROFILE defined (make ALLOC_PROFILE=1), the global
+ * operator new / delete are replaced by counting versions. Allocations
+ * are attributed to the innermost phase of the allocating thread, so unlike
+ * the timings in trace.hpp, the phases add up to the total.
+ *
+ * Exceptions thrown are counted the same way (__cxa_throw is interposed),
+ * to check that searches, which try many moves, never unwind.
+ *
+ * Without ALLOC_PROFILE, nothing is interposed and all counts stay 0.
+ */
+
+struct alloc_stats_t {
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t bytes;  /* Requested bytes, over all allocations. */
+  uint64_t throws;
+};
+
+bool alloc_profile_enabled();
+void alloc_profile_reset();
+alloc_stats_t alloc_profile_phase_stats(trace_phase_t phase);
+
+/* Exceptions thrown so far, over all phases. */
+uint64_t alloc_profile_throws();
+
+/* Prints allocations and bytes per phase, per decision. */
+void alloc_profile_print_report(std::ostream & out, uint64_t decisions);
+
+#endif
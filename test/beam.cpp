@@ -0,0 +1,289 @@
+#include <algorithm>
+
+#include "beam.hpp"
+#include "prune.hpp"
+#include "metrics.hpp"
+
+/* Beam nodes handed to a worker at a time. */
+static const uint32_t CHUNK_SIZE = 16;
+
+/* Weights of beam_score. */
+static const int32_t SCORE_FACE_DOWN = -100;
+static const int32_t SCORE_BLOCKING = -1;  /* Face up on a face down card. */
+static const int32_t SCORE_HOME = 5;
+static const int32_t SCORE_EMPTY_COLUMN = 10;
+
+beam_options_t beam_default_options()
+{
+  beam_options_t options;
+
+  options.width = 64;
+  options.depth = 6;
+  options.threads = 1;
+  options.pruning = PRUNE_ALL;
+  options.cancel = NULL;
+
+  return options;
+}
+
+int32_t beam_score(const packed_state_t & state)
+{
+  int32_t score = 0;
+
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    score += SCORE_HOME * state.foundation[suite];
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (state.num_down[deck] != 0) {
+      score += SCORE_FACE_DOWN * state.num_down[deck]
+        + SCORE_BLOCKING * (state.num_cards[deck] - state.num_down[deck]);
+    } else if (state.num_cards[deck] == 0) {
+      score += SCORE_EMPTY_COLUMN;
+    }
+  }
+
+  return score;
+}
+
+/* Ties are broken on the hash, so results don't depend on which worker
+ * got to a state first.
+ */
+static bool better(const beam_node_t & a, const beam_node_t & b)
+{
+  return a.score > b.score
+    || (a.score == b.score && a.state.hash < b.state.hash);
+}
+
+static bool by_hash(const beam_node_t & a, const beam_node_t & b)
+{
+  return a.state.hash < b.state.hash
+    || (a.state.hash == b.state.hash && a.first_move < b.first_move);
+}
+
+beam_search_t::beam_search_t(const beam_options_t & options)
+  : options(options),
+    generation(0),
+    busy_workers(0),
+    stopping(false),
+    frontier(NULL),
+    next_index(0)
+{
+  const uint32_t threads = std::max<uint32_t>(options.threads, 1);
+
+  children.resize(threads);
+
+  /* The calling thread is worker 0. */
+  for (uint32_t i = 1 ; i < threads ; i++) {
+    workers.push_back(std::thread(&beam_search_t::worker_loop, this, i));
+  }
+}
+
+beam_search_t::~beam_search_t()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  work_ready.notify_all();
+
+  for (std::thread & worker : workers) {
+    worker.join();
+  }
+}
+
+void beam_search_t::worker_loop(uint32_t worker)
+{
+  uint64_t done_generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work_ready.wait(lock, [&]() {
+        return stopping || generation != done_generation;
+      });
+
+      if (stopping) {
+        return;
+      }
+
+      done_generation = generation;
+    }
+
+    expand_chunks(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      busy_workers--;
+    }
+
+    work_done.notify_one();
+  }
+}
+
+void beam_search_t::expand_chunks(uint32_t worker)
+{
+  const std::vector<beam_node_t> & nodes = *frontier;
+  std::vector<beam_node_t> & out = children[worker];
+  solver_move_t moves[SOLVER_MAX_MOVES];
+
+  while (true) {
+    const uint32_t begin = next_index.fetch_add(CHUNK_SIZE);
+    const uint32_t end = std::min<uint32_t>(begin + CHUNK_SIZE, nodes.size());
+
+    if (begin >= nodes.size()) {
+      return;
+    }
+
+    for (uint32_t i = begin ; i < end ; i++) {
+      const beam_node_t & node = nodes[i];
+      prune_context_t context;
+
+      context.previous = node.last_move;
+      context.previous_revealed = node.last_revealed;
+
+      const uint32_t num_moves = prune_moves(
+          node.state, context, moves,
+          solver_generate_moves(node.state, moves), options.pruning);
+
+      for (uint32_t j = 0 ; j < num_moves ; j++) {
+        beam_node_t child;
+        const uint32_t source = solver_move_source(moves[j]);
+
+        child.state = node.state;
+        child.first_move = node.first_move ? node.first_move : moves[j];
+        child.last_move = moves[j];
+        child.last_revealed = solver_apply_move(&child.state, moves[j]);
+        child.terminal = child.last_revealed
+          && child.state.cards[source][child.state.num_down[source]]
+             == SOLVER_UNKNOWN_CARD;
+        child.score = beam_score(child.state);
+
+        out.push_back(child);
+      }
+    }
+  }
+}
+
+void beam_search_t::expand_frontier()
+{
+  next_index = 0;
+
+  for (std::vector<beam_node_t> & out : children) {
+    out.clear();
+  }
+
+  if (workers.empty()) {
+    expand_chunks(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    busy_workers = workers.size();
+  }
+
+  work_ready.notify_all();
+  expand_chunks(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  work_done.wait(lock, [&]() { return busy_workers == 0; });
+}
+
+beam_result_t beam_search_t::search(
+    const packed_state_t & root, uint64_t deadline_us)
+{
+  static const char *const RESULTS[] = { "move", "none" };
+  static metric_counter_t & nodes_total = metrics_counter(
+      "beam_nodes_total", "States kept by beam searches, after dedup");
+  static const metric_counter_table_t<2> searches(
+      "beam_searches_total",
+      "Beam searches, by whether they found a move",
+      "result",
+      RESULTS);
+  beam_result_t result;
+  std::vector<beam_node_t> beam;
+  std::vector<beam_node_t> next;
+  beam_node_t best;
+
+  best.state = root;
+  best.first_move = 0;
+  best.last_move = 0;
+  best.last_revealed = false;
+  best.score = beam_score(root);
+  best.terminal = false;
+
+  result.has_move = false;
+  result.move = 0;
+  result.root_score = best.score;
+  result.line_length = 0;
+  result.nodes = 0;
+
+  seen.clear();
+  seen.insert(root.hash);
+  beam.push_back(best);
+
+  /* Moves are never 0 (a column onto itself), so a first_move of 0 marks
+   * the root.
+   */
+  for (uint32_t depth = 1 ; depth <= options.depth && !beam.empty() ; depth++) {
+    if ((options.cancel != NULL
+         && options.cancel->load(std::memory_order_relaxed))
+        || (deadline_us != 0 && metrics_now_us() > deadline_us)) {
+      break;
+    }
+
+    frontier = &beam;
+    expand_frontier();
+    next.clear();
+
+    for (const std::vector<beam_node_t> & out : children) {
+      next.insert(next.end(), out.begin(), out.end());
+    }
+
+    /* Of the lines to a state, the one with the lowest first move stays. */
+    std::sort(next.begin(), next.end(), by_hash);
+    next.erase(
+        std::remove_if(next.begin(), next.end(),
+          [&](const beam_node_t & node) {
+            return !seen.insert(node.state.hash).second;
+          }),
+        next.end());
+
+    /* Shorter lines win ties. */
+    for (const beam_node_t & child : next) {
+      if (child.score > best.score
+          || (result.line_length == depth && better(child, best))) {
+        best = child;
+        result.line_length = depth;
+      }
+    }
+
+    result.nodes += next.size();
+
+    /* Lines that turned over an unknown card were scored, and end. */
+    next.erase(
+        std::remove_if(next.begin(), next.end(),
+          [](const beam_node_t & node) { return node.terminal; }),
+        next.end());
+
+    if (next.size() > options.width) {
+      std::nth_element(
+          next.begin(), next.begin() + options.width, next.end(), better);
+      next.resize(options.width);
+    }
+
+    beam.swap(next);
+  }
+
+  result.has_move = best.score > result.root_score;
+  result.move = best.first_move;
+  result.score = best.score;
+
+  nodes_total.inc(result.nodes);
+  searches[result.has_move ? 0 : 1].inc();
+
+  return result;
+}
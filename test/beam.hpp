@@ -0,0 +1,101 @@
+#ifndef BEAM_HPP
+#define BEAM_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "solver.hpp"
+
+/* A cheaper alternative to solving: keeps the [width] best states by a
+ * static evaluation at each depth, rather than every state, and returns
+ * the first move of the best line seen.
+ *
+ * Moves and states are the solver's (see solver.hpp). Face down cards are
+ * unknown, so a line ends when it turns one over, and is scored there.
+ *
+ * Each depth is expanded in parallel by a pool of worker threads that
+ * take the beam in chunks; children are then deduplicated by hash, against
+ * every state seen in the search, and the best [width] kept. Workers are
+ * started once and wait between searches.
+ */
+
+struct beam_options_t {
+  uint32_t width;    /* States kept per depth. */
+  uint32_t depth;    /* Moves looked ahead. */
+  uint32_t threads;  /* 1 expands on the calling thread. */
+  uint32_t pruning;  /* Or of prune_rule_t, see prune.hpp. */
+
+  /* Stops the search after the depth being expanded when set. NULL for
+   * never.
+   */
+  const std::atomic<bool> *cancel;
+};
+
+beam_options_t beam_default_options();
+
+struct beam_result_t {
+  bool has_move;       /* False if no line does better than standing still. */
+  solver_move_t move;  /* First move of the best line. */
+  int32_t score;       /* Of the best line, against the root's. */
+  int32_t root_score;
+  uint32_t line_length;
+  uint64_t nodes;
+};
+
+/* Static evaluation of a state, higher is better. */
+int32_t beam_score(const packed_state_t & state);
+
+struct beam_node_t {
+  packed_state_t state;
+  solver_move_t first_move;
+  solver_move_t last_move;
+  bool last_revealed;
+  int32_t score;
+  bool terminal;  /* Turned over an unknown card, not expanded further. */
+};
+
+class beam_search_t {
+private:
+  beam_options_t options;
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  uint64_t generation;
+  uint32_t busy_workers;
+  bool stopping;
+
+  /* The depth being expanded, and a child list per worker. */
+  const std::vector<beam_node_t> *frontier;
+  std::atomic<uint32_t> next_index;
+  std::vector<std::vector<beam_node_t>> children;
+
+  std::unordered_set<uint64_t> seen;
+
+  beam_search_t(const beam_search_t &);
+  beam_search_t & operator=(const beam_search_t &);
+
+  void worker_loop(uint32_t worker);
+  void expand_chunks(uint32_t worker);
+  void expand_frontier();
+
+public:
+  explicit beam_search_t(const beam_options_t & options);
+  ~beam_search_t();
+
+  const beam_options_t & get_options() const { return options; }
+
+  /* Stops after the depth being expanded past [deadline_us] (on the
+   * metrics_now_us() clock), unless it is 0.
+   */
+  beam_result_t search(const packed_state_t & root, uint64_t deadline_us = 0);
+};
+
+#endif
@@ -0,0 +1,347 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "belief.hpp"
+
+/* Rejection sampling gives up after this many deals in a row that don't
+ * fit the masks.
+ */
+static const uint32_t MAX_SAMPLE_ATTEMPTS = 100000;
+
+static inline uint64_t card_bit(uint32_t index)
+{
+  return uint64_t(1) << index;
+}
+
+/* Uniform in [0, n), n being tiny next to 2^32. */
+static inline uint32_t next_below(uint64_t *state, uint32_t n)
+{
+  return uint32_t(((splitmix64_next(state) >> 32) * n) >> 32);
+}
+
+static belief_count_t falling_factorial(uint32_t n, uint32_t k)
+{
+  belief_count_t result = 1;
+
+  for (uint32_t i = 0 ; i < k ; i++) {
+    result *= n - i;
+  }
+
+  return result;
+}
+
+/* Number of ways to give each of [rows] a distinct card of [unseen], within
+ * its mask.
+ *
+ * With rows padded up to as many as there are cards by rows that take any
+ * card, that's the permanent of a square 0/1 matrix divided by the number
+ * of ways to fill the padding, and the permanent is worked out with
+ * Ryser's formula. Its terms are summed modulo 2^128, which is exact as
+ * the permanent itself is below 24! < 2^128.
+ */
+static belief_count_t count_deals(
+    uint64_t unseen, const uint64_t *rows, uint32_t num_rows)
+{
+  uint8_t columns[NUM_CARDS];
+  uint32_t n = 0;
+  bool uniform = true;
+
+  for (uint32_t i = 0 ; i < NUM_CARDS ; i++) {
+    if (unseen & card_bit(i)) {
+      columns[n++] = i;
+    }
+  }
+
+  if (num_rows > n) {
+    return 0;
+  }
+
+  for (uint32_t i = 0 ; i < num_rows ; i++) {
+    uniform = uniform && (rows[i] & unseen) == unseen;
+  }
+
+  if (uniform) {
+    return falling_factorial(n, num_rows);
+  }
+
+  if (n > BELIEF_MAX_EXACT_CARDS) {
+    throw BeliefException();
+  }
+
+  uint32_t compact[7 * BELIEF_MAX_HIDDEN];
+
+  for (uint32_t i = 0 ; i < num_rows ; i++) {
+    compact[i] = 0;
+
+    for (uint32_t c = 0 ; c < n ; c++) {
+      if (rows[i] & card_bit(columns[c])) {
+        compact[i] |= 1u << c;
+      }
+    }
+  }
+
+  const uint32_t padding = n - num_rows;
+  belief_count_t permanent = 0;
+
+  for (uint32_t subset = 1 ; subset < (1u << n) ; subset++) {
+    const uint32_t size = __builtin_popcount(subset);
+    belief_count_t product = 1;
+
+    for (uint32_t i = 0 ; i < num_rows && product != 0 ; i++) {
+      product *= __builtin_popcount(compact[i] & subset);
+    }
+
+    for (uint32_t i = 0 ; i < padding && product != 0 ; i++) {
+      product *= size;
+    }
+
+    if ((n - size) % 2 == 0) {
+      permanent += product;
+    } else {
+      permanent -= product;
+    }
+  }
+
+  return permanent / falling_factorial(padding, padding);
+}
+
+std::string belief_count_to_string(belief_count_t count)
+{
+  std::string digits;
+
+  do {
+    digits.push_back(char('0' + uint32_t(count % 10)));
+    count /= 10;
+  } while (count != 0);
+
+  std::reverse(digits.begin(), digits.end());
+  return digits;
+}
+
+belief_t::belief_t()
+{
+  unseen_mask = card_bit(NUM_CARDS) - 1;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    hidden[deck] = deck;
+
+    for (uint32_t depth = 0 ; depth < BELIEF_MAX_HIDDEN ; depth++) {
+      masks[deck][depth] = depth < deck ? unseen_mask : 0;
+    }
+  }
+
+  refresh();
+}
+
+void belief_t::refresh()
+{
+  num_unseen = 0;
+  num_slots = 0;
+  uniform = true;
+
+  for (uint32_t i = 0 ; i < NUM_CARDS ; i++) {
+    if (unseen_mask & card_bit(i)) {
+      unseen_cards[num_unseen++] = i;
+    }
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    for (uint32_t depth = 0 ; depth < hidden[deck] ; depth++) {
+      uniform = uniform && masks[deck][depth] == unseen_mask;
+      num_slots++;
+    }
+  }
+}
+
+void belief_t::update(const game_state_t & state, uint64_t known_pile)
+{
+  uint64_t seen = known_pile;
+
+  /* Face down cards only ever get fewer, within a game. */
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (state.tableau[deck].num_down_cards > hidden[deck]) {
+      *this = belief_t();
+      break;
+    }
+  }
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    if (state.foundation[i].is_some()) {
+      const card_t top = state.foundation[i].get();
+
+      for (uint32_t number = ACE ; number <= uint32_t(top.number) ; number++) {
+        card_t card = { .suite = top.suite, .number = number_t(number) };
+        seen |= card_bit(card_index(card));
+      }
+    }
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    for (const card_t & card : state.tableau[deck].cards) {
+      seen |= card_bit(card_index(card));
+    }
+  }
+
+  if (state.waste_pile_top.is_some()) {
+    seen |= card_bit(card_index(state.waste_pile_top.get()));
+  }
+
+  unseen_mask &= ~seen;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    hidden[deck] = state.tableau[deck].num_down_cards;
+
+    for (uint32_t depth = 0 ; depth < BELIEF_MAX_HIDDEN ; depth++) {
+      masks[deck][depth] = depth < hidden[deck]
+        ? masks[deck][depth] & unseen_mask
+        : 0;
+    }
+  }
+
+  refresh();
+}
+
+void belief_t::exclude(uint32_t deck, uint32_t depth, const card_t & card)
+{
+  masks[deck][depth] &= ~card_bit(card_index(card));
+  refresh();
+}
+
+void belief_t::pin(uint32_t deck, uint32_t depth, const card_t & card)
+{
+  const uint64_t bit = card_bit(card_index(card));
+
+  for (uint32_t d = 0 ; d < 7 ; d++) {
+    for (uint32_t i = 0 ; i < hidden[d] ; i++) {
+      masks[d][i] &= ~bit;
+    }
+  }
+
+  masks[deck][depth] = bit & unseen_mask;
+  refresh();
+}
+
+Option<card_t> belief_t::known(uint32_t deck, uint32_t depth) const
+{
+  const uint64_t mask = masks[deck][depth];
+
+  if (depth >= hidden[deck] || mask == 0 || (mask & (mask - 1)) != 0) {
+    return Option<card_t>();
+  }
+
+  return Option<card_t>(card_of_index(__builtin_ctzll(mask)));
+}
+
+void belief_t::sample(uint64_t *rng, belief_sample_t *out) const
+{
+  uint8_t pool[NUM_CARDS];
+  uint32_t pool_size = 0;
+  uint64_t pinned = 0;
+  uint32_t num_pinned = 0;
+
+  /* Slots down to one card (eg. peeked at) are dealt it straight away:
+   * rejection would hardly ever draw it.
+   */
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    for (uint32_t depth = 0 ; depth < hidden[deck] ; depth++) {
+      const uint64_t mask = masks[deck][depth];
+
+      if (mask == 0 || (mask & (mask - 1)) != 0) {
+        continue;
+      }
+
+      if (pinned & mask) {
+        throw BeliefException();
+      }
+
+      pinned |= mask;
+      num_pinned++;
+    }
+  }
+
+  for (uint32_t i = 0 ; i < num_unseen ; i++) {
+    if (!(pinned & card_bit(unseen_cards[i]))) {
+      pool[pool_size++] = unseen_cards[i];
+    }
+  }
+
+  if (num_slots > num_pinned + pool_size) {
+    throw BeliefException();
+  }
+
+  /* A partial Fisher-Yates shuffle deals uniformly; when the masks are
+   * narrower than the unseen cards, deals that don't fit are rejected,
+   * which keeps the ones that do uniform.
+   */
+  for (uint32_t attempt = 0 ; attempt < MAX_SAMPLE_ATTEMPTS ; attempt++) {
+    uint32_t dealt = 0;
+    bool fits = true;
+
+    for (uint32_t deck = 0 ; deck < 7 && fits ; deck++) {
+      for (uint32_t depth = 0 ; depth < hidden[deck] ; depth++) {
+        const uint64_t mask = masks[deck][depth];
+
+        if (mask != 0 && (mask & (mask - 1)) == 0) {
+          out->cards[deck][depth] = __builtin_ctzll(mask);
+          continue;
+        }
+
+        const uint32_t pick =
+          dealt + next_below(rng, pool_size - dealt);
+
+        std::swap(pool[dealt], pool[pick]);
+        out->cards[deck][depth] = pool[dealt];
+        dealt++;
+
+        if (!uniform && !(masks[deck][depth] & card_bit(pool[dealt - 1]))) {
+          fits = false;
+          break;
+        }
+      }
+    }
+
+    if (fits) {
+      return;
+    }
+  }
+
+  throw BeliefException();
+}
+
+belief_count_t belief_t::count() const
+{
+  uint64_t rows[7 * BELIEF_MAX_HIDDEN];
+  uint32_t num_rows = 0;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    for (uint32_t depth = 0 ; depth < hidden[deck] ; depth++) {
+      rows[num_rows++] = masks[deck][depth];
+    }
+  }
+
+  return count_deals(unseen_mask, rows, num_rows);
+}
+
+belief_count_t belief_t::count_with(
+    uint32_t deck, uint32_t depth, const card_t & card) const
+{
+  const uint64_t bit = card_bit(card_index(card));
+  uint64_t rows[7 * BELIEF_MAX_HIDDEN];
+  uint32_t num_rows = 0;
+
+  if (depth >= hidden[deck] || !(masks[deck][depth] & bit)) {
+    return 0;
+  }
+
+  /* The other slots, dealt from what is left once [card] is placed. */
+  for (uint32_t d = 0 ; d < 7 ; d++) {
+    for (uint32_t j = 0 ; j < hidden[d] ; j++) {
+      if (d != deck || j != depth) {
+        rows[num_rows++] = masks[d][j] & ~bit;
+      }
+    }
+  }
+
+  return count_deals(unseen_mask & ~bit, rows, num_rows);
+}
@@ -0,0 +1,104 @@
+#ifndef BELIEF_HPP
+#define BELIEF_HPP
+
+#include <stdint.h>
+
+#include <exception>
+#include <string>
+
+#include "game.hpp"
+
+/* What the face down cards of the tableau can still be.
+ *
+ * Every face down slot has a 52-bit mask of the cards it can be (bit
+ * [card_index]). A card seen anywhere (tableau, foundation, or the stock
+ * pile, which is known in full after strategy_init) is cleared from every
+ * mask, and a slot disappears when its card is revealed, so updating after
+ * a move is a handful of and-nots.
+ *
+ * A deal is an assignment of distinct cards to the face down slots, each
+ * within its slot's mask. Deals can be sampled uniformly and counted
+ * exactly, for decision making that looks at what might be under the
+ * cards.
+ */
+
+/* Slots are [deck][depth], depth 0 being the bottom of the deck. */
+const uint32_t BELIEF_MAX_HIDDEN = 6;
+
+/* General (non uniform masks) exact counts are exponential in the number
+ * of unseen cards, and refused past this.
+ */
+const uint32_t BELIEF_MAX_EXACT_CARDS = 24;
+
+/* Thrown when asked for something the belief can't do in reasonable time,
+ * or that doesn't exist (no consistent deal).
+ */
+class BeliefException : public std::exception {
+};
+
+/* Enough for any number of deals of 52 cards, exactly. */
+typedef unsigned __int128 belief_count_t;
+
+std::string belief_count_to_string(belief_count_t count);
+
+/* A deal of the face down slots, as card indices. */
+struct belief_sample_t {
+  uint8_t cards[7][BELIEF_MAX_HIDDEN];
+};
+
+class belief_t {
+private:
+  uint64_t masks[7][BELIEF_MAX_HIDDEN];
+  uint32_t hidden[7];
+  uint64_t unseen_mask;
+
+  /* Derived from the above by [refresh]. */
+  uint8_t unseen_cards[NUM_CARDS];
+  uint32_t num_unseen;
+  uint32_t num_slots;
+  bool uniform;  /* Every mask is [unseen_mask]. */
+
+  void refresh();
+
+public:
+  /* The initial deal: deck d has d face down slots, nothing is seen. */
+  belief_t();
+
+  /* Catches up with [state]: slots revealed since, cards seen in it or in
+   * [known_pile] (bit [card_index] of the stock and waste pile cards, as
+   * far as they are known).
+   */
+  void update(const game_state_t & state, uint64_t known_pile);
+
+  /* Rules [card] out of one slot only, eg. after peeking. */
+  void exclude(uint32_t deck, uint32_t depth, const card_t & card);
+
+  /* [card] is at the slot, and so at no other: seen and turned back face
+   * down (see peek.hpp).
+   */
+  void pin(uint32_t deck, uint32_t depth, const card_t & card);
+
+  /* The card at the slot, if it is down to one. */
+  Option<card_t> known(uint32_t deck, uint32_t depth) const;
+
+  uint32_t num_hidden(uint32_t deck) const { return hidden[deck]; }
+  uint32_t num_hidden_slots() const { return num_slots; }
+  uint32_t num_unseen_cards() const { return num_unseen; }
+  uint64_t unseen() const { return unseen_mask; }
+  uint64_t candidates(uint32_t deck, uint32_t depth) const {
+    return masks[deck][depth];
+  }
+
+  /* Draws a deal uniformly from the consistent ones, [rng] being a
+   * splitmix64 state. Throws [BeliefException] if, with narrowed down
+   * masks, no consistent deal turns up within a bounded number of tries.
+   */
+  void sample(uint64_t *rng, belief_sample_t *out) const;
+
+  /* Number of consistent deals, and of those with [card] at the slot. */
+  belief_count_t count() const;
+  belief_count_t count_with(
+      uint32_t deck, uint32_t depth, const card_t & card) const;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "bloom.hpp"
+
+static const uint32_t CACHE_LINE_BYTES = 64;
+static const uint32_t BLOCK_BITS = CACHE_LINE_BYTES * 8;
+static const uint32_t MAX_HASHES = 16;
+
+struct bloom_filter_t::block_t {
+  uint64_t words[CACHE_LINE_BYTES / sizeof(uint64_t)];
+};
+
+static uint32_t optimal_num_hashes(uint64_t bits, uint64_t items)
+{
+  double k = round(double(bits) / double(items) * log(2.0));
+
+  if (k < 1) {
+    return 1;
+  } else if (k > MAX_HASHES) {
+    return MAX_HASHES;
+  }
+  return uint32_t(k);
+}
+
+/* The block is picked with the raw hash, the probes within the block with
+ * a remixed one, so the two are independent.
+ */
+static uint64_t remix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+bloom_filter_t::bloom_filter_t(const bloom_config_t & config)
+{
+  const uint64_t items = config.expected_items ? config.expected_items : 1;
+  double p = config.false_positive_rate;
+
+  if (p <= 0 || p >= 1) {
+    p = 0.01;
+  }
+
+  const double ln2 = log(2.0);
+  uint64_t bits = uint64_t(ceil(-double(items) * log(p) / (ln2 * ln2)));
+
+  num_blocks = (bits + BLOCK_BITS - 1) / BLOCK_BITS;
+
+  if (config.max_bytes != 0
+      && num_blocks * CACHE_LINE_BYTES > config.max_bytes) {
+    num_blocks = config.max_bytes / CACHE_LINE_BYTES;
+  }
+  if (num_blocks == 0) {
+    num_blocks = 1;
+  }
+
+  num_hashes_ = optimal_num_hashes(num_blocks * BLOCK_BITS, items);
+
+  void *memory;
+  if (posix_memalign(&memory, CACHE_LINE_BYTES, size_bytes()) != 0) {
+    throw std::bad_alloc();
+  }
+  blocks = static_cast<block_t *>(memory);
+
+  clear();
+  reset_stats();
+}
+
+bloom_filter_t::~bloom_filter_t()
+{
+  free(blocks);
+}
+
+static inline uint64_t block_of_hash(uint64_t hash, uint64_t num_blocks)
+{
+  /* Fast range reduction, avoids a division per lookup. */
+  return uint64_t(((unsigned __int128) hash * num_blocks) >> 64);
+}
+
+bool bloom_filter_t::contains(uint64_t hash) const
+{
+  const block_t & block = blocks[block_of_hash(hash, num_blocks)];
+  const uint64_t h = remix(hash);
+  uint32_t probe = uint32_t(h);
+  const uint32_t step = uint32_t(h >> 32) | 1;
+
+  for (uint32_t i = 0 ; i < num_hashes_ ; i++, probe += step) {
+    const uint32_t bit = probe % BLOCK_BITS;
+
+    if (!(block.words[bit / 64] & (1ULL << (bit % 64)))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void bloom_filter_t::insert(uint64_t hash)
+{
+  block_t & block = blocks[block_of_hash(hash, num_blocks)];
+  const uint64_t h = remix(hash);
+  uint32_t probe = uint32_t(h);
+  const uint32_t step = uint32_t(h >> 32) | 1;
+
+  for (uint32_t i = 0 ; i < num_hashes_ ; i++, probe += step) {
+    const uint32_t bit = probe % BLOCK_BITS;
+    block.words[bit / 64] |= (1ULL << (bit % 64));
+  }
+
+  load++;
+  stats_.insertions++;
+}
+
+bool bloom_filter_t::test_and_insert(uint64_t hash)
+{
+  stats_.lookups++;
+
+  if (contains(hash)) {
+    stats_.hits++;
+    return true;
+  }
+
+  insert(hash);
+  return false;
+}
+
+void bloom_filter_t::clear()
+{
+  memset(blocks, 0, size_bytes());
+  load = 0;
+}
+
+size_t bloom_filter_t::size_bytes() const
+{
+  return num_blocks * CACHE_LINE_BYTES;
+}
+
+uint32_t bloom_filter_t::num_hashes() const
+{
+  return num_hashes_;
+}
+
+double bloom_filter_t::estimated_false_positive_rate() const
+{
+  /* Classic Bloom filter estimate. Blocking makes the real rate somewhat
+   * higher, mostly noticeable at high load.
+   */
+  const double bits = double(num_blocks * BLOCK_BITS);
+  const double k = num_hashes_;
+
+  return pow(1.0 - exp(-k * double(load) / bits), k);
+}
+
+const bloom_stats_t & bloom_filter_t::stats() const
+{
+  return stats_;
+}
+
+void bloom_filter_t::reset_stats()
+{
+  stats_.lookups = 0;
+  stats_.insertions = 0;
+  stats_.hits = 0;
+}
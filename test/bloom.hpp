@@ -0,0 +1,85 @@
+#ifndef BLOOM_HPP
+#define BLOOM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A visited-state set for memory bounded searches, keyed by Zobrist hashes
+ * (see zobrist.hpp).
+ *
+ * This is a cache-blocked Bloom filter: all the probe bits of a hash live
+ * in the same 64-byte block, so a lookup touches exactly one cache line.
+ * The price is a slightly higher false positive rate than a classic Bloom
+ * filter of the same size.
+ *
+ * A false positive makes the search treat an unseen state as visited and
+ * skip it. That is the trade we are making against a full transposition
+ * table, so keep [false_positive_rate] small when the search has to be
+ * exhaustive.
+ *
+ * Not thread safe. Use one filter per search (or per sample).
+ */
+
+struct bloom_config_t {
+  uint64_t expected_items;
+  double false_positive_rate;
+
+  /* Upper bound on the memory used by the bit array. The filter is sized
+   * for [false_positive_rate], then shrunk to fit. 0 for no cap.
+   */
+  size_t max_bytes;
+};
+
+struct bloom_stats_t {
+  uint64_t lookups;
+  uint64_t insertions;
+
+  /* Lookups that reported "visited". Each of them is a node the search
+   * did not expand - some of which are false positives.
+   */
+  uint64_t hits;
+};
+
+class bloom_filter_t {
+private:
+  struct block_t;
+
+  block_t *blocks;
+  uint64_t num_blocks;
+  uint32_t num_hashes_;
+  uint64_t load;  /* Insertions since the last [clear]. */
+  bloom_stats_t stats_;
+
+  bloom_filter_t(const bloom_filter_t &);
+  bloom_filter_t & operator=(const bloom_filter_t &);
+
+public:
+  explicit bloom_filter_t(const bloom_config_t & config);
+  ~bloom_filter_t();
+
+  /* Returns true if [hash] may have been inserted before. Inserts it
+   * otherwise. This is the only call a search needs per node.
+   */
+  bool test_and_insert(uint64_t hash);
+  bool contains(uint64_t hash) const;
+  void insert(uint64_t hash);
+
+  /* Forgets every state, keeps the memory. Stats are kept as well, so
+   * they add up over multiple samples.
+   */
+  void clear();
+
+  size_t size_bytes() const;
+  uint32_t num_hashes() const;
+
+  /* Expected false positive rate given the current number of insertions.
+   * Expected number of wrongly skipped nodes is roughly
+   * [stats().lookups * estimated_false_positive_rate()].
+   */
+  double estimated_false_positive_rate() const;
+
+  const bloom_stats_t & stats() const;
+  void reset_stats();
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include <fstream>
+#include <sstream>
+
+#include "calibrate.hpp"
+#include "metrics.hpp"
+
+/* From what the game was always played at, to faster than it animates. */
+static const gesture_timing_t LADDER[] = {
+  { .hold_us = 20000, .settle_us = 200000 },
+  { .hold_us = 10000, .settle_us = 150000 },
+  { .hold_us = 10000, .settle_us = 100000 },
+  { .hold_us = 5000,  .settle_us = 75000 },
+  { .hold_us = 5000,  .settle_us = 50000 },
+  { .hold_us = 2000,  .settle_us = 35000 },
+  { .hold_us = 0,     .settle_us = 25000 },
+  { .hold_us = 0,     .settle_us = 15000 },
+};
+static const uint32_t LADDER_SIZE = sizeof(LADDER) / sizeof(LADDER[0]);
+
+struct calibration_state_t {
+  uint32_t step;    /* Into LADDER, the timing being tried. */
+  uint32_t passes;  /* Checks in a row passed at [step]. */
+  bool done;
+};
+
+static gesture_timing_t tuned[NUM_GESTURES] = { LADDER[0], LADDER[0] };
+static calibration_state_t calibration[NUM_GESTURES];
+static bool running = false;
+
+const char *gesture_name(gesture_t gesture)
+{
+  switch (gesture) {
+    case GESTURE_CLICK: return "click";
+    case GESTURE_DRAG: return "drag";
+    default: return "unknown";
+  }
+}
+
+gesture_timing_t gesture_timing(gesture_t gesture)
+{
+  if (running && !calibration[gesture].done) {
+    return LADDER[calibration[gesture].step];
+  }
+
+  return tuned[gesture];
+}
+
+gesture_timing_t gesture_safe_timing()
+{
+  return LADDER[0];
+}
+
+bool gesture_timings_load(const std::string & path)
+{
+  std::ifstream in(path.c_str());
+  std::string line;
+  uint32_t found = 0;
+
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    std::string name;
+    gesture_timing_t timing;
+
+    if (!(fields >> name >> timing.hold_us >> timing.settle_us)) {
+      continue;
+    }
+
+    for (uint32_t i = 0 ; i < NUM_GESTURES ; i++) {
+      if (name == gesture_name(gesture_t(i))) {
+        tuned[i] = timing;
+        found |= 1 << i;
+      }
+    }
+  }
+
+  return found == (1 << NUM_GESTURES) - 1;
+}
+
+void gesture_timings_save(const std::string & path)
+{
+  std::ofstream out(path.c_str());
+
+  out << "# gesture hold_us settle_us\n";
+  out << "# Generated by --calibrate-gestures.\n";
+
+  for (uint32_t i = 0 ; i < NUM_GESTURES ; i++) {
+    out << gesture_name(gesture_t(i)) << " "
+      << tuned[i].hold_us << " "
+      << tuned[i].settle_us << "\n";
+  }
+}
+
+void calibration_start()
+{
+  running = true;
+
+  for (uint32_t i = 0 ; i < NUM_GESTURES ; i++) {
+    calibration[i].step = 0;
+    calibration[i].passes = 0;
+    calibration[i].done = false;
+    tuned[i] = LADDER[0];
+  }
+}
+
+bool calibration_running()
+{
+  return running;
+}
+
+static std::string gesture_label(gesture_t gesture)
+{
+  return std::string("gesture=\"") + gesture_name(gesture) + "\"";
+}
+
+static metric_counter_t & calibration_checks(gesture_t gesture, bool passed)
+{
+  static const char *const RESULTS[] = { "fail", "pass" };
+  static const metric_counter_table_t<2> checks[NUM_GESTURES] = {
+    {
+      "interact_calibration_checks_total",
+      "Gestures checked while calibrating, by gesture and result",
+      "result",
+      RESULTS,
+      gesture_label(GESTURE_CLICK)
+    },
+    {
+      "interact_calibration_checks_total",
+      "Gestures checked while calibrating, by gesture and result",
+      "result",
+      RESULTS,
+      gesture_label(GESTURE_DRAG)
+    },
+  };
+
+  return checks[gesture][passed ? 1 : 0];
+}
+
+void calibration_report(gesture_t gesture, bool passed)
+{
+  calibration_state_t & c = calibration[gesture];
+
+  if (!running || c.done) {
+    return;
+  }
+
+  calibration_checks(gesture, passed).inc();
+
+  if (!passed) {
+    std::cout << "Calibration: " << gesture_name(gesture)
+      << " failed at hold = " << LADDER[c.step].hold_us
+      << "us, settle = " << LADDER[c.step].settle_us << "us" << std::endl;
+    c.done = true;
+    return;
+  }
+
+  if (++c.passes < CALIBRATION_PASSES) {
+    return;
+  }
+
+  tuned[gesture] = LADDER[c.step];
+  c.passes = 0;
+
+  if (c.step + 1 == LADDER_SIZE) {
+    c.done = true;
+  } else {
+    c.step++;
+  }
+}
+
+void calibration_finish()
+{
+  running = false;
+}
+
+void calibration_print(std::ostream & out)
+{
+  for (uint32_t i = 0 ; i < NUM_GESTURES ; i++) {
+    out << gesture_name(gesture_t(i))
+      << ": hold = " << tuned[i].hold_us
+      << "us, settle = " << tuned[i].settle_us << "us";
+
+    if (running && !calibration[i].done) {
+      out << " (still calibrating)";
+    }
+
+    out << "\n";
+  }
+}
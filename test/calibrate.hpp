@@ -0,0 +1,66 @@
+#ifndef CALIBRATE_HPP
+#define CALIBRATE_HPP
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+/* Gesture pacing, and its calibration.
+ *
+ * Every gesture waits [hold_us] between its steps (press, move, release),
+ * then for the board to settle for at most [settle_us] (see settle() in
+ * interact.cpp). Both default to what is known to work, and are tuned once
+ * per machine by calibrating while a game is played:
+ *
+ * Each gesture type walks down a ladder of ever shorter timings. Every
+ * gesture made while calibrating is checked through recognition by
+ * interact (did the card land where it should, and is it settled?), and
+ * redone at the safe timing when it didn't register. A timing is accepted
+ * after [CALIBRATION_PASSES] checks in a row pass, and the first failure
+ * settles the gesture on the last accepted timing.
+ *
+ * Tuned timings are cached in a file and loaded on start up.
+ */
+
+enum gesture_t {
+  GESTURE_CLICK = 0,
+  GESTURE_DRAG,
+  NUM_GESTURES
+};
+
+struct gesture_timing_t {
+  uint32_t hold_us;
+  uint32_t settle_us;
+};
+
+const uint32_t CALIBRATION_PASSES = 3;
+
+const char *gesture_name(gesture_t gesture);
+
+/* The timing to use for [gesture]: the candidate being tried while
+ * calibrating, otherwise the tuned (or default) one.
+ */
+gesture_timing_t gesture_timing(gesture_t gesture);
+
+/* Known to work on any machine, for gestures that have to be redone. */
+gesture_timing_t gesture_safe_timing();
+
+/* Returns false, leaving the defaults, if there is no usable cache. */
+bool gesture_timings_load(const std::string & path);
+void gesture_timings_save(const std::string & path);
+
+void calibration_start();
+bool calibration_running();
+
+/* Records whether the last gesture of type [gesture], made at
+ * gesture_timing(gesture), registered in time.
+ */
+void calibration_report(gesture_t gesture, bool passed);
+
+/* Ends calibration, keeping the fastest timings accepted so far. */
+void calibration_finish();
+
+void calibration_print(std::ostream & out);
+
+#endif
@@ -0,0 +1,106 @@
+#include <string.h>
+
+#include <mutex>
+
+#include "cycle.hpp"
+#include "zobrist.hpp"
+
+static const uint32_t MAX_PHASES = 16;
+
+static phase_work_stats_t phases[MAX_PHASES];
+static uint32_t num_phases = 0;
+static std::mutex phases_mutex;
+
+static phase_work_stats_t *find_phase(const char *name)
+{
+  std::lock_guard<std::mutex> lock(phases_mutex);
+
+  for (uint32_t i = 0 ; i < num_phases ; i++) {
+    if (strcmp(phases[i].phase, name) == 0) {
+      return &phases[i];
+    }
+  }
+
+  if (num_phases == MAX_PHASES) {
+    chatter() << "Too many phases, cannot track " << name << std::endl;
+    return &phases[MAX_PHASES - 1];
+  }
+
+  const std::string labels = std::string("phase=\"") + name + "\"";
+  phase_work_stats_t *stats = &phases[num_phases++];
+
+  stats->phase = name;
+  stats->iterations = &metrics_counter(
+      "strategy_phase_iterations_total",
+      "Iterations of the strategy loops", labels);
+  stats->repetitions = &metrics_counter(
+      "strategy_phase_repetitions_total",
+      "Strategy loop iterations that came back to an already seen state",
+      labels);
+  stats->budget_exhaustions = &metrics_counter(
+      "strategy_phase_budget_exhaustions_total",
+      "Strategy loops that ran out of their work budget", labels);
+  return stats;
+}
+
+cycle_guard_t::cycle_guard_t(const char *phase, uint32_t budget)
+  : stats(find_phase(phase)), budget(budget), iterations(0) {}
+
+uint32_t cycle_guard_t::visit(const game_state_t & state)
+{
+  uint32_t & count = visits[zobrist_hash(state)];
+
+  iterations++;
+  stats->iterations->inc();
+
+  if (count != 0) {
+    stats->repetitions->inc();
+    chatter() << "Repeated state in " << stats->phase
+      << " (visited " << count << " times before)" << std::endl;
+  }
+
+  return count++;
+}
+
+bool cycle_guard_t::exhausted()
+{
+  if (iterations <= budget) {
+    return false;
+  }
+
+  /* Only count the first time the loop hits the wall. */
+  if (iterations == budget + 1) {
+    stats->budget_exhaustions->inc();
+    chatter() << "Work budget of " << budget << " exhausted in "
+      << stats->phase << std::endl;
+  }
+
+  return true;
+}
+
+void cycle_guard_t::reset()
+{
+  iterations = 0;
+  visits.clear();
+}
+
+uint32_t cycle_num_phases()
+{
+  return num_phases;
+}
+
+const phase_work_stats_t & cycle_phase_stats(uint32_t i)
+{
+  return phases[i];
+}
+
+void cycle_print_stats(std::ostream & out)
+{
+  for (uint32_t i = 0 ; i < num_phases ; i++) {
+    out << phases[i].phase
+      << ": iterations = " << phases[i].iterations->get()
+      << " repetitions = " << phases[i].repetitions->get()
+      << " budget exhaustions = " << phases[i].budget_exhaustions->get()
+      << "\n";
+  }
+}
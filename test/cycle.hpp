@@ -0,0 +1,57 @@
+#ifndef CYCLE_HPP
+#define CYCLE_HPP
+
+#include <stdint.h>
+
+#include <iostream>
+#include <unordered_map>
+
+#include "game.hpp"
+#include "metrics.hpp"
+
+/* Repetition detection and work budgets for the strategy loops.
+ *
+ * A phase is a loop that is supposed to make progress on every iteration.
+ * The guard remembers the (Zobrist) hash of every state the loop has been
+ * in, so a loop that comes back to a state it has already seen can do
+ * something else or give up, rather than replaying the same gestures
+ * forever. The budget caps the number of iterations regardless.
+ *
+ * The counts are exported as strategy_phase_*_total{phase="..."}.
+ */
+
+struct phase_work_stats_t {
+  const char *phase;
+  metric_counter_t *iterations;
+  metric_counter_t *repetitions;
+  metric_counter_t *budget_exhaustions;
+};
+
+class cycle_guard_t {
+private:
+  phase_work_stats_t *stats;
+  uint32_t budget;
+  uint32_t iterations;
+  std::unordered_map<uint64_t, uint32_t> visits;
+
+public:
+  cycle_guard_t(const char *phase, uint32_t budget);
+
+  /* Records an iteration at [state]. Returns the number of times [state]
+   * was visited before, 0 if it is new.
+   */
+  uint32_t visit(const game_state_t & state);
+
+  /* True once more than [budget] iterations have been recorded. */
+  bool exhausted();
+
+  /* Forgets the history, for the next game. */
+  void reset();
+};
+
+/* Work stats of every phase that has had a guard, since start up. */
+uint32_t cycle_num_phases();
+const phase_work_stats_t & cycle_phase_stats(uint32_t i);
+void cycle_print_stats(std::ostream & out);
+
+#endif
@@ -0,0 +1,142 @@
+#include "engine.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+const char *const ENGINE_NAMES[] = {
+  "rules", "beam", "solver", "portfolio", NULL
+};
+
+engine_options_t engine_default_options()
+{
+  engine_options_t options;
+
+  options.beam = beam_default_options();
+  options.solver = solver_default_options();
+  options.portfolio = portfolio_default_options();
+  options.deadline_ms = 200;
+
+  return options;
+}
+
+namespace {
+
+class rules_engine_t : public decision_engine_t {
+public:
+  const char *name() const { return "rules"; }
+
+  std::vector<solver_move_t> choose(
+      const game_state_t &,
+      const engine_context_t &,
+      uint64_t) {
+    return std::vector<solver_move_t>();
+  }
+};
+
+class beam_engine_t : public decision_engine_t {
+private:
+  beam_search_t beam;
+
+public:
+  explicit beam_engine_t(const beam_options_t & options) : beam(options) {}
+
+  const char *name() const { return "beam"; }
+
+  std::vector<solver_move_t> choose(
+      const game_state_t & state,
+      const engine_context_t & context,
+      uint64_t deadline_us) {
+    trace_scope_t scope(PHASE_BEAM_SEARCH);
+    const beam_result_t result = beam.search(
+        packed_state_of(state, context.stock->mask(), NULL), deadline_us);
+
+    if (!result.has_move) {
+      return std::vector<solver_move_t>();
+    }
+
+    chatter() << "Beam search: " << solver_move_to_string(result.move)
+      << ", score " << result.root_score << " -> " << result.score
+      << " in " << result.line_length << " moves" << std::endl;
+    return std::vector<solver_move_t>(1, result.move);
+  }
+};
+
+class solver_engine_t : public decision_engine_t {
+private:
+  solver_t solver;
+
+public:
+  explicit solver_engine_t(const solver_options_t & options)
+    : solver(options) {}
+
+  const char *name() const { return "solver"; }
+
+  std::vector<solver_move_t> choose(
+      const game_state_t & state,
+      const engine_context_t & context,
+      uint64_t deadline_us) {
+    const solver_result_t result = solver.solve(
+        packed_state_of(state, context.stock->mask(), NULL), deadline_us);
+
+    if (result.outcome != SOLVER_FOUND) {
+      return std::vector<solver_move_t>();
+    }
+
+    chatter() << "Solver: " << result.num_moves << " moves to turn a card"
+      << " over, " << result.nodes << " nodes" << std::endl;
+    return std::vector<solver_move_t>(
+        result.moves, result.moves + result.num_moves);
+  }
+};
+
+class race_engine_t : public decision_engine_t {
+private:
+  portfolio_t portfolio;
+
+public:
+  explicit race_engine_t(const portfolio_options_t & options)
+    : portfolio(options) {}
+
+  const char *name() const { return "portfolio"; }
+
+  std::vector<solver_move_t> choose(
+      const game_state_t & state,
+      const engine_context_t & context,
+      uint64_t deadline_us) {
+    const portfolio_pick_t pick = portfolio.race(
+        state, *context.stock, *context.belief, deadline_us);
+
+    chatter() << "Portfolio: " << portfolio_engine_name(pick.engine);
+
+    if (pick.engine == PORTFOLIO_RULES) {
+      chatter() << std::endl;
+      return std::vector<solver_move_t>();
+    }
+
+    chatter() << ", " << solver_move_to_string(pick.move)
+      << (pick.proven_win ? " (proven win)" : "")
+      << ", score " << pick.score << std::endl;
+    return std::vector<solver_move_t>(1, pick.move);
+  }
+};
+
+}
+
+std::unique_ptr<decision_engine_t> engine_create(
+    const std::string & name, const engine_options_t & options)
+{
+  decision_engine_t *engine = NULL;
+
+  if (name == "rules") {
+    engine = new rules_engine_t();
+  } else if (name == "beam") {
+    engine = new beam_engine_t(options.beam);
+  } else if (name == "solver") {
+    engine = new solver_engine_t(options.solver);
+  } else if (name == "portfolio") {
+    engine = new race_engine_t(options.portfolio);
+  } else {
+    throw EngineException();
+  }
+
+  return std::unique_ptr<decision_engine_t>(engine);
+}
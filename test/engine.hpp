@@ -0,0 +1,75 @@
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include <stdint.h>
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+#include "belief.hpp"
+#include "stock.hpp"
+#include "solver.hpp"
+#include "beam.hpp"
+#include "portfolio.hpp"
+
+/* Decision engines: what strategy_step asks for a move when there is no
+ * obvious one (Rules 0 to 2), before falling back on the Rule 3
+ * heuristics. An engine returns a line of moves, in the solver's terms
+ * (see solver.hpp), to play in a row; an empty line leaves the decision
+ * to the rules.
+ *
+ * Engines are made by name, so that the bot and the bench pick one with
+ * --engine=<name>, and two can be compared on the same deals (see
+ * `bench --ab`):
+ *
+ * - rules: always leaves the decision to the rules.
+ * - beam: the first move of a beam search (see beam.hpp).
+ * - solver: a line that turns over the next face down card, if the
+ *   solver finds one.
+ * - portfolio: races the others (see portfolio.hpp).
+ */
+
+/* What the strategy knows besides the state. */
+struct engine_context_t {
+  const stock_model_t *stock;
+  const belief_t *belief;
+};
+
+class decision_engine_t {
+public:
+  virtual ~decision_engine_t() {}
+
+  virtual const char *name() const = 0;
+
+  /* [deadline_us] is on the metrics_now_us() clock. Engines that can't
+   * be interrupted part way may overrun it.
+   */
+  virtual std::vector<solver_move_t> choose(
+      const game_state_t & state,
+      const engine_context_t & context,
+      uint64_t deadline_us) = 0;
+};
+
+struct engine_options_t {
+  beam_options_t beam;
+  solver_options_t solver;
+  portfolio_options_t portfolio;
+  uint32_t deadline_ms;  /* Per decision. */
+};
+
+engine_options_t engine_default_options();
+
+/* Thrown for an unknown engine name. */
+class EngineException : public std::exception {
+};
+
+/* Names engine_create knows, NULL terminated. */
+extern const char *const ENGINE_NAMES[];
+
+std::unique_ptr<decision_engine_t> engine_create(
+    const std::string & name, const engine_options_t & options);
+
+#endif
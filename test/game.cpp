@@ -94,5 +94,6 @@ std::ostream& operator<<(std::ostream & out, const game_state_t & game)
   }
 
   out << "<< End of game state\n";
+  return out;
 }
 
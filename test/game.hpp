@@ -43,6 +43,21 @@ struct card_t {
   std::string to_string() const;
 };
 
+/* Dense [0, 52) index of a card, suite-major. Used as a key into hash and
+ * bit tables.
+ */
+const uint32_t NUM_CARDS = 52;
+
+static inline uint32_t card_index(const card_t & card) {
+  return uint32_t(card.suite) * 13 + (uint32_t(card.number) - 1);
+}
+
+static inline card_t card_of_index(uint32_t index) {
+  card_t card = { .suite = suite_t(index / 13),
+                  .number = number_t(index % 13 + 1) };
+  return card;
+}
+
 struct tableau_position_t {
   uint32_t deck; /* 0 to 6 */
   uint32_t num_hidden;
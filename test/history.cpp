@@ -0,0 +1,252 @@
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "history.hpp"
+#include "metrics.hpp"
+
+/* Gestures in a long game, so the history doesn't grow during play. */
+static const uint32_t HISTORY_RESERVE = 1024;
+
+bool history_column_t::same_as(const tableau_deck_t & deck) const
+{
+  if (num_down_cards != deck.num_down_cards
+      || num_cards != deck.cards.size()) {
+    return false;
+  }
+
+  for (uint32_t i = 0 ; i < num_cards ; i++) {
+    if (!(cards[i] == deck.cards[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+game_state_t state_snapshot_t::state() const
+{
+  game_state_t state;
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    state.foundation[i] = foundation[i];
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    const history_column_t & column = *columns[deck];
+
+    state.tableau[deck].num_down_cards = column.num_down_cards;
+    state.tableau[deck].cards.assign(
+        column.cards, column.cards + column.num_cards);
+  }
+
+  state.waste_pile_top = waste_pile_top;
+  state.stock_pile_size = stock_pile_size;
+  state.remaining_pile_size = remaining_pile_size;
+
+  return state;
+}
+
+state_history_t::state_history_t() : num_chunks(0)
+{
+}
+
+void state_history_t::clear()
+{
+  snapshots.clear();
+  snapshots.reserve(HISTORY_RESERVE);
+  num_chunks = 0;
+}
+
+const state_snapshot_t & state_history_t::push(
+    const game_state_t & state, const char *gesture)
+{
+  static metric_counter_t & new_columns = metrics_counter(
+      "history_columns_total",
+      "Columns recorded in the state history, by whether they were shared "
+      "with the previous state",
+      "kind=\"new\"");
+  static metric_counter_t & shared_columns = metrics_counter(
+      "history_columns_total",
+      "Columns recorded in the state history, by whether they were shared "
+      "with the previous state",
+      "kind=\"shared\"");
+  state_snapshot_t snapshot;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    const tableau_deck_t & source = state.tableau[deck];
+
+    if (!snapshots.empty()
+        && snapshots.back().columns[deck]->same_as(source)) {
+      snapshot.columns[deck] = snapshots.back().columns[deck];
+      shared_columns.inc();
+      continue;
+    }
+
+    if (source.cards.size() > HISTORY_MAX_COLUMN_CARDS) {
+      throw HistoryException();
+    }
+
+    std::shared_ptr<history_column_t> column =
+      std::make_shared<history_column_t>();
+
+    column->num_down_cards = source.num_down_cards;
+    column->num_cards = source.cards.size();
+    std::copy(source.cards.begin(), source.cards.end(), column->cards);
+
+    snapshot.columns[deck] = column;
+    num_chunks++;
+    new_columns.inc();
+  }
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    snapshot.foundation[i] = state.foundation[i];
+  }
+
+  snapshot.waste_pile_top = state.waste_pile_top;
+  snapshot.stock_pile_size = state.stock_pile_size;
+  snapshot.remaining_pile_size = state.remaining_pile_size;
+  snapshot.gesture = gesture;
+
+  snapshots.push_back(snapshot);
+  return snapshots.back();
+}
+
+void state_history_t::truncate(uint32_t size)
+{
+  if (size < snapshots.size()) {
+    snapshots.erase(snapshots.begin() + size, snapshots.end());
+  }
+}
+
+const state_snapshot_t & state_history_t::at(uint32_t i) const
+{
+  if (i >= snapshots.size()) {
+    throw HistoryException();
+  }
+
+  return snapshots[i];
+}
+
+void state_history_t::print(std::ostream & out) const
+{
+  out << "History: " << snapshots.size() << " states, "
+    << num_chunks << " column chunks (" << 7 * snapshots.size()
+    << " as deep copies)\n";
+}
+
+static void save_card(std::ostream & out, const Option<card_t> & card)
+{
+  if (card.is_some()) {
+    out << " " << card_index(card.get());
+  } else {
+    out << " -";
+  }
+}
+
+static bool load_card(std::istream & in, Option<card_t> *card)
+{
+  std::string field;
+
+  if (!(in >> field)) {
+    return false;
+  }
+
+  if (field == "-") {
+    *card = Option<card_t>();
+    return true;
+  }
+
+  const uint32_t index = strtoul(field.c_str(), NULL, 10);
+
+  if (index >= NUM_CARDS) {
+    return false;
+  }
+
+  *card = Option<card_t>(card_of_index(index));
+  return true;
+}
+
+void state_history_t::save(const std::string & path) const
+{
+  std::ofstream out(path.c_str());
+
+  out << "# gesture stock_pile_size remaining_pile_size waste_pile_top"
+    " foundation[4] (num_down_cards num_cards cards...)[7]\n";
+  out << "# Cards are card_index, - for none.\n";
+
+  for (const state_snapshot_t & snapshot : snapshots) {
+    out << snapshot.gesture << " " << snapshot.stock_pile_size << " "
+      << snapshot.remaining_pile_size;
+    save_card(out, snapshot.waste_pile_top);
+
+    for (uint32_t i = 0 ; i < 4 ; i++) {
+      save_card(out, snapshot.foundation[i]);
+    }
+
+    for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+      const history_column_t & column = *snapshot.columns[deck];
+
+      out << " " << column.num_down_cards << " " << column.num_cards;
+
+      for (uint32_t i = 0 ; i < column.num_cards ; i++) {
+        out << " " << card_index(column.cards[i]);
+      }
+    }
+
+    out << "\n";
+  }
+}
+
+bool state_history_t::load(const std::string & path)
+{
+  /* Snapshots keep their gesture as a static string. */
+  static std::set<std::string> gestures;
+  std::ifstream in(path.c_str());
+  std::string line;
+
+  clear();
+
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    std::string gesture;
+    game_state_t state;
+    bool ok = bool(fields >> gesture >> state.stock_pile_size
+        >> state.remaining_pile_size)
+      && load_card(fields, &state.waste_pile_top);
+
+    for (uint32_t i = 0 ; i < 4 && ok ; i++) {
+      ok = load_card(fields, &state.foundation[i]);
+    }
+
+    for (uint32_t deck = 0 ; deck < 7 && ok ; deck++) {
+      uint32_t num_cards = 0;
+
+      ok = bool(fields >> state.tableau[deck].num_down_cards >> num_cards)
+        && num_cards <= HISTORY_MAX_COLUMN_CARDS;
+
+      for (uint32_t i = 0 ; i < num_cards && ok ; i++) {
+        uint32_t index;
+
+        ok = bool(fields >> index) && index < NUM_CARDS;
+        state.tableau[deck].cards.push_back(card_of_index(index));
+      }
+    }
+
+    if (!ok) {
+      clear();
+      return false;
+    }
+
+    push(state, gestures.insert(gesture).first->c_str());
+  }
+
+  return !empty();
+}
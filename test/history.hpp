@@ -0,0 +1,93 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <stdint.h>
+
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+
+/* Every state a game has been in, in little memory.
+ *
+ * A snapshot holds the small parts of a [game_state_t] by value and its
+ * columns through reference counted pointers to immutable column chunks.
+ * Pushing a state reuses the chunk of every column that is the same as in
+ * the previous snapshot, so a gesture costs a new chunk for the one or two
+ * columns it touched, and a draw from the stock pile none at all.
+ *
+ * Chunks are never written to once made, so a snapshot can be copied
+ * (seven reference counts) and handed to another thread, and stays valid
+ * however the history changes after. The history itself is not thread
+ * safe.
+ */
+
+/* Face up cards in a column: a king down to an ace. */
+const uint32_t HISTORY_MAX_COLUMN_CARDS = 13;
+
+/* Thrown when a state doesn't fit a snapshot, or on a bad index. */
+class HistoryException : public std::exception {
+};
+
+struct history_column_t {
+  uint32_t num_down_cards;
+  uint32_t num_cards;
+  card_t cards[HISTORY_MAX_COLUMN_CARDS];
+
+  bool same_as(const tableau_deck_t & deck) const;
+};
+
+class state_snapshot_t {
+public:
+  std::shared_ptr<const history_column_t> columns[7];
+  Option<card_t> foundation[4];
+  Option<card_t> waste_pile_top;
+  uint32_t stock_pile_size;
+  uint32_t remaining_pile_size;
+  const char *gesture;  /* What led here, "deal" for the initial state. */
+
+  /* The state back as a [game_state_t], which does copy the columns. */
+  game_state_t state() const;
+};
+
+class state_history_t {
+private:
+  std::vector<state_snapshot_t> snapshots;
+  uint64_t num_chunks;  /* Column chunks made since [clear]. */
+
+public:
+  state_history_t();
+
+  /* Forgets every snapshot, for the next game. */
+  void clear();
+
+  /* Records [state], reached by [gesture] (a static string). */
+  const state_snapshot_t & push(const game_state_t & state, const char *gesture);
+
+  /* Drops the snapshots after the first [size], to carry on from there, eg.
+   * after undoing moves in the game.
+   */
+  void truncate(uint32_t size);
+
+  uint32_t size() const { return snapshots.size(); }
+  bool empty() const { return snapshots.empty(); }
+  const state_snapshot_t & at(uint32_t i) const;
+  const state_snapshot_t & back() const { return at(size() - 1); }
+
+  /* Column chunks made, against the 7 per snapshot of deep copies. */
+  uint64_t num_column_chunks() const { return num_chunks; }
+
+  void print(std::ostream & out) const;
+
+  /* The session log: every snapshot, one per line, so that a later run
+   * can rewind the game (see rewind_to). [load] replaces the history, and
+   * returns false, leaving it empty, if [path] is missing or malformed.
+   */
+  void save(const std::string & path) const;
+  bool load(const std::string & path);
+};
+
+#endif
@@ -1,14 +1,27 @@
 #include <unistd.h>
 
+#include <algorithm>
+#include <functional>
+
 #include <robot.h>
 
 #include "interact.hpp"
 #include "vision.hpp"
 #include "game.hpp"
-
-static bool sandbox = false;
+#include "metrics.hpp"
+#include "simulator.hpp"
+#include "calibrate.hpp"
+#include "recorder.hpp"
+
+/* Per thread, so a simulated copy of the game can be played on another
+ * thread than the live one (see portfolio.hpp).
+ */
+static thread_local bool sandbox = false;
 static robot_h robot;
 
+/* Every state the game went through, see history.hpp. */
+static thread_local state_history_t history;
+
 IllegalMoveException::IllegalMoveException(std::string msg) : msg(msg) {}
 
 const char * IllegalMoveException::what() const throw()
@@ -16,61 +29,269 @@ const char * IllegalMoveException::what() const throw()
   return msg.c_str();
 }
 
-static bool is_short_sleep = false;
+const char *move_error_name(move_error_t error)
+{
+  switch (error) {
+    case MOVE_OK: return "ok";
+    case MOVE_NO_WASTE_CARD: return "no card on the waste pile";
+    case MOVE_STOCK_EMPTY: return "stock pile is empty";
+    case MOVE_STOCK_NOT_EMPTY: return "stock pile is not empty";
+    case MOVE_EMPTY_COLUMN: return "no cards in the column";
+    case MOVE_BAD_POSITION: return "no such card in the column";
+    case MOVE_NO_INDEX: return "location has no index";
+    case MOVE_ILLEGAL_TRANSFER: return "card does not go on the column";
+    case MOVE_ILLEGAL_PROMOTION: return "card does not go on the foundation";
+    case MOVE_NOTHING_TO_UNDO: return "nothing to undo";
+    case MOVE_NO_SUCH_STATE: return "no such state in the history";
+    default: return "unknown";
+  }
+}
+
+/* The live loop's way out of an illegal move; searches use the check_
+ * functions instead.
+ */
+static void throw_illegal_move(
+    const game_state_t & state, const char *move, move_error_t error)
+{
+  chatter() << state << std::endl;
+  throw IllegalMoveException(
+      std::string(move) + " is illegal: " + move_error_name(error));
+}
+
+static thread_local bool is_short_sleep = false;
+static thread_local uint64_t num_gestures = 0;
+static std::pair<uint32_t, uint32_t> undo_button = UNDO_BUTTON;
+/* Whether a click at [undo_button] is known to undo: it was given, or one
+ * click was seen to.
+ */
+static bool is_undo_button_confirmed = false;
 
 void interact_short_sleep() 
 {
   is_short_sleep = true;
 }
 
-static const uint32_t LONG_SLEEP  = 200000;
+/* Upper bound on the wait after a gesture once wrapping up. The usual
+ * bound comes from the gesture's timing (see calibrate.hpp).
+ */
 static const uint32_t SHORT_SLEEP = 200000;
 
-void click_card(uint32_t x, uint32_t y)
+/* How long the board has to stay unchanged for an animation to be over. */
+static const uint32_t QUIET_MS = 50;
+
+/* Between the undo clicks of a rewind: the pace of Main.java's old undo
+ * loop, which the game kept up with.
+ */
+static const uint32_t UNDO_CLICK_GAP_US = 10000;
+
+enum counted_gesture_t {
+  COUNTED_CLICK = 0,
+  COUNTED_DRAG,
+  COUNTED_UNDO,
+  NUM_COUNTED_GESTURES
+};
+
+static const char *const COUNTED_GESTURES[NUM_COUNTED_GESTURES] = {
+  "click", "drag", "undo"
+};
+
+static void count_gesture(counted_gesture_t type)
+{
+  static const metric_counter_table_t<NUM_COUNTED_GESTURES> gestures(
+      "interact_gestures_total",
+      "Mouse gestures made on the game, by type",
+      "type",
+      COUNTED_GESTURES);
+
+  gestures[type].inc();
+}
+
+/* Waits for the game to take in the last gesture: for the board to change
+ * since [watch] began, then to stop changing, or [max_micros] overall.
+ */
+static void settle(const robot_watch_t & watch, uint32_t max_micros)
+{
+  static metric_histogram_t & settle_time = metrics_histogram(
+      "interact_settle_seconds",
+      "Time waited after a gesture for the game to settle");
+  const uint64_t start = metrics_now_us();
+
+  if (robot_wait_for_change(robot, &watch, max_micros / 1000)
+      == ROBOT_WAIT_CHANGED) {
+    const uint64_t elapsed = metrics_now_us() - start;
+    const uint32_t remaining_ms =
+      elapsed < max_micros ? (max_micros - elapsed) / 1000 : 0;
+
+    robot_wait_for_quiet(robot, watch.rect, QUIET_MS, remaining_ms);
+  }
+
+  const uint64_t elapsed = metrics_now_us() - start;
+
+  settle_time.record(elapsed);
+  recorder_record(RECORD_SETTLE, 0, 0, elapsed);
+}
+
+static uint32_t settle_bound(const gesture_timing_t & timing)
+{
+  if (is_short_sleep) {
+    return std::min(timing.settle_us, SHORT_SLEEP);
+  }
+  return timing.settle_us;
+}
+
+static void hold(const gesture_timing_t & timing)
+{
+  if (timing.hold_us != 0) {
+    usleep(timing.hold_us);
+  }
+}
+
+/* In sandbox mode, the screen is the simulator. */
+static card_t see_visible_pile_card()
 {
+  if (sandbox) {
+    return simulator_visible_pile_card();
+  }
+  return recognize_visible_pile_card();
+}
+
+static card_t see_tableau_card(const tableau_position_t & position)
+{
+  if (sandbox) {
+    return simulator_tableau_card(position);
+  }
+  return recognize_tableau_card(position);
+}
+
+static void click_at(uint32_t x, uint32_t y, const gesture_timing_t & timing)
+{
+  num_gestures++;
+
+  if (sandbox) {
+    return;
+  }
+
+  robot_watch_t watch;
+
+  vision_track_window();
+  robot_watch_begin(robot, GAME_BOARD, &watch);
   robot_mouse_move(robot, x, y);
   robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
+  hold(timing);
   robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+  count_gesture(COUNTED_CLICK);
+  recorder_record(RECORD_CLICK, x << 16 | y);
+  settle(watch, settle_bound(timing));
+}
 
-  /* TODO(fyquah): This isn't super reliable, as it is decided based on
-   * the processor's (underterministic) speed.
-   */
-  if (is_short_sleep) {
-    usleep(SHORT_SLEEP);
-  } else {
-    usleep(LONG_SLEEP);
-  }
+void click_card(uint32_t x, uint32_t y)
+{
+  click_at(x, y, gesture_timing(GESTURE_CLICK));
 }
 
 static void drag_mouse(
     std::pair<uint32_t, uint32_t> from,
-    std::pair<uint32_t, uint32_t> to
+    std::pair<uint32_t, uint32_t> to,
+    const gesture_timing_t & timing
 )
 {
-  if (is_short_sleep) {
+  num_gestures++;
 
-    /* When we enter short sleep mode, we want everything to go directly to
-     * the foundation. Hence, we can skip dragging.
-     */
+  if (sandbox) {
+    return;
+  }
 
-    robot_mouse_move(robot, from.first, from.second);
-    robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
-    robot_mouse_move(robot, to.first, to.second);
-    robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
-    usleep(SHORT_SLEEP);
+  robot_watch_t watch;
 
-  } else {
-    robot_mouse_move(robot, from.first, from.second);
-    robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
-    robot_mouse_move(robot, to.first, to.second);
-    robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
-    usleep(LONG_SLEEP);
+  vision_track_window();
+  robot_watch_begin(robot, GAME_BOARD, &watch);
+  robot_mouse_move(robot, from.first, from.second);
+  robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
+  hold(timing);
+  robot_mouse_move(robot, to.first, to.second);
+  hold(timing);
+  robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+  count_gesture(COUNTED_DRAG);
+  recorder_record(RECORD_DRAG, to.first << 16 | to.second);
+  settle(watch, settle_bound(timing));
+}
+
+/* Drags [card] to where [see_destination] recognizes it. While calibrating,
+ * checks that it is there right after the drag. If it isn't, and still
+ * isn't once the game had all the time it could need, the drag didn't
+ * register and is redone at the safe timing.
+ */
+static void drag_card(
+    std::pair<uint32_t, uint32_t> from,
+    std::pair<uint32_t, uint32_t> to,
+    const card_t & card,
+    std::function<card_t()> see_destination
+)
+{
+  drag_mouse(from, to, gesture_timing(GESTURE_DRAG));
+
+  if (sandbox || !calibration_running()) {
+    return;
+  }
+
+  const bool passed = see_destination() == card;
+  calibration_report(GESTURE_DRAG, passed);
+
+  if (passed) {
+    return;
+  }
+
+  usleep(gesture_safe_timing().settle_us);
+
+  if (!(see_destination() == card)) {
+    drag_mouse(from, to, gesture_safe_timing());
   }
 }
 
+/* Clicks the draw pile and returns the new top of the visible pile. While
+ * calibrating, the top has to be recognized the same right after the click
+ * and once the game had all the time it could need, and be a new card.
+ */
+static card_t draw_card(const Option<card_t> & previous_top)
+{
+  const uint32_t x = DRAW_PILE.first + CARD_WIDTH / 2;
+  const uint32_t y = DRAW_PILE.second + CARD_HEIGHT / 2;
+
+  if (sandbox || !calibration_running()) {
+    click_card(x, y);
+
+    if (sandbox) {
+      simulator_draw_from_stock_pile();
+    }
+
+    return see_visible_pile_card();
+  }
+
+  if (!previous_top.is_some()) {
+    /* An empty pile could be recognized as anything; nothing to check. */
+    click_at(x, y, gesture_safe_timing());
+    return see_visible_pile_card();
+  }
+
+  click_at(x, y, gesture_timing(GESTURE_CLICK));
+  const card_t quick = see_visible_pile_card();
+
+  usleep(gesture_safe_timing().settle_us);
+  const card_t settled = see_visible_pile_card();
+
+  if (settled == previous_top.get()) {
+    calibration_report(GESTURE_CLICK, false);
+    click_at(x, y, gesture_safe_timing());
+    return see_visible_pile_card();
+  }
+
+  calibration_report(GESTURE_CLICK, quick == settled);
+  return settled;
+}
+
 static void unsafe_remove_card_from_visible_pile(game_state_t *state)
 {
-  std::cout << "Unsafe operation! Original remaining pile size = "
+  chatter() << "Unsafe operation! Original remaining pile size = "
     << state->remaining_pile_size
     << " original stock pile size = "
     << state->stock_pile_size
@@ -78,10 +299,14 @@ static void unsafe_remove_card_from_visible_pile(game_state_t *state)
 
   state->remaining_pile_size = state->remaining_pile_size - 1;
 
+  if (sandbox) {
+    simulator_remove_visible_pile_card();
+  }
+
   if (state->remaining_pile_size == state->stock_pile_size) {
     state->waste_pile_top = Option<card_t>();
   } else {
-    state->waste_pile_top = Option<card_t>(recognize_visible_pile_card());
+    state->waste_pile_top = Option<card_t>(see_visible_pile_card());
   }
 }
 
@@ -99,7 +324,7 @@ static void unsafe_remove_card_from_tableau(
     };
 
     tbl_deck.num_down_cards -= 1;
-    tbl_deck.cards.push_back(recognize_tableau_card(pos));
+    tbl_deck.cards.push_back(see_tableau_card(pos));
   }
 }
 
@@ -129,6 +354,204 @@ void set_sandbox_mode(bool a)
   sandbox = a;
 }
 
+const state_history_t & interact_history()
+{
+  return history;
+}
+
+uint64_t interact_num_gestures()
+{
+  return num_gestures;
+}
+
+void interact_set_undo_button(uint32_t x, uint32_t y)
+{
+  undo_button = std::make_pair(x, y);
+  is_undo_button_confirmed = true;
+}
+
+move_error_t check_undo_gesture()
+{
+  /* The first snapshot is the deal. */
+  return history.size() < 2 ? MOVE_NOTHING_TO_UNDO : MOVE_OK;
+}
+
+game_state_t undo_gesture()
+{
+  const move_error_t error = check_undo_gesture();
+
+  if (error != MOVE_OK) {
+    throw_illegal_move(history.back().state(), "Undo", error);
+  }
+
+  return rewind_to(history.size() - 2);
+}
+
+/* Clicks undo [clicks] times in a row, and waits for the game once. */
+static void click_undo(uint32_t clicks, const gesture_timing_t & timing)
+{
+  num_gestures += clicks;
+
+  if (sandbox || clicks == 0) {
+    return;
+  }
+
+  robot_watch_t watch;
+
+  vision_track_window();
+  robot_watch_begin(robot, GAME_BOARD, &watch);
+  robot_mouse_move(robot, undo_button.first, undo_button.second);
+
+  for (uint32_t i = 0 ; i < clicks ; i++) {
+    if (i != 0) {
+      usleep(UNDO_CLICK_GAP_US);
+    }
+
+    robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
+    hold(timing);
+    robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+    count_gesture(COUNTED_UNDO);
+  }
+
+  recorder_record(RECORD_UNDO, clicks);
+
+  settle(watch, settle_bound(timing));
+}
+
+/* One look at the board, for whether it is [state]: the waste pile and
+ * foundation tops, and the bottom and top face up cards of every column.
+ * The simulator is [state] by construction.
+ */
+static bool board_matches(const game_state_t & state)
+{
+  if (sandbox) {
+    return true;
+  }
+
+  try {
+    if (state.waste_pile_top.is_some()
+        && !(recognize_visible_pile_card() == state.waste_pile_top.get())) {
+      return false;
+    }
+
+    for (uint32_t i = 0 ; i < 4 ; i++) {
+      if (state.foundation[i].is_some()
+          && !(recognize_foundation_card(i) == state.foundation[i].get())) {
+        return false;
+      }
+    }
+
+    for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+      const tableau_deck_t & column = state.tableau[deck];
+      tableau_position_t position = {
+        .deck = deck,
+        .num_hidden = column.num_down_cards,
+        .position = 0
+      };
+
+      if (column.cards.empty()) {
+        continue;
+      }
+
+      if (!(recognize_tableau_card(position) == column.cards.front())) {
+        return false;
+      }
+
+      position.position = column.cards.size() - 1;
+
+      if (!(recognize_tableau_card(position) == column.cards.back())) {
+        return false;
+      }
+    }
+  } catch (RecognizeException & e) {
+    return false;
+  }
+
+  return true;
+}
+
+move_error_t check_rewind(uint32_t index)
+{
+  return index < history.size() ? MOVE_OK : MOVE_NO_SUCH_STATE;
+}
+
+game_state_t rewind_to(uint32_t index)
+{
+  static metric_histogram_t & rewind_time = metrics_histogram(
+      "interact_rewind_seconds",
+      "Time to take the game back by undoing, checking the board included");
+  const move_error_t error = check_rewind(index);
+
+  if (error != MOVE_OK) {
+    throw_illegal_move(history.back().state(), "Rewind", error);
+  }
+
+  const uint64_t start = metrics_now_us();
+  const game_state_t state = history.at(index).state();
+  uint32_t clicks = history.size() - 1 - index;
+
+  /* UNDO_BUTTON is a guess: one click must be seen to take a gesture back
+   * before a batch goes out there.
+   */
+  if (!sandbox && !is_undo_button_confirmed && clicks != 0) {
+    click_undo(1, gesture_safe_timing());
+
+    if (!board_matches(history.at(history.size() - 2).state())) {
+      std::cout << "Clicking (" << undo_button.first << ", "
+        << undo_button.second << ") didn't undo, see --undo-button"
+        << std::endl;
+      throw RewindException();
+    }
+
+    is_undo_button_confirmed = true;
+    clicks--;
+  }
+
+  click_undo(clicks, gesture_timing(GESTURE_CLICK));
+
+  if (!board_matches(state)) {
+    /* The game is slow, or missed clicks and is at a later state: the
+     * earliest the board matches, so as not to undo past [index].
+     */
+    uint32_t reached = index;
+
+    usleep(gesture_safe_timing().settle_us);
+
+    while (reached < history.size()
+        && !board_matches(history.at(reached).state())) {
+      reached++;
+    }
+
+    if (reached == history.size()) {
+      throw RewindException();
+    }
+
+    if (reached != index) {
+      std::cout << "Rewind fell short by " << reached - index
+        << " gesture(s)" << std::endl;
+      click_undo(reached - index, gesture_safe_timing());
+
+      if (!board_matches(state)) {
+        throw RewindException();
+      }
+    }
+  }
+
+  history.truncate(index + 1);
+
+  if (sandbox) {
+    simulator_undo_to(state);
+  }
+
+  rewind_time.record(metrics_now_us() - start);
+  return state;
+}
+
+bool interact_load_history(const std::string & path)
+{
+  return history.load(path);
+}
+
 game_state_t load_initial_game_state()
 {
   tableau_deck_t tableau[7];
@@ -137,7 +560,7 @@ game_state_t load_initial_game_state()
   for (uint32_t i = 0 ; i < 7 ; i++) {
     tableau_position_t pos = { .deck = i, .num_hidden = i, .position = 0 };
     tableau[i].num_down_cards = i;
-    tableau[i].cards = { recognize_tableau_card(pos) };
+    tableau[i].cards = { see_tableau_card(pos) };
   }
   auto none = Option<card_t>();
 
@@ -153,38 +576,36 @@ game_state_t load_initial_game_state()
   ret.stock_pile_size = stock_pile_size;
   ret.remaining_pile_size = stock_pile_size;
 
+  history.clear();
+  history.push(ret, "deal");
+
   return ret;
 }
 
 game_state_t draw_from_stock_pile(const game_state_t & state)
 {
   game_state_t next_state = state;
+  const move_error_t error = check_draw_from_stock_pile(state);
 
-  if (state.stock_pile_size <= 0) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Cannot draw from stock pile when stock pile size is <= 0");
+  if (error != MOVE_OK) {
+    throw_illegal_move(state, "Drawing from the stock pile", error);
   }
 
-  click_card(
-      DRAW_PILE.first + CARD_WIDTH / 2,
-      DRAW_PILE.second + CARD_HEIGHT / 2
-  );
-
   next_state.stock_pile_size -= 1;
-  next_state.waste_pile_top = Option<card_t>(recognize_visible_pile_card());
+  next_state.waste_pile_top = Option<card_t>(
+      draw_card(state.waste_pile_top));
 
+  history.push(next_state, "draw");
   return next_state;
 }
 
 game_state_t reset_stock_pile(const game_state_t & state)
 {
   game_state_t next_state = state;
+  const move_error_t error = check_reset_stock_pile(state);
 
-  if (state.stock_pile_size != 0) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Cannot reset stock pile when stock_pile_size != 0");
+  if (error != MOVE_OK) {
+    throw_illegal_move(state, "Resetting the stock pile", error);
   }
 
   click_card(
@@ -192,9 +613,14 @@ game_state_t reset_stock_pile(const game_state_t & state)
       DRAW_PILE.second + CARD_HEIGHT / 2
   );
 
+  if (sandbox) {
+    simulator_reset_stock_pile();
+  }
+
   next_state.stock_pile_size = state.remaining_pile_size;
   next_state.waste_pile_top = Option<card_t>();
 
+  history.push(next_state, "reset");
   return next_state;
 }
 
@@ -230,35 +656,104 @@ bool is_promote_to_foundation_legal(
   );
 }
 
+move_error_t check_draw_from_stock_pile(const game_state_t & state)
+{
+  return state.stock_pile_size == 0 ? MOVE_STOCK_EMPTY : MOVE_OK;
+}
+
+move_error_t check_reset_stock_pile(const game_state_t & state)
+{
+  return state.stock_pile_size != 0 ? MOVE_STOCK_NOT_EMPTY : MOVE_OK;
+}
+
+move_error_t check_move_from_visible_pile_to_tableau(
+    const game_state_t & state, uint32_t deck)
+{
+  if (!state.waste_pile_top.is_some()) {
+    return MOVE_NO_WASTE_CARD;
+  }
+
+  return is_transfer_legal(state.waste_pile_top.get(), state.tableau[deck])
+    ? MOVE_OK
+    : MOVE_ILLEGAL_TRANSFER;
+}
+
+move_error_t check_move_from_visible_pile_to_foundation(
+    const game_state_t & state, uint32_t foundation_position)
+{
+  if (!state.waste_pile_top.is_some()) {
+    return MOVE_NO_WASTE_CARD;
+  }
+
+  return is_promote_to_foundation_legal(
+      state.foundation[foundation_position], state.waste_pile_top.get())
+    ? MOVE_OK
+    : MOVE_ILLEGAL_PROMOTION;
+}
+
+move_error_t check_move_from_tableau_to_foundation(
+    const game_state_t & state,
+    uint32_t tableau_position,
+    uint32_t foundation_position)
+{
+  const std::vector<card_t> & cards = state.tableau[tableau_position].cards;
+
+  if (cards.size() == 0) {
+    return MOVE_EMPTY_COLUMN;
+  }
+
+  return is_promote_to_foundation_legal(
+      state.foundation[foundation_position], cards.back())
+    ? MOVE_OK
+    : MOVE_ILLEGAL_PROMOTION;
+}
+
+move_error_t check_move_from_column_to_column(
+    const game_state_t & state,
+    const tableau_position_t & position,
+    uint32_t destination)
+{
+  const tableau_deck_t & src_deck = state.tableau[position.deck];
+
+  if (position.num_hidden != src_deck.num_down_cards
+      || position.position >= src_deck.cards.size()) {
+    return MOVE_BAD_POSITION;
+  }
+
+  return is_transfer_legal(
+      src_deck.cards[position.position], state.tableau[destination])
+    ? MOVE_OK
+    : MOVE_ILLEGAL_TRANSFER;
+}
+
 game_state_t move_from_visible_pile_to_tableau(
     const game_state_t & state,
     const uint32_t deck
 )
 {
-  if (!state.waste_pile_top.is_some()) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "waste pile is missing. Cannot move to tableau."
-    );
+  const move_error_t error =
+    check_move_from_visible_pile_to_tableau(state, deck);
+
+  if (error != MOVE_OK) {
+    throw_illegal_move(state, "Transfer from waste pile to tableau", error);
   }
 
   const card_t waste_pile_top = state.waste_pile_top.get();
   const tableau_deck_t & tableau_deck = state.tableau[deck];
 
-  if (!is_transfer_legal(waste_pile_top, tableau_deck)) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Intended transfer from waste pile to tableau is illegal. Tbl "
-        + std::to_string(deck));
-  }
-
   /* Dragging the card in the game */
   std::pair<uint32_t, uint32_t> from = std::make_pair(
       VISIBLE_PILE.first + CARD_WIDTH / 2 ,
       VISIBLE_PILE.second + CARD_HEIGHT / 2
   );
   std::pair<uint32_t, uint32_t> to = get_end_card_position(state, deck);
-  drag_mouse(from, to);
+  const tableau_position_t landed = {
+    .deck = deck,
+    .num_hidden = tableau_deck.num_down_cards,
+    .position = uint32_t(tableau_deck.cards.size())
+  };
+  drag_card(from, to, waste_pile_top,
+      [&]() { return see_tableau_card(landed); });
 
   game_state_t next_state = state;
 
@@ -267,6 +762,7 @@ game_state_t move_from_visible_pile_to_tableau(
   /* See the new card in the pile */
   unsafe_remove_card_from_visible_pile(&next_state);
 
+  history.push(next_state, "waste_to_tableau");
   return next_state;
 }
 
@@ -275,20 +771,16 @@ game_state_t move_from_visible_pile_to_foundation(
     const uint32_t foundation_pos
 )
 {
-  if (!state.waste_pile_top.is_some()) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException("Missing visible pile to to move to foundation");
+  const move_error_t error =
+    check_move_from_visible_pile_to_foundation(state, foundation_pos);
+
+  if (error != MOVE_OK) {
+    throw_illegal_move(
+        state, "Promotion from waste pile to foundation", error);
   }
 
-  const Option<card_t> & foundation = state.foundation[foundation_pos];
   const card_t & waste_pile_top = state.waste_pile_top.get();
 
-  if (!is_promote_to_foundation_legal(foundation, waste_pile_top)) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Intended promotion from waste pile to foundation is illegal");
-  }
-
   std::pair<uint32_t, uint32_t> from = std::make_pair(
       VISIBLE_PILE.first + CARD_WIDTH / 2 ,
       VISIBLE_PILE.second + CARD_HEIGHT / 2
@@ -297,12 +789,14 @@ game_state_t move_from_visible_pile_to_foundation(
       FOUNDATION_DECKS[foundation_pos].first + CARD_WIDTH / 2 ,
       FOUNDATION_DECKS[foundation_pos].second + CARD_HEIGHT / 2
   );
-  drag_mouse(from, to);
+  drag_card(from, to, waste_pile_top,
+      [&]() { return recognize_foundation_card(foundation_pos); });
 
   game_state_t next_state = state;
   next_state.foundation[foundation_pos] = Option<card_t>(waste_pile_top);
   unsafe_remove_card_from_visible_pile(&next_state);
 
+  history.push(next_state, "waste_to_foundation");
   return next_state;
 }
 
@@ -313,34 +807,29 @@ game_state_t move_from_tableau_to_foundation(
 )
 {
   const tableau_deck_t & tbl_deck = state.tableau[tableau_position];
+  const move_error_t error = check_move_from_tableau_to_foundation(
+      state, tableau_position, foundation_position);
 
-  if (tbl_deck.cards.size() == 0) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "No cards in tableau to move to foundation.");
+  if (error != MOVE_OK) {
+    throw_illegal_move(state, "Promotion from tableau to foundation", error);
   }
 
-  const Option<card_t> & foundation = state.foundation[foundation_position];
   const card_t & foundation_bound = tbl_deck.cards.back();
 
-  if (!is_promote_to_foundation_legal(foundation, foundation_bound)) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Intended promotion from tableau to foundation is illegal");
-  }
-
   std::pair<uint32_t, uint32_t> from = get_end_card_position(
       state, tableau_position);
   std::pair<uint32_t, uint32_t> to = std::make_pair(
       FOUNDATION_DECKS[foundation_position].first + CARD_WIDTH / 2 ,
       FOUNDATION_DECKS[foundation_position].second + CARD_HEIGHT / 2
   );
-  drag_mouse(from, to);
+  drag_card(from, to, foundation_bound,
+      [&]() { return recognize_foundation_card(foundation_position); });
 
   game_state_t next_state = state;
   next_state.foundation[foundation_position] = Option<card_t>(foundation_bound);
   unsafe_remove_card_from_tableau(&next_state, tableau_position);
 
+  history.push(next_state, "tableau_to_foundation");
   return next_state;
 
 }
@@ -358,18 +847,11 @@ game_state_t move_from_column_to_column(
     throw InconsistentArgument();
   }
 
-  if (position.position >= src_deck.cards.size()
-      || !is_transfer_legal(src_deck.cards[position.position], dest_deck)) {
-    std::cout << state << std::endl;
-    throw IllegalMoveException(
-        "Transfer from deck "
-        + std::to_string(position.deck)
-        + "."
-        + std::to_string(position.position)
-        + " to deck "
-        + std::to_string(destination)
-        + " is illegal"
-    );
+  const move_error_t error =
+    check_move_from_column_to_column(state, position, destination);
+
+  if (error != MOVE_OK) {
+    throw_illegal_move(state, "Transfer between columns", error);
   }
 
   std::pair<uint32_t, uint32_t> from = std::make_pair(
@@ -380,7 +862,13 @@ game_state_t move_from_column_to_column(
   );
   std::pair<uint32_t, uint32_t> to = get_end_card_position(
       state, destination);
-  drag_mouse(from, to);
+  const tableau_position_t landed = {
+    .deck = destination,
+    .num_hidden = dest_deck.num_down_cards,
+    .position = uint32_t(dest_deck.cards.size())
+  };
+  drag_card(from, to, src_deck.cards[position.position],
+      [&]() { return see_tableau_card(landed); });
 
   game_state_t next_state = state;
 
@@ -398,5 +886,6 @@ game_state_t move_from_column_to_column(
       next_state.tableau[position.deck].cards.end());
   unsafe_remove_card_from_tableau(&next_state, position.deck);
 
+  history.push(next_state, "column_to_column");
   return next_state;
 }
@@ -1,12 +1,15 @@
 #ifndef INTERACT_HPP
 #define INTERACT_HPP
 
+#include <stdint.h>
+
 #include <string>
 #include <exception>
 
 #include <robot.h>
 
 #include "game.hpp"
+#include "history.hpp"
 
 class IllegalMoveException : public std::exception {
 private:
@@ -17,9 +20,57 @@ public:
 };
 class InconsistentArgument : public std::exception {};
 
+/* Thrown when the board isn't where undoing should have taken it, even
+ * after giving the game time and making up for missed clicks.
+ */
+class RewindException : public std::exception {
+};
+
+/* Why a move is illegal in a state. The check_ functions below say so
+ * without throwing, for code that tries many moves; the moves themselves
+ * throw IllegalMoveException, for the live loop.
+ */
+enum move_error_t {
+  MOVE_OK = 0,
+  MOVE_NO_WASTE_CARD,
+  MOVE_STOCK_EMPTY,
+  MOVE_STOCK_NOT_EMPTY,
+  MOVE_EMPTY_COLUMN,
+  MOVE_BAD_POSITION,
+  MOVE_NO_INDEX,          /* The location (eg. the waste pile) has none. */
+  MOVE_ILLEGAL_TRANSFER,
+  MOVE_ILLEGAL_PROMOTION,
+  MOVE_NOTHING_TO_UNDO,
+  MOVE_NO_SUCH_STATE,     /* Not in the history. */
+  NUM_MOVE_ERRORS
+};
+
+const char *move_error_name(move_error_t error);
+
+move_error_t check_draw_from_stock_pile(const game_state_t & state);
+move_error_t check_reset_stock_pile(const game_state_t & state);
+move_error_t check_move_from_visible_pile_to_tableau(
+    const game_state_t & state, uint32_t deck);
+move_error_t check_move_from_visible_pile_to_foundation(
+    const game_state_t & state, uint32_t foundation_position);
+move_error_t check_move_from_tableau_to_foundation(
+    const game_state_t & state,
+    uint32_t tableau_position,
+    uint32_t foundation_position);
+move_error_t check_move_from_column_to_column(
+    const game_state_t & state,
+    const tableau_position_t & position,
+    uint32_t destination);
+
 void interact_init(robot_h robot);
+/* Plays against the simulator instead of the screen, on the calling
+ * thread.
+ */
 void set_sandbox_mode(bool flag);
 
+/* The states of the current game, one per gesture since the deal. */
+const state_history_t & interact_history();
+
 game_state_t load_initial_game_state();
 game_state_t draw_from_stock_pile(const game_state_t &);
 game_state_t reset_stock_pile(const game_state_t &);
@@ -51,4 +102,38 @@ bool is_promote_to_foundation_legal(
 void interact_short_sleep();
 void click_card(uint32_t x, uint32_t y);
 
+/* Clicks the game's undo button, which takes back the last gesture (a
+ * move, a draw or a reset of the stock pile), and returns the state from
+ * before it, as the history has it.
+ */
+move_error_t check_undo_gesture();
+game_state_t undo_gesture();
+
+/* Takes the game back to state [index] of the history (0 being the deal)
+ * and returns it. The undo clicks go out in one batch, without waiting
+ * for the game in between, so this takes time in the number of gestures
+ * undone. The board is then checked once by recognition; clicks the game
+ * missed are made up for, and RewindException thrown if that fails too.
+ * Until the undo button was given or seen to work, a single click goes
+ * first, and RewindException is thrown before any other when the board
+ * isn't one gesture back.
+ */
+move_error_t check_rewind(uint32_t index);
+game_state_t rewind_to(uint32_t index);
+
+/* Picks up the history of a game an earlier run played, from its session
+ * log (see state_history_t::save), eg. to rewind it.
+ */
+bool interact_load_history(const std::string & path);
+
+/* Where undo_gesture clicks, UNDO_BUTTON (see vision.hpp) by default.
+ * Trusted without the check rewind_to makes at UNDO_BUTTON.
+ */
+void interact_set_undo_button(uint32_t x, uint32_t y);
+
+/* Gestures made on the calling thread so far, in sandbox mode too, where
+ * they cost nothing but would on screen.
+ */
+uint64_t interact_num_gestures();
+
 #endif
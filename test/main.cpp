@@ -2,9 +2,12 @@
 #include <thread>
 #include <chrono>
 #include <utility>
+#include <algorithm>
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <opencv2/core/core.hpp>
@@ -16,43 +19,344 @@
 #include "game.hpp"
 #include "vision.hpp"
 #include "interact.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "calibrate.hpp"
+#include "screen.hpp"
+#include "recorder.hpp"
+
+/* Picked up by the host agent, see metrics.hpp. Override with
+ * --metrics-file=<path>.
+ */
+static const char *DEFAULT_METRICS_FILE = "metrics.prom";
+static const uint32_t METRICS_EXPORT_PERIOD_MS = 5000;
+
+/* Tuned gesture timings, see calibrate.hpp. Override with
+ * --gesture-timings=<path>.
+ */
+static const char *DEFAULT_GESTURE_TIMINGS_FILE = "gesture_timings.txt";
+
+/* Every state of the last game, for `undo` mode to rewind it. Override
+ * with --session-log=<path>.
+ */
+static const char *DEFAULT_SESSION_LOG_FILE = "session.log";
+
+/* The flight recorder's dump (see recorder.hpp), written when the game
+ * loop throws, on a fatal signal, or after --watchdog-s=<seconds> (0 for
+ * never) without an event. Override with --flight-recorder=<path>.
+ */
+static const char *DEFAULT_FLIGHT_RECORDER_FILE = "flight_recorder.bin";
+static const uint32_t DEFAULT_WATCHDOG_S = 60;
+
+static const char *option_of_args(
+    int argc, const char *argv[], const char *prefix, const char *fallback)
+{
+  for (int i = 1 ; i < argc ; i++) {
+    if (strncmp(argv[i], prefix, strlen(prefix)) == 0) {
+      return argv[i] + strlen(prefix);
+    }
+  }
+
+  return fallback;
+}
+
+/* --beam-width=<states>, --beam-depth=<moves> and --beam-threads=<n> (all
+ * cores by default) size beam search to the host.
+ */
+static beam_options_t beam_options_of_args(int argc, const char *argv[])
+{
+  beam_options_t options = beam_default_options();
+  const char *width = option_of_args(argc, argv, "--beam-width=", NULL);
+  const char *depth = option_of_args(argc, argv, "--beam-depth=", NULL);
+  const char *threads = option_of_args(argc, argv, "--beam-threads=", NULL);
+
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+  if (width != NULL) {
+    options.width = atoi(width);
+  }
+  if (depth != NULL) {
+    options.depth = atoi(depth);
+  }
+  if (threads != NULL) {
+    options.threads = atoi(threads);
+  }
+
+  return options;
+}
+
+static bool has_flag(int argc, const char *argv[], const char *flag)
+{
+  for (int i = 1 ; i < argc ; i++) {
+    if (strcmp(argv[i], flag) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* --deadline-ms=<ms> bounds the time the decision engine (see engine.hpp)
+ * takes per decision.
+ */
+static engine_options_t engine_options_of_args(int argc, const char *argv[])
+{
+  engine_options_t options = engine_default_options();
+  const char *deadline = option_of_args(argc, argv, "--deadline-ms=", NULL);
+
+  options.beam = beam_options_of_args(argc, argv);
+  options.portfolio.beam = options.beam;
+
+  if (deadline != NULL) {
+    options.deadline_ms = atoi(deadline);
+  }
+
+  return options;
+}
+
+/* --engine=<name> picks the decision engine, "rules" by default. */
+static bool set_engine_of_args(int argc, const char *argv[])
+{
+  const engine_options_t options = engine_options_of_args(argc, argv);
+  const char *name = option_of_args(argc, argv, "--engine=", "rules");
+
+  try {
+    strategy_set_engine(engine_create(name, options), options.deadline_ms);
+  } catch (EngineException & e) {
+    std::cout << "Unknown engine " << name << ", pick one of:";
+
+    for (const char *const *known = ENGINE_NAMES ; *known != NULL ; known++) {
+      std::cout << " " << *known;
+    }
+
+    std::cout << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/* --undo-button=<x>,<y> if the game's undo button isn't at UNDO_BUTTON.
+ * Returns whether it was given.
+ */
+static bool set_undo_button_of_args(int argc, const char *argv[])
+{
+  const char *undo_button = option_of_args(argc, argv, "--undo-button=", NULL);
+  uint32_t x, y;
+
+  if (undo_button != NULL && sscanf(undo_button, "%u,%u", &x, &y) == 2) {
+    interact_set_undo_button(x, y);
+    return true;
+  }
+
+  return false;
+}
+
+/* --peek turns peeking under Rule 2 moves on (see peek.hpp), at most
+ * --peek-max-gestures=<n> gestures per game. Only with [has_undo_button]:
+ * a peek's undo missing UNDO_BUTTON would leave the move it peeked with.
+ */
+static void set_peek_of_args(
+    int argc, const char *argv[], bool has_undo_button)
+{
+  peek_options_t options = peek_default_options();
+  const char *max_gestures =
+    option_of_args(argc, argv, "--peek-max-gestures=", NULL);
+
+  options.enabled = has_flag(argc, argv, "--peek");
+
+  if (options.enabled && !has_undo_button) {
+    std::cout << "Not peeking: --peek needs --undo-button=<x>,<y>"
+      << std::endl;
+    options.enabled = false;
+  }
+
+  if (max_gestures != NULL) {
+    options.max_gestures = atoi(max_gestures);
+  }
+
+  strategy_set_peek_options(options);
+}
+
+/* `undo` mode: takes the last run's game back to state --rewind-to=<n> of
+ * its session log, the deal by default. The log is cut there, so that
+ * another rewind carries on from it.
+ */
+static int rewind_session(
+    int argc, const char *argv[], const char *session_log)
+{
+  const uint32_t index = atoi(option_of_args(argc, argv, "--rewind-to=", "0"));
+
+  if (!interact_load_history(session_log)) {
+    std::cout << "No session log at " << session_log << std::endl;
+    return 1;
+  }
+
+  std::cout << "Rewinding " << interact_history().size() - 1
+    << " gesture(s) to state " << index << std::endl;
+
+  try {
+    std::cout << rewind_to(index) << std::endl;
+  } catch (IllegalMoveException & e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  } catch (RewindException & e) {
+    std::cout << "The board doesn't match state " << index << std::endl;
+    return 1;
+  }
+
+  interact_history().save(session_log);
+  return 0;
+}
+
+/* --save-dialog=<name>,<x>,<y>,<width>,<height> captures a dialog's
+ * button as its template (see screen.hpp), rather than playing.
+ */
+static bool save_dialog_of_args(int argc, const char *argv[])
+{
+  const char *dialog = option_of_args(argc, argv, "--save-dialog=", NULL);
+  char name[64];
+  rectangle_t rect;
+
+  if (dialog == NULL
+      || sscanf(dialog, "%63[^,],%u,%u,%u,%u", name,
+        &rect.x, &rect.y, &rect.width, &rect.height) != 5) {
+    return false;
+  }
+
+  screen_save_template(name, rect);
+  std::cout << "Saved the template of the " << name << " dialog" << std::endl;
+  return true;
+}
 
 int entry_point(int argc, const char *argv[])
 {
   static char char_buffer[200];
+
+  /* Before anything that would need undoing on the way out. */
+  if (!set_engine_of_args(argc, argv)) {
+    return 1;
+  }
+
   robot_h robot = robot_init();
 
+  const char *gesture_timings_file = option_of_args(
+      argc, argv, "--gesture-timings=", DEFAULT_GESTURE_TIMINGS_FILE);
+  const char *session_log = option_of_args(
+      argc, argv, "--session-log=", DEFAULT_SESSION_LOG_FILE);
+  const char *watchdog_s = option_of_args(argc, argv, "--watchdog-s=", NULL);
+  const uint32_t watchdog_ms = 1000
+    * (watchdog_s != NULL ? atoi(watchdog_s) : DEFAULT_WATCHDOG_S);
+
+  recorder_init(option_of_args(
+        argc, argv, "--flight-recorder=", DEFAULT_FLIGHT_RECORDER_FILE));
+
+  metrics_start_export(
+      option_of_args(argc, argv, "--metrics-file=", DEFAULT_METRICS_FILE),
+      METRICS_EXPORT_PERIOD_MS);
+
+  if (has_flag(argc, argv, "--perf-counters")) {
+    trace_enable_perf_counters();
+  }
+
+  set_peek_of_args(argc, argv, set_undo_button_of_args(argc, argv));
   vision_init(robot);
   interact_init(robot);
+  screen_init(robot);
+
+  if (save_dialog_of_args(argc, argv)) {
+    robot_free(robot);
+    metrics_stop_export();
+    return 0;
+  }
+
+  if (has_flag(argc, argv, "undo")) {
+    gesture_timings_load(gesture_timings_file);
+
+    const int status = rewind_session(argc, argv, session_log);
+
+    robot_free(robot);
+    metrics_stop_export();
+    return status;
+  }
+
+  /* Calibrates while playing this game when there is nothing cached. */
+  if (has_flag(argc, argv, "--calibrate-gestures")
+      || !gesture_timings_load(gesture_timings_file)) {
+    std::cout << "Calibrating gesture timings" << std::endl;
+    calibration_start();
+  }
 
+  if (watchdog_ms != 0) {
+    recorder_start_watchdog(watchdog_ms);
+  }
+
+  trace_begin_game();
+  recorder_record(RECORD_GAME);
   game_state_t game_state = load_initial_game_state();
 
   std::cout << "Initial state = " << game_state << std::endl;
 
+  /* Checked once per step: a known dialog ends the game, unless it was an
+   * interruption that went away; an unknown screen doesn't.
+   */
+  screen_state_t screen = SCREEN_BOARD;
+
   try {
     game_state = strategy_init(game_state);
     bool moved;
 
     do {
+      screen = screen_check();
+
+      if (!screen_is_playable(screen)) {
+        std::cout << "Stopped on the " << screen_state_name(screen)
+          << " screen" << std::endl;
+        break;
+      }
+
+      const uint64_t start = metrics_now_us();
+
       game_state = strategy_step(game_state, &moved);
+      recorder_record(RECORD_STEP, moved, 0, metrics_now_us() - start);
     } while(moved);
-  } catch (std::exception e) {
-
+  } catch (std::exception & e) {
+    std::cout << "Game loop stopped by an exception: " << e.what()
+      << std::endl;
+    recorder_record(RECORD_EXCEPTION, recorder_tag(e.what()));
+    recorder_dump(RECORDER_DUMP_EXCEPTION);
   }
 
-  std::cout << "Wrapping up " << game_state << std::endl;
-  game_state = strategy_term(game_state);
+  if (screen_is_playable(screen)) {
+    std::cout << "Wrapping up " << game_state << std::endl;
+    game_state = strategy_term(game_state);
+
+    /* Deals with the win screen, most likely. */
+    screen_check();
+  }
 
   std::cout << "I AM DONE (not sure if i won the game)" << std::endl;
+  interact_history().save(session_log);
   std::cout << "Strategy internal state:" << std::endl;
   strategy_print_internal_state();
+  interact_history().print(std::cout);
+  trace_print_game_report(std::cout);
+  portfolio_print_stats(std::cout);
+
+  if (calibration_running()) {
+    calibration_finish();
+    gesture_timings_save(gesture_timings_file);
+    std::cout << "Saved gesture timings to " << gesture_timings_file << "\n";
+  }
+
+  std::cout << "Gesture timings:\n";
+  calibration_print(std::cout);
   std::cout << "Game state: " << std::endl;
   std::cout << game_state << "\n";
 
-  robot_mouse_move(robot, 2000, 100);
-  robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
-  robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+  recorder_stop_watchdog();
   robot_free(robot);
+  metrics_stop_export();
 
   return 0;
 }
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <robot.h>
+
+#include "metrics.hpp"
+
+namespace {
+
+enum metric_type_t {
+  METRIC_COUNTER,
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM
+};
+
+struct metric_entry_t {
+  std::string name;
+  std::string help;
+  std::string labels;
+  metric_type_t type;
+  void *metric;
+};
+
+/* Entries are never removed, and the metrics themselves are heap allocated,
+ * so references handed out stay valid while the vector grows.
+ *
+ * Metrics get registered from static initializers of other files, hence
+ * the function-local static.
+ */
+static std::mutex registry_lock;
+
+static std::vector<metric_entry_t> & registry()
+{
+  static std::vector<metric_entry_t> *entries =
+    new std::vector<metric_entry_t>();
+  return *entries;
+}
+
+static void *find_or_register(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels,
+    metric_type_t type)
+{
+  std::lock_guard<std::mutex> lock(registry_lock);
+
+  for (const metric_entry_t & entry : registry()) {
+    if (entry.name == name && entry.labels == labels) {
+      return entry.metric;
+    }
+  }
+
+  metric_entry_t entry;
+  entry.name = name;
+  entry.help = help;
+  entry.labels = labels;
+  entry.type = type;
+
+  if (type == METRIC_COUNTER) {
+    entry.metric = new metric_counter_t();
+  } else if (type == METRIC_GAUGE) {
+    entry.metric = new metric_gauge_t();
+  } else {
+    entry.metric = new metric_histogram_t();
+  }
+
+  registry().push_back(entry);
+  return entry.metric;
+}
+
+static const char *type_name(metric_type_t type)
+{
+  const char *names[] = { "counter", "gauge", "histogram" };
+  return names[type];
+}
+
+static std::string with_label(
+    const std::string & labels, const std::string & extra)
+{
+  if (labels.empty()) {
+    return "{" + extra + "}";
+  }
+  return "{" + labels + "," + extra + "}";
+}
+
+static std::string braced(const std::string & labels)
+{
+  return labels.empty() ? "" : "{" + labels + "}";
+}
+
+static void write_histogram(
+    std::ostream & out,
+    const metric_entry_t & entry,
+    const metric_histogram_t & histogram)
+{
+  uint64_t cumulative = 0;
+
+  /* Only non-empty buckets are written. Buckets are cumulative, so that
+   * loses nothing.
+   */
+  for (uint32_t i = 0 ; i < HISTOGRAM_NUM_BUCKETS ; i++) {
+    uint64_t n = histogram.bucket_count(i);
+
+    if (n == 0) {
+      continue;
+    }
+
+    cumulative += n;
+    char le[64];
+    snprintf(le, sizeof(le), "le=\"%.6f\"",
+        double(metric_histogram_t::bucket_upper_bound(i)) / 1e6);
+    out << entry.name << "_bucket" << with_label(entry.labels, le)
+      << " " << cumulative << "\n";
+  }
+
+  out << entry.name << "_bucket" << with_label(entry.labels, "le=\"+Inf\"")
+    << " " << histogram.count() << "\n";
+  out << entry.name << "_sum" << braced(entry.labels)
+    << " " << double(histogram.sum()) / 1e6 << "\n";
+  out << entry.name << "_count" << braced(entry.labels)
+    << " " << histogram.count() << "\n";
+}
+
+static void write_robot_stats(std::ostream & out)
+{
+  robot_stats_t stats;
+  robot_get_stats(&stats);
+
+  out << "# HELP robot_screenshots_total Screenshots taken by the robot\n"
+    << "# TYPE robot_screenshots_total counter\n"
+    << "robot_screenshots_total " << stats.screenshots << "\n"
+    << "# HELP robot_screenshot_pixels_total Pixels captured\n"
+    << "# TYPE robot_screenshot_pixels_total counter\n"
+    << "robot_screenshot_pixels_total " << stats.screenshot_pixels << "\n"
+    << "# HELP robot_screenshot_bytes_total Bytes of captures handed out\n"
+    << "# TYPE robot_screenshot_bytes_total counter\n"
+    << "robot_screenshot_bytes_total " << stats.screenshot_bytes << "\n"
+    << "# HELP robot_screenshot_seconds_total Time spent capturing\n"
+    << "# TYPE robot_screenshot_seconds_total counter\n"
+    << "robot_screenshot_seconds_total "
+    << double(stats.screenshot_nanos) / 1e9 << "\n"
+    << "# HELP robot_input_events_total Input events sent by the robot\n"
+    << "# TYPE robot_input_events_total counter\n"
+    << "robot_input_events_total{event=\"mouse_move\"} "
+    << stats.mouse_moves << "\n"
+    << "robot_input_events_total{event=\"mouse_press\"} "
+    << stats.mouse_presses << "\n"
+    << "robot_input_events_total{event=\"mouse_release\"} "
+    << stats.mouse_releases << "\n"
+    << "robot_input_events_total{event=\"key_press\"} "
+    << stats.key_presses << "\n"
+    << "robot_input_events_total{event=\"key_release\"} "
+    << stats.key_releases << "\n";
+}
+
+static void write_snapshot(std::ostream & out)
+{
+  std::vector<metric_entry_t> entries;
+
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    entries = registry();
+  }
+
+  /* HELP and TYPE must appear once per metric name, so group the label
+   * variants together.
+   */
+  std::stable_sort(entries.begin(), entries.end(),
+      [](const metric_entry_t & a, const metric_entry_t & b) {
+        return a.name < b.name;
+      });
+
+  for (uint32_t i = 0 ; i < entries.size() ; i++) {
+    const metric_entry_t & entry = entries[i];
+
+    if (i == 0 || entries[i - 1].name != entry.name) {
+      out << "# HELP " << entry.name << " " << entry.help << "\n";
+      out << "# TYPE " << entry.name << " " << type_name(entry.type) << "\n";
+    }
+
+    if (entry.type == METRIC_COUNTER) {
+      out << entry.name << braced(entry.labels) << " "
+        << static_cast<metric_counter_t *>(entry.metric)->get() << "\n";
+    } else if (entry.type == METRIC_GAUGE) {
+      out << entry.name << braced(entry.labels) << " "
+        << static_cast<metric_gauge_t *>(entry.metric)->get() << "\n";
+    } else {
+      write_histogram(
+          out, entry, *static_cast<metric_histogram_t *>(entry.metric));
+    }
+  }
+
+  write_robot_stats(out);
+}
+
+static std::mutex export_lock;
+static std::condition_variable export_cv;
+static std::thread export_thread;
+static bool export_running = false;
+
+static void export_loop(std::string path, uint32_t period_ms)
+{
+  std::unique_lock<std::mutex> lock(export_lock);
+
+  while (export_running) {
+    export_cv.wait_for(lock, std::chrono::milliseconds(period_ms));
+    metrics_write_snapshot(path.c_str());
+  }
+}
+
+}
+
+metric_histogram_t::metric_histogram_t() : count_(0), sum_(0)
+{
+  for (uint32_t i = 0 ; i < HISTOGRAM_NUM_BUCKETS ; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+static uint32_t bucket_of_value(uint64_t v)
+{
+  if (v < HISTOGRAM_SUB_BUCKETS) {
+    return uint32_t(v);
+  }
+
+  uint32_t msb = 63 - __builtin_clzll(v);
+  uint32_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+
+  /* [v >> shift] is in [SUB_BUCKETS, 2 * SUB_BUCKETS) */
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS
+    + uint32_t(v >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+uint64_t metric_histogram_t::bucket_upper_bound(uint32_t bucket)
+{
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t mantissa = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void metric_histogram_t::record(uint64_t micros)
+{
+  buckets[bucket_of_value(micros)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(micros, std::memory_order_relaxed);
+}
+
+uint64_t metric_histogram_t::count() const
+{
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t metric_histogram_t::sum() const
+{
+  return sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t metric_histogram_t::bucket_count(uint32_t bucket) const
+{
+  return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+metric_counter_t & metrics_counter(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels)
+{
+  return *static_cast<metric_counter_t *>(
+      find_or_register(name, help, labels, METRIC_COUNTER));
+}
+
+metric_gauge_t & metrics_gauge(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels)
+{
+  return *static_cast<metric_gauge_t *>(
+      find_or_register(name, help, labels, METRIC_GAUGE));
+}
+
+metric_histogram_t & metrics_histogram(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels)
+{
+  return *static_cast<metric_histogram_t *>(
+      find_or_register(name, help, labels, METRIC_HISTOGRAM));
+}
+
+uint64_t metrics_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool metrics_write_snapshot(const char *path)
+{
+  std::string tmp_path = std::string(path) + ".tmp";
+
+  {
+    std::ofstream out(tmp_path.c_str());
+
+    if (!out) {
+      return false;
+    }
+
+    write_snapshot(out);
+
+    if (!out) {
+      return false;
+    }
+  }
+
+  return rename(tmp_path.c_str(), path) == 0;
+}
+
+void metrics_start_export(const std::string & path, uint32_t period_ms)
+{
+  std::lock_guard<std::mutex> lock(export_lock);
+
+  if (export_running) {
+    return;
+  }
+
+  export_running = true;
+  export_thread = std::thread(export_loop, path, period_ms);
+}
+
+void metrics_stop_export()
+{
+  {
+    std::lock_guard<std::mutex> lock(export_lock);
+
+    if (!export_running) {
+      return;
+    }
+
+    export_running = false;
+  }
+
+  export_cv.notify_all();
+  export_thread.join();
+}
@@ -0,0 +1,151 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+/* In-process metrics registry.
+ *
+ * Metrics are registered once by name (and optional Prometheus label
+ * string, eg. [type="click"]) and live until the process exits, so the
+ * returned references can be cached, typically in a function-local static:
+ *
+ *   static metric_counter_t & captures =
+ *     metrics_counter("vision_captures_total", "Screen captures");
+ *   captures.inc();
+ *
+ * Registration takes a lock, updating a metric never does.
+ */
+
+class metric_counter_t {
+private:
+  std::atomic<uint64_t> value;
+
+public:
+  metric_counter_t() : value(0) {}
+
+  void inc(uint64_t n = 1) {
+    value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+class metric_gauge_t {
+private:
+  std::atomic<int64_t> value;
+
+public:
+  metric_gauge_t() : value(0) {}
+
+  void set(int64_t v) {
+    value.store(v, std::memory_order_relaxed);
+  }
+
+  void add(int64_t n) {
+    value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  int64_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+/* HDR-style log-linear histogram of durations in microseconds. Every power
+ * of two range is split into 16 linear sub-buckets, so any recorded value
+ * is off by at most 1/16 (~6%) over the whole range.
+ */
+const uint32_t HISTOGRAM_SUB_BUCKET_BITS = 4;
+const uint32_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+const uint32_t HISTOGRAM_NUM_BUCKETS =
+  (64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+class metric_histogram_t {
+private:
+  std::atomic<uint64_t> buckets[HISTOGRAM_NUM_BUCKETS];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+
+public:
+  metric_histogram_t();
+
+  void record(uint64_t micros);
+
+  uint64_t count() const;
+  uint64_t sum() const;
+  uint64_t bucket_count(uint32_t bucket) const;
+
+  /* Largest value that falls into [bucket]. */
+  static uint64_t bucket_upper_bound(uint32_t bucket);
+};
+
+metric_counter_t & metrics_counter(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels = ""
+);
+metric_gauge_t & metrics_gauge(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels = ""
+);
+metric_histogram_t & metrics_histogram(
+    const std::string & name,
+    const std::string & help,
+    const std::string & labels = ""
+);
+
+/* The counters of one metric, one per value of a label, registered once
+ * and picked by index (eg. an enum) when updated:
+ *
+ *   static const char *const RESULTS[] = { "hit", "miss" };
+ *   static metric_counter_table_t<2> lookups(
+ *     "cache_lookups_total", "Cache lookups, by result", "result", RESULTS);
+ *   lookups[hit ? 0 : 1].inc();
+ *
+ * [labels], if any, are the other labels, the same on every counter.
+ */
+template <uint32_t N>
+class metric_counter_table_t {
+private:
+  metric_counter_t *counters[N];
+
+public:
+  metric_counter_table_t(
+      const std::string & name,
+      const std::string & help,
+      const std::string & label,
+      const char *const (&values)[N],
+      const std::string & labels = "") {
+    for (uint32_t i = 0 ; i < N ; i++) {
+      counters[i] = &metrics_counter(name, help,
+          (labels.empty() ? "" : labels + ",")
+            + label + "=\"" + values[i] + "\"");
+    }
+  }
+
+  metric_counter_t & operator[](uint32_t i) const {
+    return *counters[i];
+  }
+};
+
+/* Monotonic clock, for feeding histograms. */
+uint64_t metrics_now_us();
+
+/* Writes a snapshot of every metric in Prometheus text format. The file is
+ * written next to [path] and renamed over it, so a scraper never sees a
+ * partial snapshot.
+ */
+bool metrics_write_snapshot(const char *path);
+
+/* Writes a snapshot to [path] every [period_ms] from a background thread.
+ * Stopping writes one last snapshot.
+ */
+void metrics_start_export(const std::string & path, uint32_t period_ms);
+void metrics_stop_export();
+
+#endif
@@ -0,0 +1,125 @@
+#include <algorithm>
+
+#include "peek.hpp"
+
+peek_options_t peek_default_options()
+{
+  peek_options_t options;
+
+  options.enabled = false;
+  options.max_gestures = 20;
+  options.gesture_cost = 0.1;
+
+  return options;
+}
+
+static inline bool stacks_on(const card_t & card, const card_t & onto)
+{
+  return onto.number == card.number + 1
+    && suite_color(onto.suite) != suite_color(card.suite);
+}
+
+double peek_card_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    const card_t & card,
+    uint64_t pile)
+{
+  const Option<card_t> & foundation = state.foundation[card.suite];
+
+  if (foundation.is_some()
+      ? foundation.get().number + 1 == card.number
+      : card.number == ACE) {
+    return PEEK_HOME;
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    const tableau_deck_t & column = state.tableau[deck];
+
+    if (deck == src) {
+      continue;
+    }
+
+    /* The card goes on the top of a column, [dest] being topped by the
+     * run it gets.
+     */
+    const std::vector<card_t> & top_of =
+      deck == dest ? state.tableau[src].cards : column.cards;
+
+    if (!top_of.empty() && stacks_on(card, top_of.back())) {
+      return PEEK_PLAYABLE;
+    }
+
+    /* A run off face down cards goes on the card. */
+    if (deck != dest
+        && column.num_down_cards != 0
+        && !column.cards.empty()
+        && stacks_on(column.cards[0], card)) {
+      return PEEK_PLAYABLE;
+    }
+  }
+
+  for (uint64_t cards = pile ; cards != 0 ; cards &= cards - 1) {
+    if (stacks_on(card_of_index(__builtin_ctzll(cards)), card)) {
+      return PEEK_PLAYABLE;
+    }
+  }
+
+  return PEEK_NOTHING;
+}
+
+double peek_expected_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    uint64_t candidates,
+    uint64_t pile)
+{
+  double total = 0;
+  uint32_t n = 0;
+
+  for ( ; candidates != 0 ; candidates &= candidates - 1, n++) {
+    total += peek_card_value(state, src, dest,
+        card_of_index(__builtin_ctzll(candidates)), pile);
+  }
+
+  return n ? total / n : PEEK_NOTHING;
+}
+
+double peek_information_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    uint64_t candidates,
+    uint64_t pile,
+    double best_other)
+{
+  double with = 0;
+  double without = 0;
+  uint32_t n = 0;
+
+  /* Knowing, the better of the two is picked for every card; not knowing,
+   * the better on average.
+   */
+  for ( ; candidates != 0 ; candidates &= candidates - 1, n++) {
+    const double value = peek_card_value(state, src, dest,
+        card_of_index(__builtin_ctzll(candidates)), pile);
+
+    with += std::max(value, best_other);
+    without += value;
+  }
+
+  return n ? with / n - std::max(without / n, best_other) : 0;
+}
+
+bool peek_is_worth(
+    const peek_options_t & options, uint32_t spent, double information)
+{
+  /* The move and its undo. */
+  const uint32_t gestures = 2;
+
+  return options.enabled
+    && spent + gestures <= options.max_gestures
+    && information > gestures * options.gesture_cost;
+}
@@ -0,0 +1,71 @@
+#ifndef PEEK_HPP
+#define PEEK_HPP
+
+#include <stdint.h>
+
+#include "game.hpp"
+
+/* Peeking: making a move that turns a face down card over, to see it, and
+ * taking the move back with the game's undo button (see undo_gesture) when
+ * another move is better. The card then stays known, pinned in the belief
+ * (see belief.hpp), the way strategy_init learns the stock pile by going
+ * through it.
+ *
+ * Peeks are only made where the rules guess between moves that can't all
+ * be made: runs off face down cards (Rule 2) competing for the one column,
+ * eg. two kings for an empty column. What each move turns over is valued
+ * (PEEK_*), and a peek is made when the value of knowing the card beats
+ * what its gestures (the move and its undo) cost. A peek that turns out
+ * best is kept rather than undone.
+ */
+
+/* What turning a card over is worth. */
+const double PEEK_NOTHING = 0;   /* No move for it. */
+const double PEEK_PLAYABLE = 1;  /* A card goes on it, or it goes somewhere. */
+const double PEEK_HOME = 2;      /* It goes to the foundation. */
+
+struct peek_options_t {
+  bool enabled;
+  uint32_t max_gestures;  /* Spent on peeks per game, at most. */
+  double gesture_cost;    /* Of a gesture, on the PEEK_* scale. */
+};
+
+peek_options_t peek_default_options();
+
+/* What [card] is worth, turned over in column [src] of [state] when its
+ * face up cards move onto column [dest]. [pile] is bit [card_index] of
+ * the stock and waste pile cards.
+ */
+double peek_card_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    const card_t & card,
+    uint64_t pile);
+
+/* The mean of peek_card_value over the cards in [candidates] (bits
+ * [card_index]), equally likely.
+ */
+double peek_expected_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    uint64_t candidates,
+    uint64_t pile);
+
+/* How much better the pick gets by knowing the card of the move, against
+ * the best of the other moves, [best_other]: the value of information.
+ */
+double peek_information_value(
+    const game_state_t & state,
+    uint32_t src,
+    uint32_t dest,
+    uint64_t candidates,
+    uint64_t pile,
+    double best_other);
+
+/* Whether knowing is worth a peek, [spent] gestures into the game. */
+bool peek_is_worth(
+    const peek_options_t & options, uint32_t spent, double information);
+
+#endif
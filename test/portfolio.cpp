@@ -0,0 +1,360 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "portfolio.hpp"
+#include "interact.hpp"
+#include "simulator.hpp"
+#include "strategy.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+struct engine_metrics_t {
+  metric_counter_t *picks;
+  metric_counter_t *finished;
+  metric_counter_t *late;  /* Past the deadline, or after a proven win. */
+  metric_histogram_t *latency;
+};
+
+/* The engine threads of a race: cancelled and joined on the way out of
+ * it, by an exception too.
+ */
+class race_threads_t {
+private:
+  std::atomic<bool> & cancel;
+
+public:
+  std::vector<std::thread> threads;
+
+  explicit race_threads_t(std::atomic<bool> & cancel) : cancel(cancel) {}
+
+  ~race_threads_t() {
+    cancel = true;
+
+    for (std::thread & thread : threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+};
+
+}
+
+const char *portfolio_engine_name(portfolio_engine_t engine)
+{
+  switch (engine) {
+    case PORTFOLIO_RULES: return "rules";
+    case PORTFOLIO_BEAM: return "beam";
+    case PORTFOLIO_SOLVER: return "solver";
+    default: return "unknown";
+  }
+}
+
+static const engine_metrics_t & engine_metrics(portfolio_engine_t engine)
+{
+  static engine_metrics_t metrics[NUM_PORTFOLIO_ENGINES];
+  static std::once_flag registered;
+
+  std::call_once(registered, []() {
+    for (uint32_t i = 0 ; i < NUM_PORTFOLIO_ENGINES ; i++) {
+      const std::string label = std::string("engine=\"")
+        + portfolio_engine_name(portfolio_engine_t(i)) + "\"";
+
+      metrics[i].picks = &metrics_counter(
+          "portfolio_picks_total",
+          "Races won, by engine",
+          label);
+      metrics[i].finished = &metrics_counter(
+          "portfolio_finished_total",
+          "Engine runs done by the deadline, by engine",
+          label);
+      metrics[i].late = &metrics_counter(
+          "portfolio_late_total",
+          "Engine runs whose result came in after the race was decided, "
+          "by engine",
+          label);
+      metrics[i].latency = &metrics_histogram(
+          "portfolio_engine_seconds",
+          "Time for an engine to come up with its move, by engine",
+          label);
+    }
+  });
+
+  return metrics[engine];
+}
+
+portfolio_options_t portfolio_default_options()
+{
+  portfolio_options_t options;
+
+  options.beam = beam_default_options();
+  options.solver = solver_default_options();
+
+  return options;
+}
+
+portfolio_t::portfolio_t(const portfolio_options_t & options)
+  : options(options),
+    cancel(false),
+    closed(false)
+{
+  if (options.beam.width != 0) {
+    beam_options_t beam_options = options.beam;
+
+    beam_options.cancel = &cancel;
+    beam.reset(new beam_search_t(beam_options));
+  }
+
+  if (options.solver.max_nodes != 0) {
+    solver_options_t solver_options = options.solver;
+
+    solver_options.cancel = &cancel;
+    solver_options.goal = SOLVER_GOAL_REVEAL;
+    reveal_solver.reset(new solver_t(solver_options));
+
+    solver_options.goal = SOLVER_GOAL_WIN;
+    solver_options.max_depth = SOLVER_MAX_DEPTH;
+    win_solver.reset(new solver_t(solver_options));
+  }
+}
+
+void portfolio_t::report(
+    portfolio_engine_t engine, const entry_t & entry, uint64_t start)
+{
+  const engine_metrics_t & metrics = engine_metrics(engine);
+
+  metrics.latency->record(metrics_now_us() - start);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (closed) {
+      metrics.late->inc();
+      return;
+    }
+
+    entries[engine] = entry;
+    entries[engine].finished = true;
+    metrics.finished->inc();
+  }
+
+  finished.notify_one();
+}
+
+bool portfolio_t::decided() const
+{
+  bool all_finished = true;
+
+  for (uint32_t i = 0 ; i < NUM_PORTFOLIO_ENGINES ; i++) {
+    if (entries[i].finished && entries[i].proven_win) {
+      return true;
+    }
+
+    all_finished = all_finished && entries[i].finished;
+  }
+
+  return all_finished;
+}
+
+void portfolio_t::run_rules(
+    const game_state_t & state,
+    const stock_model_t & stock,
+    const belief_t & belief,
+    const belief_sample_t & sample)
+{
+  const uint64_t start = metrics_now_us();
+  quiet_scope_t quiet;
+  entry_t entry = entry_t();
+
+  try {
+    set_sandbox_mode(true);
+    simulator_load(state, stock, sample);
+    strategy_resume(stock, belief);
+    strategy_set_cancel(&cancel);
+
+    const game_state_t after = strategy_step(state, &entry.has_move);
+
+    entry.score = beam_score(
+        packed_state_of(after, strategy_stock_pile().mask(), NULL));
+  } catch (std::exception & e) {
+    entry.has_move = false;
+  }
+
+  report(PORTFOLIO_RULES, entry, start);
+}
+
+void portfolio_t::run_beam(const packed_state_t & root)
+{
+  const uint64_t start = metrics_now_us();
+  const beam_result_t result = beam->search(root);
+  entry_t entry = entry_t();
+
+  entry.has_move = result.has_move;
+  entry.move = result.move;
+  entry.score = result.score;
+
+  report(PORTFOLIO_BEAM, entry, start);
+}
+
+/* [root] is dealt from the sample when [pinned]; otherwise its face down
+ * cards are unknown, and the line ends on the first one turned over.
+ */
+void portfolio_t::run_solver(const packed_state_t & root, bool pinned)
+{
+  const uint64_t start = metrics_now_us();
+  solver_t & solver = pinned ? *win_solver : *reveal_solver;
+  solver_result_t result;
+  entry_t entry = entry_t();
+
+  try {
+    result = solver.solve(root);
+  } catch (SolverException & e) {
+    result.outcome = SOLVER_EXHAUSTED;
+  }
+
+  if (result.outcome == SOLVER_FOUND && result.num_moves != 0) {
+    packed_state_t end = root;
+
+    for (uint32_t i = 0 ; i < result.num_moves ; i++) {
+      solver_apply_move(&end, result.moves[i]);
+    }
+
+    entry.has_move = true;
+    entry.proven_win = pinned;
+    entry.move = result.moves[0];
+    entry.score = beam_score(end);
+  }
+
+  report(PORTFOLIO_SOLVER, entry, start);
+}
+
+/* Every face down card is known when each slot has one candidate left. */
+static bool is_pinned(const belief_t & belief)
+{
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    for (uint32_t depth = 0 ; depth < belief.num_hidden(deck) ; depth++) {
+      const uint64_t candidates = belief.candidates(deck, depth);
+
+      if (candidates == 0 || (candidates & (candidates - 1)) != 0) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+portfolio_pick_t portfolio_t::race(
+    const game_state_t & state,
+    const stock_model_t & stock,
+    const belief_t & belief,
+    uint64_t deadline_us)
+{
+  static metric_counter_t & races = metrics_counter(
+      "portfolio_races_total", "Positions raced by the portfolio");
+  const packed_state_t root = packed_state_of(state, stock.mask(), NULL);
+  portfolio_pick_t pick;
+  belief_sample_t sample;
+  uint64_t rng = root.hash;
+
+  pick.engine = PORTFOLIO_RULES;
+  pick.proven_win = false;
+  pick.move = 0;
+  pick.score = 0;
+
+  /* Without a deal to play on, the rules are left to the live game. */
+  try {
+    belief.sample(&rng, &sample);
+  } catch (BeliefException & e) {
+    return pick;
+  }
+
+  const bool pinned = is_pinned(belief);
+  const packed_state_t dealt = packed_state_of(state, stock.mask(), &sample);
+
+  races.inc();
+  cancel = false;
+  closed = false;
+
+  for (uint32_t i = 0 ; i < NUM_PORTFOLIO_ENGINES ; i++) {
+    entries[i] = entry_t();
+  }
+
+  /* Engines that are left out are done before they start. */
+  entries[PORTFOLIO_BEAM].finished = beam == NULL;
+  entries[PORTFOLIO_SOLVER].finished = reveal_solver == NULL;
+
+  {
+    race_threads_t race(cancel);
+
+    race.threads.push_back(std::thread(
+          &portfolio_t::run_rules, this,
+          std::cref(state), std::cref(stock), std::cref(belief),
+          std::cref(sample)));
+
+    if (beam != NULL) {
+      race.threads.push_back(std::thread(
+            &portfolio_t::run_beam, this, std::cref(root)));
+    }
+
+    if (reveal_solver != NULL) {
+      race.threads.push_back(std::thread(
+            &portfolio_t::run_solver, this,
+            std::cref(pinned ? dealt : root), pinned));
+    }
+
+    /* Released before [race] joins the threads, which report under it. */
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint64_t now = metrics_now_us();
+
+    finished.wait_for(
+        lock,
+        std::chrono::microseconds(deadline_us > now ? deadline_us - now : 0),
+        [&]() { return decided(); });
+    closed = true;
+  }
+
+  /* Engines are in order of preference, so the rules win ties. */
+  bool has_pick = false;
+
+  for (uint32_t i = 0 ; i < NUM_PORTFOLIO_ENGINES ; i++) {
+    const entry_t & entry = entries[i];
+
+    if (!entry.finished || !entry.has_move) {
+      continue;
+    }
+
+    if (entry.proven_win || !has_pick || entry.score > pick.score) {
+      pick.engine = portfolio_engine_t(i);
+      pick.proven_win = entry.proven_win;
+      pick.move = entry.move;
+      pick.score = entry.score;
+      has_pick = true;
+    }
+
+    if (entry.proven_win) {
+      break;
+    }
+  }
+
+  engine_metrics(pick.engine).picks->inc();
+  return pick;
+}
+
+void portfolio_print_stats(std::ostream & out)
+{
+  for (uint32_t i = 0 ; i < NUM_PORTFOLIO_ENGINES ; i++) {
+    const portfolio_engine_t engine = portfolio_engine_t(i);
+    const engine_metrics_t & metrics = engine_metrics(engine);
+    const uint64_t runs = metrics.latency->count();
+
+    out << portfolio_engine_name(engine)
+      << ": picks = " << metrics.picks->get()
+      << " finished = " << metrics.finished->get()
+      << " late = " << metrics.late->get()
+      << " mean latency = "
+      << (runs ? metrics.latency->sum() / runs : 0) << " us\n";
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef PORTFOLIO_HPP
+#define PORTFOLIO_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#include "game.hpp"
+#include "belief.hpp"
+#include "stock.hpp"
+#include "solver.hpp"
+#include "beam.hpp"
+
+/* Races the decision engines against each other on one position, each on
+ * its own thread, under a shared deadline:
+ *
+ * - the rules: strategy_step itself, played on a simulated copy of the
+ *   game (see simulator_load) dealt from a sample of the belief,
+ * - a beam search (see beam.hpp),
+ * - the solver (see solver.hpp), on the same sampled deal: to a win when
+ *   the belief pins down every face down card, and so the sample is the
+ *   real deal, or else to turn over the next card.
+ *
+ * A proven win (the solver winning on a pinned down deal) is taken as soon
+ * as it comes in. Otherwise, at the deadline or once every engine is done,
+ * the engine whose line ends on the best beam_score is picked, the rules
+ * winning ties. Engines still running are cancelled and their results
+ * dropped. The rules stop at their next Rule 3 path search or candidate
+ * move (see strategy_set_cancel), so a race overruns its deadline by at
+ * most one such path search on the simulator.
+ *
+ * Easy positions are settled by the rules and the obvious moves before a
+ * race is run; a race only costs a deadline on positions where the rules
+ * would have guessed.
+ */
+
+enum portfolio_engine_t {
+  PORTFOLIO_RULES,
+  PORTFOLIO_BEAM,
+  PORTFOLIO_SOLVER,
+  NUM_PORTFOLIO_ENGINES
+};
+
+const char *portfolio_engine_name(portfolio_engine_t engine);
+
+struct portfolio_options_t {
+  beam_options_t beam;      /* Width 0 leaves the beam search out. */
+  solver_options_t solver;  /* max_nodes 0 leaves the solver out. */
+};
+
+portfolio_options_t portfolio_default_options();
+
+struct portfolio_pick_t {
+  portfolio_engine_t engine;
+  bool proven_win;
+  solver_move_t move;  /* First move of the line, unless the rules won. */
+  int32_t score;
+};
+
+/* Keeps its engines (and the beam search's threads) between races. Races
+ * are run one at a time.
+ */
+class portfolio_t {
+private:
+  struct entry_t {
+    bool finished;
+    bool has_move;
+    bool proven_win;
+    solver_move_t move;
+    int32_t score;
+  };
+
+  portfolio_options_t options;
+  std::atomic<bool> cancel;
+  std::unique_ptr<beam_search_t> beam;
+  std::unique_ptr<solver_t> reveal_solver;
+  std::unique_ptr<solver_t> win_solver;
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool closed;  /* Past the deadline, results are dropped. */
+  entry_t entries[NUM_PORTFOLIO_ENGINES];
+
+  portfolio_t(const portfolio_t &);
+  portfolio_t & operator=(const portfolio_t &);
+
+  void run_rules(
+      const game_state_t & state,
+      const stock_model_t & stock,
+      const belief_t & belief,
+      const belief_sample_t & sample);
+  void run_beam(const packed_state_t & root);
+  void run_solver(const packed_state_t & root, bool pinned);
+  void report(portfolio_engine_t engine, const entry_t & entry,
+      uint64_t start);
+  bool decided() const;
+
+public:
+  explicit portfolio_t(const portfolio_options_t & options);
+
+  const portfolio_options_t & get_options() const { return options; }
+
+  /* [stock] and [belief] as strategy_step knows them at [state].
+   * [deadline_us] is on the metrics_now_us() clock.
+   */
+  portfolio_pick_t race(
+      const game_state_t & state,
+      const stock_model_t & stock,
+      const belief_t & belief,
+      uint64_t deadline_us);
+};
+
+/* Races, picks and latencies of every engine so far. */
+void portfolio_print_stats(std::ostream & out);
+
+#endif
@@ -0,0 +1,145 @@
+#include "prune.hpp"
+
+const char *prune_rule_name(prune_rule_t rule)
+{
+  switch (rule) {
+    case PRUNE_NONE: return "none";
+    case PRUNE_KING_SHUFFLE: return "king_shuffle";
+    case PRUNE_REVERSAL: return "reversal";
+    case PRUNE_SPLIT_RUN: return "split_run";
+    case PRUNE_ALL: return "all";
+    default: return "unknown";
+  }
+}
+
+static inline bool is_between_columns(solver_move_t move)
+{
+  return solver_move_source(move) != SOLVER_PILE
+    && solver_move_destination(move) != SOLVER_FOUNDATION;
+}
+
+/* Where [card] is in column [deck], which holds it. */
+static uint32_t depth_of(
+    const packed_state_t & state, uint32_t deck, uint32_t card)
+{
+  uint32_t depth = state.num_cards[deck];
+
+  while (state.cards[deck][--depth] != card) {
+  }
+
+  return depth;
+}
+
+static bool is_king_shuffle(const packed_state_t & state, solver_move_t move)
+{
+  const uint32_t source = solver_move_source(move);
+  const uint32_t card = solver_move_card(move);
+
+  return is_between_columns(move)
+    && solver_card_number(card) == KING
+    && state.num_down[source] == 0
+    && state.cards[source][0] == card;
+}
+
+solver_move_t prune_reversible(const prune_context_t & context)
+{
+  const solver_move_t previous = context.previous;
+
+  return previous != 0
+    && !context.previous_revealed
+    && is_between_columns(previous) ? previous : 0;
+}
+
+/* Moving straight back restores the state before [context.previous],
+ * unless that turned a card over.
+ */
+static bool is_reversal(
+    const prune_context_t & context, solver_move_t move)
+{
+  const solver_move_t previous = prune_reversible(context);
+
+  return previous != 0
+    && is_between_columns(move)
+    && solver_move_card(move) == solver_move_card(previous)
+    && solver_move_source(move) == solver_move_destination(previous)
+    && solver_move_destination(move) == solver_move_source(previous);
+}
+
+/* Some card, other than the one on it, can be played on [exposed]. */
+static bool has_taker(
+    const packed_state_t & state, uint32_t source, uint32_t exposed)
+{
+  for (uint64_t pile = state.pile ; pile != 0 ; pile &= pile - 1) {
+    if (solver_stacks_on(__builtin_ctzll(pile), exposed)) {
+      return true;
+    }
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (deck == source) {
+      continue;
+    }
+
+    for (uint32_t i = state.num_down[deck] ; i < state.num_cards[deck] ; i++) {
+      const uint32_t card = state.cards[deck][i];
+
+      if (card != SOLVER_UNKNOWN_CARD && solver_stacks_on(card, exposed)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static bool is_idle_split(const packed_state_t & state, solver_move_t move)
+{
+  if (!is_between_columns(move)) {
+    return false;
+  }
+
+  const uint32_t source = solver_move_source(move);
+  const uint32_t depth = depth_of(state, source, solver_move_card(move));
+
+  if (depth <= state.num_down[source]) {
+    return false;
+  }
+
+  const uint32_t exposed = state.cards[source][depth - 1];
+
+  return !packed_goes_home(state, exposed)
+    && !has_taker(state, source, exposed);
+}
+
+bool prune_move(
+    const packed_state_t & state,
+    const prune_context_t & context,
+    solver_move_t move,
+    uint32_t rules)
+{
+  return ((rules & PRUNE_KING_SHUFFLE) && is_king_shuffle(state, move))
+    || ((rules & PRUNE_REVERSAL) && is_reversal(context, move))
+    || ((rules & PRUNE_SPLIT_RUN) && is_idle_split(state, move));
+}
+
+uint32_t prune_moves(
+    const packed_state_t & state,
+    const prune_context_t & context,
+    solver_move_t *moves,
+    uint32_t num_moves,
+    uint32_t rules)
+{
+  uint32_t n = 0;
+
+  if (rules == PRUNE_NONE) {
+    return num_moves;
+  }
+
+  for (uint32_t i = 0 ; i < num_moves ; i++) {
+    if (!prune_move(state, context, moves[i], rules)) {
+      moves[n++] = moves[i];
+    }
+  }
+
+  return n;
+}
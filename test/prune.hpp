@@ -0,0 +1,63 @@
+#ifndef PRUNE_HPP
+#define PRUNE_HPP
+
+#include <stdint.h>
+
+#include "solver.hpp"
+
+/* Rules for leaving moves out of a search, on top of the legal moves of
+ * solver_generate_moves. A rule is sound if it never leaves out every
+ * line to a win; `bench --verify-pruning` checks each of them against an
+ * unpruned search on small random positions, and reports how many nodes
+ * each saves.
+ */
+
+enum prune_rule_t {
+  PRUNE_NONE = 0,
+
+  /* A king with a column to itself doesn't move to another (empty) one. */
+  PRUNE_KING_SHUFFLE = 1,
+
+  /* A run moved between columns isn't moved straight back, unless its
+   * move turned a card over.
+   */
+  PRUNE_REVERSAL = 2,
+
+  /* A run is split (moved from above the bottom face up card of its
+   * column) only to expose a card that can be played: home, or as the
+   * destination of some other card.
+   */
+  PRUNE_SPLIT_RUN = 4,
+
+  PRUNE_ALL = 7,
+};
+
+const char *prune_rule_name(prune_rule_t rule);
+
+/* The move that led to a state, for rules that look back. */
+struct prune_context_t {
+  solver_move_t previous;  /* 0 at the root. */
+  bool previous_revealed;
+};
+
+/* The move after which reversal pruning would leave one out, or 0: the
+ * part of [context] it looks at. Contexts with the same one prune alike.
+ */
+solver_move_t prune_reversible(const prune_context_t & context);
+
+/* Whether [rules] leave [move] out of [state]. */
+bool prune_move(
+    const packed_state_t & state,
+    const prune_context_t & context,
+    solver_move_t move,
+    uint32_t rules);
+
+/* Drops the moves [rules] leave out, in place. Returns how many are left. */
+uint32_t prune_moves(
+    const packed_state_t & state,
+    const prune_context_t & context,
+    solver_move_t *moves,
+    uint32_t num_moves,
+    uint32_t rules);
+
+#endif
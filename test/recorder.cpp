@@ -0,0 +1,360 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "recorder.hpp"
+#include "game.hpp"
+
+const char RECORDER_MAGIC[8] = { 'S', 'O', 'L', 'F', 'L', 'I', 'G', '1' };
+
+static const uint64_t RING_MASK = RECORDER_CAPACITY - 1;
+
+/* Entries written to the dump file at a time, from the stack. */
+static const uint32_t DUMP_CHUNK = 64;
+
+/* The watchdog looks at the ring at least this often. */
+static const uint32_t WATCHDOG_PERIOD_MS = 1000;
+
+static recorder_entry_t ring[RECORDER_CAPACITY];
+static uint64_t recorded;
+static uint32_t num_threads;
+
+/* 0 until the thread first records, its number + 1 from then on. */
+static thread_local uint32_t thread_number;
+
+static char dump_path[256];
+static int dumping;
+
+static const int SIGNALS[] = { SIGABRT, SIGINT, SIGTERM };
+static const uint32_t NUM_SIGNALS = sizeof(SIGNALS) / sizeof(SIGNALS[0]);
+static struct sigaction previous_actions[NUM_SIGNALS];
+
+static std::thread watchdog;
+static std::mutex watchdog_mutex;
+static std::condition_variable watchdog_wake;
+static bool watchdog_running;
+
+const char *recorder_event_name(recorder_event_t event)
+{
+  switch (event) {
+    case RECORD_NONE: return "none";
+    case RECORD_GAME: return "game";
+    case RECORD_CLICK: return "click";
+    case RECORD_DRAG: return "drag";
+    case RECORD_UNDO: return "undo";
+    case RECORD_SETTLE: return "settle";
+    case RECORD_RECOGNITION: return "recognition";
+    case RECORD_DECISION: return "decision";
+    case RECORD_STEP: return "step";
+    case RECORD_SCREEN: return "screen";
+    case RECORD_EXCEPTION: return "exception";
+    case RECORD_WATCHDOG: return "watchdog";
+    default: return "unknown";
+  }
+}
+
+static inline uint64_t now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t recorder_tag(const char *name)
+{
+  uint32_t tag = 0;
+
+  for (uint32_t i = 0 ; i < 4 && name[i] != '\0' ; i++) {
+    tag |= uint32_t(uint8_t(name[i])) << (8 * i);
+  }
+
+  return tag;
+}
+
+void recorder_record(
+    recorder_event_t event, uint32_t arg, float value, uint32_t duration_us)
+{
+  const uint64_t n = __atomic_fetch_add(&recorded, 1, __ATOMIC_RELAXED);
+  recorder_entry_t & entry = ring[n & RING_MASK];
+
+  if (thread_number == 0) {
+    thread_number = __atomic_add_fetch(&num_threads, 1, __ATOMIC_RELAXED);
+  }
+
+  /* A seqlock of one writer per slot: readers take the entry only if its
+   * sequence is the one they expect before and after copying it.
+   */
+  __atomic_store_n(&entry.sequence, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  entry.time_ns = now_ns();
+  entry.event = event;
+  entry.thread = thread_number - 1;
+  entry.arg = arg;
+  entry.value = value;
+  entry.duration_us = duration_us;
+
+  __atomic_store_n(&entry.sequence, n + 1, __ATOMIC_RELEASE);
+}
+
+/* Copies event [n] out of the ring, unless it is being written or was
+ * overwritten.
+ */
+static bool read_entry(uint64_t n, recorder_entry_t *out)
+{
+  const recorder_entry_t & entry = ring[n & RING_MASK];
+
+  if (__atomic_load_n(&entry.sequence, __ATOMIC_ACQUIRE) != n + 1) {
+    return false;
+  }
+
+  memcpy(out, &entry, sizeof(*out));
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  return __atomic_load_n(&entry.sequence, __ATOMIC_RELAXED) == n + 1
+    && out->sequence == n + 1;
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+  const char *bytes = (const char *) data;
+
+  while (size != 0) {
+    const ssize_t written = write(fd, bytes, size);
+
+    if (written < 0) {
+      return false;
+    }
+
+    bytes += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+bool recorder_dump(recorder_dump_reason_t reason, int signal)
+{
+  if (dump_path[0] == '\0'
+      || __atomic_exchange_n(&dumping, 1, __ATOMIC_ACQUIRE) != 0) {
+    return false;
+  }
+
+  const int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0;
+
+  if (ok) {
+    const uint64_t end = __atomic_load_n(&recorded, __ATOMIC_ACQUIRE);
+    recorder_header_t header;
+    recorder_entry_t chunk[DUMP_CHUNK];
+    uint32_t filled = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDER_MAGIC, sizeof(header.magic));
+    header.entry_size = sizeof(recorder_entry_t);
+    header.capacity = RECORDER_CAPACITY;
+    header.recorded = end;
+    header.time_ns = now_ns();
+    header.reason = reason;
+    header.signal = signal;
+    ok = write_all(fd, &header, sizeof(header));
+
+    for (uint64_t n = end > RECORDER_CAPACITY ? end - RECORDER_CAPACITY : 0 ;
+        n < end && ok ; n++) {
+      filled += read_entry(n, &chunk[filled]);
+
+      if (filled == DUMP_CHUNK) {
+        ok = write_all(fd, chunk, sizeof(chunk));
+        filled = 0;
+      }
+    }
+
+    if (ok && filled != 0) {
+      ok = write_all(fd, chunk, filled * sizeof(chunk[0]));
+    }
+
+    close(fd);
+  }
+
+  __atomic_store_n(&dumping, 0, __ATOMIC_RELEASE);
+  return ok;
+}
+
+/* Dumps, then hands [signal] to whoever had it before. */
+static void on_signal(int signal, siginfo_t *info, void *context)
+{
+  recorder_dump(RECORDER_DUMP_SIGNAL, signal);
+
+  for (uint32_t i = 0 ; i < NUM_SIGNALS ; i++) {
+    const struct sigaction & previous = previous_actions[i];
+
+    if (SIGNALS[i] != signal) {
+      continue;
+    }
+
+    if (previous.sa_flags & SA_SIGINFO) {
+      previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler == SIG_DFL) {
+      sigaction(signal, &previous, NULL);
+      raise(signal);
+    } else if (previous.sa_handler != SIG_IGN) {
+      previous.sa_handler(signal);
+    }
+  }
+}
+
+void recorder_init(const char *path)
+{
+  static bool installed = false;
+
+  strncpy(dump_path, path, sizeof(dump_path) - 1);
+
+  if (installed) {
+    return;
+  }
+
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_signal;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+
+  for (uint32_t i = 0 ; i < NUM_SIGNALS ; i++) {
+    sigaction(SIGNALS[i], &action, &previous_actions[i]);
+  }
+
+  installed = true;
+}
+
+static void watch(uint32_t timeout_ms)
+{
+  std::unique_lock<std::mutex> lock(watchdog_mutex);
+  const uint32_t period_ms = std::max(1u,
+      std::min(WATCHDOG_PERIOD_MS, timeout_ms / 4));
+  uint64_t last_time = now_ns();
+  uint64_t last_seen = 0;
+  uint64_t dumped_at = 0;
+
+  while (watchdog_running) {
+    watchdog_wake.wait_for(lock, std::chrono::milliseconds(period_ms));
+
+    const uint64_t end = __atomic_load_n(&recorded, __ATOMIC_ACQUIRE);
+    const uint64_t now = now_ns();
+
+    /* Counts from when the watchdog saw the last event, rather than its
+     * time, which is being written while its sequence isn't.
+     */
+    if (end != last_seen) {
+      last_seen = end;
+      last_time = now;
+      continue;
+    }
+
+    if (!watchdog_running
+        || now - last_time < uint64_t(timeout_ms) * 1000000
+        || end == dumped_at) {
+      continue;
+    }
+
+    recorder_record(RECORD_WATCHDOG, 0, 0, (now - last_time) / 1000);
+    dumped_at = last_seen = end + 1;
+    recorder_dump(RECORDER_DUMP_WATCHDOG);
+    std::cout << "Watchdog: no event for " << (now - last_time) / 1000000
+      << " ms, dumped the flight recorder to " << dump_path << std::endl;
+  }
+}
+
+void recorder_start_watchdog(uint32_t timeout_ms)
+{
+  recorder_stop_watchdog();
+  watchdog_running = true;
+  watchdog = std::thread(watch, timeout_ms);
+}
+
+void recorder_stop_watchdog()
+{
+  {
+    std::lock_guard<std::mutex> lock(watchdog_mutex);
+    watchdog_running = false;
+  }
+
+  watchdog_wake.notify_all();
+
+  if (watchdog.joinable()) {
+    watchdog.join();
+  }
+}
+
+static void print_arg(std::ostream & out, const recorder_entry_t & entry)
+{
+  switch (entry.event) {
+    case RECORD_CLICK:
+    case RECORD_DRAG:
+      out << "(" << (entry.arg >> 16) << ", " << (entry.arg & 0xffff) << ")";
+      break;
+
+    case RECORD_RECOGNITION:
+      if (entry.arg < NUM_CARDS) {
+        out << card_of_index(entry.arg).to_string();
+      }
+      out << " score " << entry.value;
+      break;
+
+    case RECORD_DECISION:
+    case RECORD_EXCEPTION:
+      for (uint32_t i = 0 ; i < 4 && (entry.arg >> (8 * i)) & 0xff ; i++) {
+        out << char((entry.arg >> (8 * i)) & 0xff);
+      }
+      break;
+
+    default:
+      out << entry.arg;
+      break;
+  }
+}
+
+bool recorder_print_dump(const std::string & path, std::ostream & out)
+{
+  static const char *const REASONS[] = {
+    "exception", "signal", "watchdog", "requested"
+  };
+  std::ifstream in(path.c_str(), std::ios::binary);
+  recorder_header_t header;
+  recorder_entry_t entry;
+
+  if (!in.read((char *) &header, sizeof(header))
+      || memcmp(header.magic, RECORDER_MAGIC, sizeof(header.magic)) != 0
+      || header.entry_size != sizeof(recorder_entry_t)) {
+    return false;
+  }
+
+  out << "Flight recorder dump (" << REASONS[std::min(header.reason, 3u)];
+
+  if (header.reason == RECORDER_DUMP_SIGNAL) {
+    out << " " << header.signal;
+  }
+
+  out << "), " << header.recorded << " events recorded\n";
+  out << "# ms_before_dump thread event arg duration_us\n";
+
+  while (in.read((char *) &entry, sizeof(entry))) {
+    out << -double(header.time_ns - entry.time_ns) / 1e6 << " "
+      << entry.thread << " "
+      << recorder_event_name(recorder_event_t(entry.event)) << " ";
+    print_arg(out, entry);
+    out << " " << entry.duration_us << "\n";
+  }
+
+  return true;
+}
@@ -0,0 +1,102 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+/* The flight recorder: the last RECORDER_CAPACITY events of the bot
+ * (gestures, recognitions, decisions, steps), always on, so that a failed
+ * or stalled game can be looked into after the fact without verbose logs.
+ *
+ * Events go into a fixed ring that any thread writes to without locks: a
+ * slot is claimed with one atomic increment, and stamped with its sequence
+ * number once written, so a dump taken meanwhile (from a signal handler,
+ * say) leaves out slots being written rather than reading them torn.
+ *
+ * The ring is dumped to a binary file (see recorder_header_t) on an
+ * exception out of the game loop, a fatal signal, or when the watchdog
+ * sees no event for too long. `bench --read-flight-recorder=<path>`
+ * prints a dump.
+ */
+
+const uint32_t RECORDER_CAPACITY = 4096;  /* A power of two. */
+
+/* What [arg], [value] and [duration_us] of an entry are, per event. */
+enum recorder_event_t {
+  RECORD_NONE = 0,
+  RECORD_GAME,         /* A game starts. */
+  RECORD_CLICK,        /* arg: x << 16 | y. */
+  RECORD_DRAG,         /* arg: x << 16 | y of the drop. */
+  RECORD_UNDO,         /* arg: undo clicks in the batch. */
+  RECORD_SETTLE,       /* duration: waiting for the game after a gesture. */
+  RECORD_RECOGNITION,  /* arg: card_index, value: worst template score. */
+  RECORD_DECISION,     /* arg: recorder_tag of the rule or engine. */
+  RECORD_STEP,         /* arg: whether it moved, duration: the step. */
+  RECORD_SCREEN,       /* arg: screen_state_t, when not the board. */
+  RECORD_EXCEPTION,    /* arg: recorder_tag of what(). */
+  RECORD_WATCHDOG,     /* duration: since the last event. */
+  NUM_RECORD_EVENTS
+};
+
+const char *recorder_event_name(recorder_event_t event);
+
+struct recorder_entry_t {
+  uint64_t sequence;  /* 1 + the event's number, once written. */
+  uint64_t time_ns;   /* CLOCK_MONOTONIC. */
+  uint16_t event;
+  uint16_t thread;    /* Numbered in the order threads first record. */
+  uint32_t arg;
+  float value;
+  uint32_t duration_us;
+};
+
+enum recorder_dump_reason_t {
+  RECORDER_DUMP_EXCEPTION = 0,
+  RECORDER_DUMP_SIGNAL,
+  RECORDER_DUMP_WATCHDOG,
+  RECORDER_DUMP_REQUESTED
+};
+
+/* The start of a dump, followed by the entries it holds, oldest first. */
+struct recorder_header_t {
+  char magic[8];  /* RECORDER_MAGIC */
+  uint32_t entry_size;
+  uint32_t capacity;
+  uint64_t recorded;  /* Events ever recorded, of which the last are kept. */
+  uint64_t time_ns;
+  uint32_t reason;
+  int32_t signal;  /* For RECORDER_DUMP_SIGNAL. */
+};
+
+extern const char RECORDER_MAGIC[8];
+
+/* Up to the first four characters of [name], as an [arg]. */
+uint32_t recorder_tag(const char *name);
+
+void recorder_record(
+    recorder_event_t event,
+    uint32_t arg = 0,
+    float value = 0,
+    uint32_t duration_us = 0);
+
+/* Where dumps go, and the signals (SIGABRT, SIGINT, SIGTERM) that dump
+ * before going on to whatever handled them before, eg. the JVM's. Not
+ * SIGSEGV: the JVM raises it on purpose.
+ */
+void recorder_init(const char *path);
+
+/* Writes the ring to the dump file. Async signal safe; returns false if
+ * the file can't be written or another dump is under way.
+ */
+bool recorder_dump(recorder_dump_reason_t reason, int signal = 0);
+
+/* Dumps when no event was recorded for [timeout_ms], once per stall. */
+void recorder_start_watchdog(uint32_t timeout_ms);
+void recorder_stop_watchdog();
+
+/* Prints the dump at [path]; returns false if it isn't one. */
+bool recorder_print_dump(const std::string & path, std::ostream & out);
+
+#endif
@@ -0,0 +1,288 @@
+#include <algorithm>
+
+#include "rollout.hpp"
+
+/* Moves picked per rule go into the tie break with this many bits of
+ * sub-priority (Rule 2's number of face down cards).
+ */
+static const uint32_t SUB_PRIORITY_BITS = 8;
+
+const char *rollout_rule_name(rollout_rule_t rule)
+{
+  switch (rule) {
+    case ROLLOUT_NONE: return "none";
+    case ROLLOUT_EAGER_PROMOTION: return "eager";
+    case ROLLOUT_RULE_3D: return "3d";
+    case ROLLOUT_RULE_3C: return "3c";
+    case ROLLOUT_RULE_3B: return "3b";
+    case ROLLOUT_RULE_3A: return "3a";
+    case ROLLOUT_RULE_2: return "2";
+    case ROLLOUT_RULE_1: return "1";
+    case ROLLOUT_RULE_0: return "0";
+    default: return "unknown";
+  }
+}
+
+/* [card] can end up under [onto] in a run, with cards in between: as
+ * check_transitive_join_compatability in strategy.cpp.
+ */
+static inline bool joins_under(uint32_t card, uint32_t onto)
+{
+  const uint32_t gap =
+    solver_card_number(onto) - solver_card_number(card);
+  const bool same_color =
+    solver_card_suite(card) % 2 == solver_card_suite(onto) % 2;
+
+  return solver_card_number(onto) > solver_card_number(card)
+    && (gap % 2 == 0) == same_color;
+}
+
+namespace {
+
+/* Reservoir sampling over the moves tied for the best priority. */
+class pick_t {
+private:
+  uint64_t *rng;
+  uint32_t ties;
+
+public:
+  solver_move_t move;
+  uint32_t priority;
+
+  explicit pick_t(uint64_t *rng) : rng(rng), ties(0), move(0), priority(0) {}
+
+  void consider(solver_move_t candidate, uint32_t candidate_priority) {
+    if (candidate_priority < priority) {
+      return;
+    }
+
+    ties = candidate_priority == priority ? ties + 1 : 1;
+    priority = candidate_priority;
+
+    if (splitmix64_next(rng) % ties == 0) {
+      move = candidate;
+    }
+  }
+};
+
+}
+
+static inline uint32_t priority_of(rollout_rule_t rule, uint32_t sub = 0)
+{
+  return (uint32_t(rule) << SUB_PRIORITY_BITS) | sub;
+}
+
+static inline uint64_t card_bit(uint32_t card)
+{
+  return uint64_t(1) << card;
+}
+
+/* The two cards that go on top of [onto] in the tableau. */
+static inline uint64_t takers_of(uint32_t onto)
+{
+  const uint32_t number = solver_card_number(onto);
+
+  if (number == ACE) {
+    return 0;
+  }
+
+  /* Suites alternate in color: the other color is one suite away. */
+  const uint32_t suite = solver_card_suite(onto);
+  const uint32_t other = (suite + 1) % 4;
+  const uint32_t another = (suite + 3) % 4;
+
+  return card_bit(other * 13 + number - 2)
+    | card_bit(another * 13 + number - 2);
+}
+
+/* Rules 0, 1, 3c and eager promotion, for [card] going home. */
+static inline rollout_rule_t home_rule(
+    const packed_state_t & state, uint32_t source, uint32_t card)
+{
+  if (solver_card_number(card) == ACE) {
+    return ROLLOUT_RULE_0;
+  }
+
+  if (solver_card_number(card) == DEUCE) {
+    return ROLLOUT_RULE_1;
+  }
+
+  if (source != SOLVER_PILE
+      && state.num_cards[source] == state.num_down[source] + 1) {
+    return ROLLOUT_RULE_3C;
+  }
+
+  return ROLLOUT_EAGER_PROMOTION;
+}
+
+solver_move_t rollout_policy_t::choose(
+    const packed_state_t & state,
+    const prune_context_t & context,
+    rollout_rule_t *rule)
+{
+  pick_t pick(&rng);
+  uint32_t tops[7];
+  uint32_t empty = 7;  /* The first empty column; kings only go there. */
+
+  /* Bottom face up cards of the columns, which carry the rest with them:
+   * the runs Rule 3a (on face down cards) and 3b (not) try to move.
+   */
+  uint32_t runs[7];
+  bool on_down[7];
+  uint32_t num_runs = 0;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    tops[deck] = SOLVER_UNKNOWN_CARD;
+
+    if (state.num_cards[deck] == 0) {
+      empty = std::min(empty, deck);
+      continue;
+    }
+
+    if (state.num_cards[deck] == state.num_down[deck]) {
+      continue;
+    }
+
+    tops[deck] = state.cards[deck][state.num_cards[deck] - 1];
+
+    const uint32_t bottom = state.cards[deck][state.num_down[deck]];
+
+    if (bottom != SOLVER_UNKNOWN_CARD
+        && (state.num_down[deck] != 0
+            || solver_card_number(bottom) != KING)) {
+      runs[num_runs] = bottom;
+      on_down[num_runs] = state.num_down[deck] != 0;
+      num_runs++;
+    }
+  }
+
+  /* Cards home. */
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (tops[deck] != SOLVER_UNKNOWN_CARD
+        && packed_goes_home(state, tops[deck])) {
+      pick.consider(
+          solver_pack_move(deck, SOLVER_FOUNDATION, tops[deck]),
+          priority_of(home_rule(state, deck, tops[deck])));
+    }
+  }
+
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    const uint32_t card = suite * 13 + state.foundation[suite];
+
+    if (state.foundation[suite] != KING && (state.pile & card_bit(card))) {
+      pick.consider(
+          solver_pack_move(SOLVER_PILE, SOLVER_FOUNDATION, card),
+          priority_of(home_rule(state, SOLVER_PILE, card)));
+    }
+  }
+
+  /* Whole runs between columns: Rule 2, or 3b. A king with the column to
+   * itself stays, and a run isn't moved straight back.
+   */
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (tops[deck] == SOLVER_UNKNOWN_CARD) {
+      continue;
+    }
+
+    const uint32_t bottom = state.cards[deck][state.num_down[deck]];
+    const uint32_t down = state.num_down[deck];
+
+    if (bottom == SOLVER_UNKNOWN_CARD
+        || (down == 0 && solver_card_number(bottom) == KING)) {
+      continue;
+    }
+
+    const rollout_rule_t run_rule =
+      down != 0 ? ROLLOUT_RULE_2 : ROLLOUT_RULE_3B;
+
+    for (uint32_t onto = 0 ; onto < 7 ; onto++) {
+      const bool fits = onto == deck
+        ? false
+        : tops[onto] != SOLVER_UNKNOWN_CARD
+          ? solver_stacks_on(bottom, tops[onto])
+          : onto == empty && solver_card_number(bottom) == KING;
+      const solver_move_t move = solver_pack_move(deck, onto, bottom);
+
+      if (fits && !prune_move(state, context, move, PRUNE_REVERSAL)) {
+        pick.consider(move, priority_of(run_rule, down));
+      }
+    }
+  }
+
+  /* Pile cards onto columns: Rule 3a or 3b if a run can then be brought
+   * under it, 3d otherwise.
+   */
+  for (uint32_t onto = 0 ; onto < 7 ; onto++) {
+    uint64_t cards = tops[onto] != SOLVER_UNKNOWN_CARD
+      ? takers_of(tops[onto]) & state.pile
+      : onto == empty
+        ? state.pile & (card_bit(12) | card_bit(25) | card_bit(38)
+            | card_bit(51))
+        : 0;
+
+    for ( ; cards != 0 ; cards &= cards - 1) {
+      const uint32_t card = __builtin_ctzll(cards);
+      rollout_rule_t join = ROLLOUT_RULE_3D;
+
+      for (uint32_t i = 0 ; i < num_runs ; i++) {
+        if (joins_under(runs[i], card)) {
+          join = on_down[i] ? ROLLOUT_RULE_3A : std::max(join, ROLLOUT_RULE_3B);
+        }
+      }
+
+      pick.consider(
+          solver_pack_move(SOLVER_PILE, onto, card), priority_of(join));
+    }
+  }
+
+  if (rule != NULL) {
+    *rule = rollout_rule_t(pick.priority >> SUB_PRIORITY_BITS);
+  }
+
+  return pick.move;
+}
+
+rollout_result_t rollout_policy_t::play(
+    packed_state_t *state, uint32_t max_moves)
+{
+  rollout_result_t result;
+  prune_context_t context;
+
+  result.num_moves = 0;
+  result.reveals = 0;
+  result.won = false;
+  result.stuck = false;
+  context.previous = 0;
+  context.previous_revealed = false;
+
+  while (result.num_moves < max_moves) {
+    const solver_move_t move = choose(*state, context);
+
+    if (move == 0) {
+      result.stuck = true;
+      break;
+    }
+
+    const uint32_t source = solver_move_source(move);
+
+    context.previous = move;
+    context.previous_revealed = solver_apply_move(state, move);
+    result.num_moves++;
+
+    if (context.previous_revealed) {
+      result.reveals++;
+
+      if (state->cards[source][state->num_down[source]]
+          == SOLVER_UNKNOWN_CARD) {
+        break;
+      }
+    }
+
+    if (packed_is_won(*state)) {
+      result.won = true;
+      break;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,65 @@
+#ifndef ROLLOUT_HPP
+#define ROLLOUT_HPP
+
+#include <stdint.h>
+
+#include "solver.hpp"
+#include "prune.hpp"
+
+/* The priorities of strategy_step (Rules 0 to 3 and eager promotion) as a
+ * playout policy over the solver's packed states, for engines that play
+ * many games out from a position (eg. sampling or tree search).
+ *
+ * Unlike strategy_step there is no I/O and no allocation, and every call
+ * picks a single move, so a rule that plays a path of moves (Rules 3a to
+ * 3c) takes the first move of it. The stock and waste pile is a set, as
+ * in the solver, so Rule 3's "peeking" is picking a pile card. Moves
+ * tied on priority are picked at random, from [seed] only: the same seed
+ * plays the same game out.
+ */
+
+/* Priorities, highest first. */
+enum rollout_rule_t {
+  ROLLOUT_NONE = 0,
+  ROLLOUT_EAGER_PROMOTION,  /* Any card home. */
+  ROLLOUT_RULE_3D,          /* A pile card onto a column. */
+  ROLLOUT_RULE_3C,          /* The card of a one card column home. */
+  ROLLOUT_RULE_3B,          /* Towards moving an all face up column. */
+  ROLLOUT_RULE_3A,          /* Towards moving a run off face down cards. */
+  ROLLOUT_RULE_2,           /* A run off face down cards, most first. */
+  ROLLOUT_RULE_1,           /* A deuce home. */
+  ROLLOUT_RULE_0,           /* An ace home. */
+  NUM_ROLLOUT_RULES
+};
+
+const char *rollout_rule_name(rollout_rule_t rule);
+
+struct rollout_result_t {
+  uint32_t num_moves;
+  uint32_t reveals;
+  bool won;
+  bool stuck;  /* No rule had a move; otherwise out of moves, or unknown. */
+};
+
+class rollout_policy_t {
+private:
+  uint64_t rng;
+
+public:
+  explicit rollout_policy_t(uint64_t seed) : rng(seed) {}
+
+  /* The rules' move in [state], 0 if they have none. Moves [context]
+   * would reverse are left out, so playouts don't go round in circles.
+   */
+  solver_move_t choose(
+      const packed_state_t & state,
+      const prune_context_t & context,
+      rollout_rule_t *rule = NULL);
+
+  /* Plays [state] out for up to [max_moves], or until the rules are stuck,
+   * the game is won, or an unknown card is turned over.
+   */
+  rollout_result_t play(packed_state_t *state, uint32_t max_moves);
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "screen.hpp"
+#include "vision.hpp"
+#include "metrics.hpp"
+#include "calibrate.hpp"
+#include "recorder.hpp"
+
+namespace {
+
+struct dialog_t {
+  const char *name;
+  screen_state_t state;
+};
+
+}
+
+/* Dialogs known by the template of the button that takes them away. */
+static const dialog_t DIALOGS[] = {
+  { "won", SCREEN_WON },
+  { "new_game", SCREEN_NEW_GAME },
+  { "interruption", SCREEN_INTERRUPTION },
+};
+static const uint32_t NUM_DIALOGS = sizeof(DIALOGS) / sizeof(DIALOGS[0]);
+
+/* Mean difference from the learnt probe row, in gray levels, past which
+ * the board is covered.
+ */
+static const uint32_t PROBE_THRESHOLD = 24;
+
+/* Scores are SQDIFF_NORMED, lower is better, as the anchor's. */
+static const double DIALOG_MATCH_THRESHOLD = 0.05;
+
+/* Interruptions dealt with in a row by screen_check, at most. */
+static const uint32_t MAX_HANDLED = 3;
+
+static robot_h robot;
+static std::vector<uint8_t> board_probe;
+static cv::Mat dialog_templates[NUM_DIALOGS];
+static uint32_t num_unknown_captures;
+
+static const char *const STATE_NAMES[NUM_SCREEN_STATES] = {
+  "board", "won", "new_game", "interruption", "lost_window", "unknown"
+};
+
+const char *screen_state_name(screen_state_t state)
+{
+  return state < NUM_SCREEN_STATES ? STATE_NAMES[state] : "unknown";
+}
+
+static const char *TEMPLATE_DIRECTORY = "res/dialogs";
+
+static std::string template_filename(const std::string & name)
+{
+  return std::string(TEMPLATE_DIRECTORY) + "/" + name + ".bmp";
+}
+
+void screen_init(robot_h arg_robot)
+{
+  robot = arg_robot;
+  board_probe.resize(BOARD_PROBE.width);
+  robot_screenshot_format(
+      robot, BOARD_PROBE, ROBOT_PIXEL_GRAY8, 0, board_probe.data());
+
+  for (uint32_t i = 0 ; i < NUM_DIALOGS ; i++) {
+    dialog_templates[i] = cv::imread(
+        template_filename(DIALOGS[i].name), CV_LOAD_IMAGE_GRAYSCALE);
+
+    if (dialog_templates[i].empty()) {
+      std::cout << "No template for the " << DIALOGS[i].name
+        << " dialog" << std::endl;
+    }
+  }
+}
+
+static bool is_board_showing()
+{
+  std::vector<uint8_t> row(board_probe.size());
+  uint64_t difference = 0;
+
+  robot_screenshot_format(
+      robot, BOARD_PROBE, ROBOT_PIXEL_GRAY8, 0, row.data());
+
+  for (uint32_t i = 0 ; i < row.size() ; i++) {
+    difference += std::abs(int(row[i]) - int(board_probe[i]));
+  }
+
+  return difference <= uint64_t(PROBE_THRESHOLD) * row.size();
+}
+
+screen_match_t screen_classify()
+{
+  static metric_histogram_t & classify_time = metrics_histogram(
+      "screen_classify_seconds",
+      "Time to tell what the game window shows");
+  const uint64_t start = metrics_now_us();
+  screen_match_t match;
+
+  match.state = SCREEN_BOARD;
+  match.dialog = NULL;
+  match.button = std::make_pair(0u, 0u);
+
+  if (!vision_track_window()) {
+    match.state = SCREEN_LOST_WINDOW;
+    return match;
+  }
+
+  if (is_board_showing()) {
+    classify_time.record(metrics_now_us() - start);
+    return match;
+  }
+
+  cv::Mat board = cv::Mat(GAME_BOARD.height, GAME_BOARD.width, CV_8UC1);
+  double best = DIALOG_MATCH_THRESHOLD;
+
+  robot_screenshot_format(
+      robot, GAME_BOARD, ROBOT_PIXEL_GRAY8, 0, board.data);
+  match.state = SCREEN_UNKNOWN;
+
+  for (uint32_t i = 0 ; i < NUM_DIALOGS ; i++) {
+    const cv::Mat & button = dialog_templates[i];
+    cv::Mat matched;
+    cv::Point location;
+    double score;
+
+    if (button.empty()
+        || button.rows > board.rows
+        || button.cols > board.cols) {
+      continue;
+    }
+
+    cv::matchTemplate(board, button, matched, CV_TM_SQDIFF_NORMED);
+    cv::minMaxLoc(matched, &score, NULL, &location, NULL);
+
+    if (score <= best) {
+      best = score;
+      match.state = DIALOGS[i].state;
+      match.dialog = DIALOGS[i].name;
+      match.button = std::make_pair(
+          GAME_BOARD.x + location.x + button.cols / 2,
+          GAME_BOARD.y + location.y + button.rows / 2);
+    }
+  }
+
+  classify_time.record(metrics_now_us() - start);
+  return match;
+}
+
+/* Takes a known dialog away with its button. */
+static void dismiss(const screen_match_t & match)
+{
+  robot_mouse_move(robot, match.button.first, match.button.second);
+  robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
+  robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+}
+
+static void route(const screen_match_t & match)
+{
+  switch (match.state) {
+    case SCREEN_WON:
+    case SCREEN_NEW_GAME:
+    case SCREEN_INTERRUPTION:
+      dismiss(match);
+      break;
+
+    default:
+      /* The board needs nothing, a lost window can't be clicked, and an
+       * unknown screen might be the board after all.
+       */
+      break;
+  }
+}
+
+static void count_screen(screen_state_t state)
+{
+  static const metric_counter_table_t<NUM_SCREEN_STATES> checks(
+      "screen_checks_total",
+      "Frames of the live loop, by what the game window showed",
+      "state",
+      STATE_NAMES);
+
+  checks[state].inc();
+}
+
+/* Keeps the game board as it was, for telling whether the probe row was
+ * covered by a dialog or by cards.
+ */
+static void save_unknown()
+{
+  if (num_unknown_captures == SCREEN_UNKNOWN_CAPTURES) {
+    return;
+  }
+
+  cv::Mat board = cv::Mat(GAME_BOARD.height, GAME_BOARD.width, CV_8UC1);
+  std::ostringstream filename;
+
+  filename << "screen_unknown_" << num_unknown_captures++ << ".bmp";
+  robot_screenshot_format(
+      robot, GAME_BOARD, ROBOT_PIXEL_GRAY8, 0, board.data);
+  cv::imwrite(filename.str(), board);
+  std::cout << "Probe row differs from the board with no dialog known, "
+    << "saved to " << filename.str() << std::endl;
+}
+
+screen_state_t screen_check()
+{
+  for (uint32_t handled = 0 ; ; handled++) {
+    const screen_match_t match = screen_classify();
+
+    count_screen(match.state);
+
+    if (match.state == SCREEN_UNKNOWN) {
+      recorder_record(RECORD_SCREEN, match.state);
+      save_unknown();
+    }
+
+    if (match.state == SCREEN_BOARD
+        || match.state == SCREEN_LOST_WINDOW
+        || match.state == SCREEN_UNKNOWN
+        || handled == MAX_HANDLED) {
+      return match.state;
+    }
+
+    recorder_record(RECORD_SCREEN, match.state);
+    std::cout << "Screen shows " << screen_state_name(match.state)
+      << " (" << match.dialog << ")" << std::endl;
+    route(match);
+    usleep(gesture_safe_timing().settle_us);
+
+    /* Only interruptions leave a game to carry on with. */
+    if (match.state != SCREEN_INTERRUPTION) {
+      return match.state;
+    }
+  }
+}
+
+bool screen_is_playable(screen_state_t state)
+{
+  return state == SCREEN_BOARD || state == SCREEN_UNKNOWN;
+}
+
+void screen_save_template(
+    const std::string & name, const rectangle_t & rect)
+{
+  cv::Mat image = cv::Mat(rect.height, rect.width, CV_8UC1);
+
+  robot_screenshot_format(robot, rect, ROBOT_PIXEL_GRAY8, 0, image.data);
+  mkdir(TEMPLATE_DIRECTORY, 0755);  /* Fails harmlessly if it exists. */
+  cv::imwrite(template_filename(name), image);
+}
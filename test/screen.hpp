@@ -0,0 +1,70 @@
+#ifndef SCREEN_HPP
+#define SCREEN_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+
+#include <robot.h>
+
+/* What the game window shows, checked once per frame of the live loop so
+ * that dialogs are dealt with rather than clicked through.
+ *
+ * The check is one capture of BOARD_PROBE (see vision.hpp), against the
+ * row as it was when the board was showing at start up. Only when that
+ * differs are the dialogs told apart, by template matching their buttons
+ * (res/dialogs/<name>.bmp, see screen_save_template) over the board.
+ *
+ * A known dialog is routed to its handler, which clicks its button. A
+ * difference that no template explains is left alone, since it may as
+ * well be cards over the probe row: the first few are saved (see
+ * SCREEN_UNKNOWN_CAPTURES) to make templates from, or to move the row.
+ */
+
+enum screen_state_t {
+  SCREEN_BOARD = 0,     /* The game, nothing in the way. */
+  SCREEN_WON,           /* The win screen. */
+  SCREEN_NEW_GAME,      /* A prompt for a new game, eg. after a loss. */
+  SCREEN_INTERRUPTION,  /* Any other known dialog over the board. */
+  SCREEN_LOST_WINDOW,   /* The game window is nowhere to be seen. */
+  SCREEN_UNKNOWN,       /* The probe row differs, no template matched. */
+  NUM_SCREEN_STATES
+};
+
+/* Unknown screens saved per run, as screen_unknown_<n>.bmp. */
+const uint32_t SCREEN_UNKNOWN_CAPTURES = 5;
+
+const char *screen_state_name(screen_state_t state);
+
+struct screen_match_t {
+  screen_state_t state;
+  const char *dialog;  /* Its template's name, NULL if none matched. */
+  std::pair<uint32_t, uint32_t> button;  /* Centre, if [dialog]. */
+};
+
+/* Learns the probe row, so call this with the board showing, after
+ * vision_init. Templates that are missing are skipped, and their dialogs
+ * seen as unknown.
+ */
+void screen_init(robot_h robot);
+
+/* What the screen shows, without acting on it. */
+screen_match_t screen_classify();
+
+/* Classifies the screen and has the handler deal with known dialogs, up
+ * to a few times while interruptions keep coming. Returns what was found
+ * first.
+ */
+screen_state_t screen_check();
+
+/* The game carries on past [state]: the board, or an unknown screen. */
+bool screen_is_playable(screen_state_t state);
+
+/* For data collection: captures [rect] (a dialog's button, in the game
+ * window's coordinates) as the template of dialog [name].
+ */
+void screen_save_template(
+    const std::string & name, const rectangle_t & rect);
+
+#endif
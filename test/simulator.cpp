@@ -0,0 +1,126 @@
+#include <utility>
+#include <vector>
+
+#include "simulator.hpp"
+
+/* Per thread, like sandbox mode. */
+static thread_local card_t deal_tableau[7][7];  /* [deck][depth] */
+static thread_local std::vector<card_t> pile;   /* In draw order. */
+static thread_local uint32_t drawn;  /* Cards of [pile] in the waste. */
+
+/* Cards played off the waste pile, with where they were in [pile], last
+ * played last.
+ */
+static thread_local std::vector<std::pair<uint32_t, card_t>> played;
+
+void simulator_deal(uint64_t seed)
+{
+  card_t deck[NUM_CARDS];
+  uint64_t state = seed;
+
+  for (uint32_t i = 0 ; i < NUM_CARDS ; i++) {
+    deck[i] = card_of_index(i);
+  }
+
+  for (uint32_t i = NUM_CARDS - 1 ; i > 0 ; i--) {
+    uint32_t j = splitmix64_next(&state) % (i + 1);
+    std::swap(deck[i], deck[j]);
+  }
+
+  uint32_t pos = 0;
+
+  for (uint32_t i = 0 ; i < 7 ; i++) {
+    for (uint32_t j = 0 ; j <= i ; j++) {
+      deal_tableau[i][j] = deck[pos++];
+    }
+  }
+
+  pile.assign(deck + pos, deck + NUM_CARDS);
+  drawn = 0;
+  played.clear();
+}
+
+void simulator_load(
+    const game_state_t & state,
+    const stock_model_t & stock,
+    const belief_sample_t & hidden)
+{
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    const tableau_deck_t & column = state.tableau[deck];
+
+    for (uint32_t depth = 0 ; depth < column.num_down_cards ; depth++) {
+      deal_tableau[deck][depth] = card_of_index(hidden.cards[deck][depth]);
+    }
+
+    if (!column.cards.empty()) {
+      deal_tableau[deck][column.num_down_cards] = column.cards[0];
+    }
+  }
+
+  pile.assign(stock.begin(), stock.end());
+  drawn = state.remaining_pile_size - state.stock_pile_size;
+  played.clear();
+}
+
+card_t simulator_tableau_card(const tableau_position_t & position)
+{
+  /* Only the bottom-most face up card of a deck is ever recognized: on
+   * the initial deal and when a face down card gets flipped.
+   */
+  if (position.deck >= 7
+      || position.position != 0
+      || position.num_hidden > position.deck) {
+    throw SimulatorException();
+  }
+
+  return deal_tableau[position.deck][position.num_hidden];
+}
+
+card_t simulator_visible_pile_card()
+{
+  if (drawn == 0) {
+    throw SimulatorException();
+  }
+
+  return pile[drawn - 1];
+}
+
+void simulator_draw_from_stock_pile()
+{
+  if (drawn == pile.size()) {
+    throw SimulatorException();
+  }
+
+  drawn++;
+}
+
+void simulator_reset_stock_pile()
+{
+  drawn = 0;
+}
+
+void simulator_remove_visible_pile_card()
+{
+  if (drawn == 0) {
+    throw SimulatorException();
+  }
+
+  played.push_back(std::make_pair(drawn - 1, pile[drawn - 1]));
+  pile.erase(pile.begin() + (drawn - 1));
+  drawn--;
+}
+
+void simulator_undo_to(const game_state_t & state)
+{
+  while (pile.size() < state.remaining_pile_size && !played.empty()) {
+    pile.insert(pile.begin() + played.back().first, played.back().second);
+    played.pop_back();
+  }
+
+  if (pile.size() != state.remaining_pile_size
+      || state.stock_pile_size > state.remaining_pile_size) {
+    throw SimulatorException();
+  }
+
+  drawn = state.remaining_pile_size - state.stock_pile_size;
+}
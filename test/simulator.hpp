@@ -0,0 +1,56 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <stdint.h>
+
+#include <exception>
+
+#include "game.hpp"
+#include "belief.hpp"
+#include "stock.hpp"
+
+/* A dealt game of solitaire, standing in for the screen when interact is
+ * in sandbox mode (see [set_sandbox_mode]). Gestures are skipped and cards
+ * are "recognized" from the deal, so the strategy can be run without a
+ * browser, eg. for benchmarks.
+ *
+ * The simulator only knows what the game knows and the strategy doesn't:
+ * the face down cards and the order of the stock pile. Everything else is
+ * tracked by [game_state_t] as usual.
+ *
+ * The deal is per thread, as is sandbox mode.
+ */
+
+/* Thrown when asked for a card that isn't there, which means the state
+ * tracked by interact went out of sync with the deal.
+ */
+class SimulatorException : public std::exception {
+};
+
+/* Deals are a function of [seed] only, and are the same on every host. */
+void simulator_deal(uint64_t seed);
+
+/* Deals a game in the middle: [state] as it is, the stock and waste pile
+ * as [stock] knows it, and the face down cards from [hidden].
+ */
+void simulator_load(
+    const game_state_t & state,
+    const stock_model_t & stock,
+    const belief_sample_t & hidden);
+
+/* Counterparts of the recognize_* functions in vision.hpp. */
+card_t simulator_tableau_card(const tableau_position_t & position);
+card_t simulator_visible_pile_card();
+
+/* Stock pile bookkeeping, mirroring what the game does on screen. */
+void simulator_draw_from_stock_pile();
+void simulator_reset_stock_pile();
+void simulator_remove_visible_pile_card();
+
+/* The game's undo, back to [state], an earlier state of this game: cards
+ * played off the waste pile since go back where they were, and draws are
+ * taken back. Face down cards never move, so the tableau needs nothing.
+ */
+void simulator_undo_to(const game_state_t & state);
+
+#endif
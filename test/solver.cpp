@@ -0,0 +1,686 @@
+#include <string.h>
+
+#include <limits>
+
+#include "solver.hpp"
+#include "prune.hpp"
+#include "zobrist.hpp"
+#include "metrics.hpp"
+
+/* Returned by a search that reached the goal. */
+static const int32_t FOUND = std::numeric_limits<int32_t>::max();
+
+/* Nodes between looks at the cancel flag and the clock. */
+static const uint64_t CANCEL_CHECK_PERIOD = 1024;
+
+/* Visited states are keyed by hash and remaining depth: the same state
+ * with as many moves left has the same subtree.
+ */
+static const uint64_t REMAINING_KEY = 0x9e3779b97f4a7c15ULL;
+static const uint64_t PREVIOUS_KEY = 0xc2b2ae3d27d4eb4fULL;
+
+static const double VISITED_FALSE_POSITIVE_RATE = 1e-4;
+
+/* Static move priorities, highest first. */
+static const uint32_t PRIORITY_LOW_FOUNDATION = 4;  /* Rules 0 and 1. */
+static const uint32_t PRIORITY_REVEAL = 3;          /* Rule 2. */
+static const uint32_t PRIORITY_FOUNDATION = 2;
+static const uint32_t PRIORITY_FROM_PILE = 1;
+static const uint32_t PRIORITY_OTHER = 0;
+
+static inline uint64_t card_bit(uint32_t index)
+{
+  return uint64_t(1) << index;
+}
+
+static inline bool top_is_face_up(const packed_state_t & state, uint32_t deck)
+{
+  return state.num_cards[deck] > state.num_down[deck];
+}
+
+std::string solver_move_to_string(solver_move_t move)
+{
+  const uint32_t source = solver_move_source(move);
+  const uint32_t destination = solver_move_destination(move);
+  std::string out = card_of_index(solver_move_card(move)).to_string();
+
+  out += source == SOLVER_PILE
+    ? " pile"
+    : " tableau " + std::to_string(source);
+  out += destination == SOLVER_FOUNDATION
+    ? " -> foundation"
+    : " -> tableau " + std::to_string(destination);
+
+  return out;
+}
+
+packed_state_t packed_state_of(
+    const game_state_t & state,
+    uint64_t pile,
+    const belief_sample_t *sample)
+{
+  packed_state_t packed;
+
+  memset(&packed, 0, sizeof(packed));
+  packed.pile = pile;
+
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    const Option<card_t> & top = state.foundation[suite];
+
+    packed.foundation[suite] = top.is_some() ? top.get().number : 0;
+    packed.hash ^= zobrist_foundation_key(suite, packed.foundation[suite]);
+  }
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    const tableau_deck_t & column = state.tableau[deck];
+    const uint32_t down = column.num_down_cards;
+
+    if (down > BELIEF_MAX_HIDDEN
+        || down + column.cards.size() > SOLVER_MAX_COLUMN) {
+      throw SolverException();
+    }
+
+    for (uint32_t depth = 0 ; depth < down ; depth++) {
+      packed.cards[deck][depth] =
+        sample ? sample->cards[deck][depth] : SOLVER_UNKNOWN_CARD;
+    }
+
+    for (uint32_t i = 0 ; i < column.cards.size() ; i++) {
+      const uint32_t card = card_index(column.cards[i]);
+
+      packed.cards[deck][down + i] = card;
+      packed.hash ^= zobrist_tableau_key(deck, down + i, card);
+    }
+
+    packed.num_down[deck] = down;
+    packed.num_cards[deck] = down + column.cards.size();
+    packed.hash ^= zobrist_hidden_key(deck, down);
+  }
+
+  for (uint32_t card = 0 ; card < NUM_CARDS ; card++) {
+    if (pile & card_bit(card)) {
+      packed.hash ^= zobrist_pile_card_key(card);
+    }
+  }
+
+  return packed;
+}
+
+uint32_t packed_num_down(const packed_state_t & state)
+{
+  uint32_t down = 0;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    down += state.num_down[deck];
+  }
+
+  return down;
+}
+
+bool packed_is_won(const packed_state_t & state)
+{
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    if (state.foundation[suite] != KING) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Moves of [card] from [source] onto a column. Kings go to the first
+ * empty column only, the others being the same.
+ */
+static uint32_t generate_to_tableau(
+    const packed_state_t & state,
+    uint32_t source,
+    uint32_t card,
+    solver_move_t *moves)
+{
+  uint32_t n = 0;
+  bool to_empty = solver_card_number(card) == KING;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (deck == source) {
+      continue;
+    }
+
+    if (state.num_cards[deck] == 0) {
+      if (to_empty) {
+        moves[n++] = solver_pack_move(source, deck, card);
+        to_empty = false;
+      }
+    } else if (top_is_face_up(state, deck)) {
+      const uint32_t top = state.cards[deck][state.num_cards[deck] - 1];
+
+      if (top != SOLVER_UNKNOWN_CARD && solver_stacks_on(card, top)) {
+        moves[n++] = solver_pack_move(source, deck, card);
+      }
+    }
+  }
+
+  return n;
+}
+
+uint32_t solver_generate_moves(
+    const packed_state_t & state, solver_move_t *moves)
+{
+  uint32_t n = 0;
+
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (!top_is_face_up(state, deck)) {
+      continue;
+    }
+
+    const uint32_t top = state.cards[deck][state.num_cards[deck] - 1];
+
+    if (top != SOLVER_UNKNOWN_CARD && packed_goes_home(state, top)) {
+      moves[n++] = solver_pack_move(deck, SOLVER_FOUNDATION, top);
+    }
+
+    for (uint32_t i = state.num_down[deck] ; i < state.num_cards[deck] ; i++) {
+      const uint32_t card = state.cards[deck][i];
+
+      if (card == SOLVER_UNKNOWN_CARD) {
+        continue;
+      }
+
+      n += generate_to_tableau(state, deck, card, moves + n);
+    }
+  }
+
+  for (uint64_t pile = state.pile ; pile != 0 ; pile &= pile - 1) {
+    const uint32_t card = __builtin_ctzll(pile);
+
+    if (packed_goes_home(state, card)) {
+      moves[n++] = solver_pack_move(SOLVER_PILE, SOLVER_FOUNDATION, card);
+    }
+
+    n += generate_to_tableau(state, SOLVER_PILE, card, moves + n);
+  }
+
+  return n;
+}
+
+static inline void push_card(
+    packed_state_t *state, uint32_t deck, uint32_t card)
+{
+  const uint32_t depth = state->num_cards[deck]++;
+
+  state->cards[deck][depth] = card;
+  state->hash ^= zobrist_tableau_key(deck, depth, card);
+}
+
+bool solver_apply_move(packed_state_t *state, solver_move_t move)
+{
+  const uint32_t source = solver_move_source(move);
+  const uint32_t destination = solver_move_destination(move);
+  const uint32_t card = solver_move_card(move);
+  uint8_t run[SOLVER_MAX_COLUMN];
+  uint32_t run_size = 0;
+
+  if (source == SOLVER_PILE) {
+    state->pile &= ~card_bit(card);
+    state->hash ^= zobrist_pile_card_key(card);
+    run[run_size++] = card;
+  } else {
+    uint32_t bottom = state->num_cards[source];
+
+    while (state->cards[source][--bottom] != card) {
+    }
+
+    for (uint32_t i = bottom ; i < state->num_cards[source] ; i++) {
+      run[run_size++] = state->cards[source][i];
+      state->hash ^= zobrist_tableau_key(source, i, state->cards[source][i]);
+    }
+
+    state->num_cards[source] = bottom;
+  }
+
+  if (destination == SOLVER_FOUNDATION) {
+    const uint32_t suite = solver_card_suite(card);
+
+    state->hash ^= zobrist_foundation_key(suite, state->foundation[suite]);
+    state->foundation[suite] = solver_card_number(card);
+    state->hash ^= zobrist_foundation_key(suite, state->foundation[suite]);
+  } else {
+    for (uint32_t i = 0 ; i < run_size ; i++) {
+      push_card(state, destination, run[i]);
+    }
+  }
+
+  if (source == SOLVER_PILE
+      || state->num_down[source] == 0
+      || state->num_cards[source] != state->num_down[source]) {
+    return false;
+  }
+
+  const uint32_t down = --state->num_down[source];
+  const uint32_t revealed = state->cards[source][down];
+
+  state->hash ^= zobrist_hidden_key(source, down + 1);
+  state->hash ^= zobrist_hidden_key(source, down);
+
+  if (revealed != SOLVER_UNKNOWN_CARD) {
+    state->hash ^= zobrist_tableau_key(source, down, revealed);
+  }
+
+  return true;
+}
+
+static uint32_t cards_home(const packed_state_t & state)
+{
+  uint32_t home = 0;
+
+  for (uint32_t suite = 0 ; suite < 4 ; suite++) {
+    home += state.foundation[suite];
+  }
+
+  return home;
+}
+
+/* How far along a state is, for crediting moves in searches that don't
+ * reach the goal: turned over cards count more than cards home.
+ */
+static int32_t progress(const packed_state_t & state)
+{
+  return int32_t(cards_home(state)) - 4 * int32_t(packed_num_down(state));
+}
+
+static uint32_t static_priority(
+    const packed_state_t & state, solver_move_t move)
+{
+  const uint32_t source = solver_move_source(move);
+  const uint32_t destination = solver_move_destination(move);
+  const uint32_t card = solver_move_card(move);
+
+  if (destination == SOLVER_FOUNDATION) {
+    return solver_card_number(card) <= DEUCE
+      ? PRIORITY_LOW_FOUNDATION
+      : PRIORITY_FOUNDATION;
+  }
+
+  if (source == SOLVER_PILE) {
+    return PRIORITY_FROM_PILE;
+  }
+
+  if (state.num_down[source] != 0
+      && state.cards[source][state.num_down[source]] == card) {
+    return PRIORITY_REVEAL;
+  }
+
+  return PRIORITY_OTHER;
+}
+
+solver_options_t solver_default_options()
+{
+  solver_options_t options;
+
+  options.goal = SOLVER_GOAL_REVEAL;
+  options.reveals = 1;
+  options.max_depth = 24;
+  options.max_nodes = 200000;
+  options.ordering = SOLVER_ORDER_ALL;
+  options.pruning = PRUNE_ALL;
+  options.exact_visited = false;
+  options.cancel = NULL;
+
+  return options;
+}
+
+static const char *const OUTCOME_NAMES[NUM_SOLVER_OUTCOMES] = {
+  "found", "exhausted", "out_of_nodes", "cancelled"
+};
+
+const char *solver_outcome_name(solver_outcome_t outcome)
+{
+  return outcome < NUM_SOLVER_OUTCOMES ? OUTCOME_NAMES[outcome] : "unknown";
+}
+
+static bloom_config_t visited_config(const solver_options_t & options)
+{
+  bloom_config_t config;
+
+  config.expected_items = options.max_nodes;
+  config.false_positive_rate = VISITED_FALSE_POSITIVE_RATE;
+  config.max_bytes = 0;
+
+  return config;
+}
+
+bool solver_visited_t::operator==(const solver_visited_t & other) const
+{
+  if (state.hash != other.state.hash
+      || remaining != other.remaining
+      || previous != other.previous
+      || previous_revealed != other.previous_revealed
+      || state.pile != other.state.pile
+      || memcmp(state.foundation, other.state.foundation,
+          sizeof(state.foundation)) != 0
+      || memcmp(state.num_cards, other.state.num_cards,
+          sizeof(state.num_cards)) != 0
+      || memcmp(state.num_down, other.state.num_down,
+          sizeof(state.num_down)) != 0) {
+    return false;
+  }
+
+  /* Past the top of a column are the leftovers of moves. */
+  for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+    if (memcmp(state.cards[deck], other.state.cards[deck],
+          state.num_cards[deck]) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t solver_visited_hash_t::operator()(
+    const solver_visited_t & visited) const
+{
+  return visited.state.hash
+    ^ (visited.remaining * REMAINING_KEY)
+    ^ (uint64_t(visited.previous) << 1 | visited.previous_revealed);
+}
+
+solver_t::solver_t(const solver_options_t & options)
+  : options(options), visited(visited_config(options))
+{
+  if (options.max_depth > SOLVER_MAX_DEPTH) {
+    throw SolverException();
+  }
+
+  memset(history, 0, sizeof(history));
+  memset(killers, 0, sizeof(killers));
+}
+
+bool solver_t::is_goal(const packed_state_t & state) const
+{
+  if (options.goal == SOLVER_GOAL_WIN) {
+    return packed_is_won(state);
+  }
+
+  return packed_num_down(state) <= reveals_at_goal;
+}
+
+void solver_t::order_moves(
+    const packed_state_t & state,
+    uint32_t ply,
+    solver_move_t *moves,
+    uint32_t num_moves) const
+{
+  uint64_t keys[SOLVER_MAX_MOVES];
+
+  if (options.ordering == SOLVER_ORDER_NONE) {
+    return;
+  }
+
+  /* Killers, then static priority, then history. */
+  for (uint32_t i = 0 ; i < num_moves ; i++) {
+    uint64_t key = 0;
+
+    if (options.ordering & SOLVER_ORDER_KILLERS) {
+      key |= uint64_t(moves[i] == killers[ply][0]) << 41;
+      key |= uint64_t(moves[i] == killers[ply][1]) << 40;
+    }
+
+    if (options.ordering & SOLVER_ORDER_STATIC) {
+      key |= uint64_t(static_priority(state, moves[i])) << 32;
+    }
+
+    if (options.ordering & SOLVER_ORDER_HISTORY) {
+      key |= history[moves[i]];
+    }
+
+    keys[i] = key;
+  }
+
+  /* Insertion sort, there are only ever a few tens of moves. */
+  for (uint32_t i = 1 ; i < num_moves ; i++) {
+    const uint64_t key = keys[i];
+    const solver_move_t move = moves[i];
+    uint32_t j = i;
+
+    for ( ; j > 0 && keys[j - 1] < key ; j--) {
+      keys[j] = keys[j - 1];
+      moves[j] = moves[j - 1];
+    }
+
+    keys[j] = key;
+    moves[j] = move;
+  }
+}
+
+/* [move] was the best at [ply], with [remaining] moves to go. Deeper
+ * subtrees are worth more, as in the usual history heuristic.
+ */
+void solver_t::credit(solver_move_t move, uint32_t ply, uint32_t remaining)
+{
+  if (history[move] < std::numeric_limits<uint32_t>::max() / 2) {
+    history[move] += remaining * remaining;
+  }
+
+  if (killers[ply][0] != move) {
+    killers[ply][1] = killers[ply][0];
+    killers[ply][0] = move;
+  }
+}
+
+/* The Bloom filter's key for [state] searched with [remaining] moves to
+ * go after [context]. Under reversal pruning, the moves searched depend on
+ * the move before, so then that is part of the key.
+ */
+static uint64_t visited_key(
+    const packed_state_t & state,
+    uint32_t remaining,
+    const prune_context_t & context,
+    uint32_t pruning)
+{
+  uint64_t key = state.hash ^ (remaining * REMAINING_KEY);
+
+  if (pruning & PRUNE_REVERSAL) {
+    key ^= prune_reversible(context) * PREVIOUS_KEY;
+  }
+
+  return key;
+}
+
+/* Returns FOUND, with the line in [result], or the best progress reached
+ * below [state].
+ */
+int32_t solver_t::search(
+    const packed_state_t & state, uint32_t ply, uint32_t remaining)
+{
+  if (++nodes > options.max_nodes) {
+    out_of_nodes = true;
+    return progress(state);
+  }
+
+  if (nodes % CANCEL_CHECK_PERIOD == 0
+      && ((options.cancel != NULL
+           && options.cancel->load(std::memory_order_relaxed))
+          || (deadline_us != 0 && metrics_now_us() > deadline_us))) {
+    cancelled = true;
+    out_of_nodes = true;
+    return progress(state);
+  }
+
+  if (is_goal(state)) {
+    result->num_moves = ply;
+    return FOUND;
+  }
+
+  /* Every card not home takes a move to get there. */
+  if (remaining == 0
+      || (options.goal == SOLVER_GOAL_WIN
+          && remaining < NUM_CARDS - cards_home(state))) {
+    cut_off = true;
+    return progress(state);
+  }
+
+  /* Going round in circles, eg. moving a card back and forth between two
+   * columns, is never shorter.
+   */
+  for (uint32_t i = 0 ; i < ply ; i++) {
+    if (path[i] == state.hash) {
+      cycle_cuts++;
+      return progress(state);
+    }
+  }
+
+  prune_context_t context;
+
+  context.previous = ply ? line[ply - 1] : 0;
+  context.previous_revealed = ply ? line_revealed[ply - 1] : false;
+
+  solver_visited_t key;
+
+  if (options.exact_visited) {
+    key.state = state;
+    key.remaining = remaining;
+    key.previous = context.previous;
+    key.previous_revealed = context.previous_revealed;
+
+    if (exact.count(key) != 0) {
+      return progress(state);
+    }
+  } else if (visited.contains(
+        visited_key(state, remaining, context, options.pruning))) {
+    return progress(state);
+  }
+
+  path[ply] = state.hash;
+
+  const uint64_t cycle_cuts_before = cycle_cuts;
+  solver_move_t moves[SOLVER_MAX_MOVES];
+
+  const uint32_t num_moves = prune_moves(
+      state, context, moves, solver_generate_moves(state, moves),
+      options.pruning);
+  int32_t best = progress(state);
+  solver_move_t best_move = 0;
+  bool has_best = false;
+
+  order_moves(state, ply, moves, num_moves);
+
+  for (uint32_t i = 0 ; i < num_moves && !out_of_nodes ; i++) {
+    packed_state_t child = state;
+    const bool revealed = solver_apply_move(&child, moves[i]);
+    int32_t value;
+
+    line[ply] = moves[i];
+    line_revealed[ply] = revealed;
+
+    /* Nothing is known past a card that wasn't. */
+    if (revealed
+        && child.cards[solver_move_source(moves[i])]
+             [child.num_down[solver_move_source(moves[i])]]
+           == SOLVER_UNKNOWN_CARD
+        && !is_goal(child)) {
+      nodes++;
+      value = progress(child);
+    } else {
+      value = search(child, ply + 1, remaining - 1);
+    }
+
+    if (value == FOUND) {
+      result->moves[ply] = moves[i];
+      credit(moves[i], ply, remaining);
+      return FOUND;
+    }
+
+    if (value > best) {
+      best = value;
+      best_move = moves[i];
+      has_best = true;
+    }
+  }
+
+  if (has_best) {
+    credit(best_move, ply, remaining);
+  }
+
+  /* A subtree cut short by the path to it may hold more from elsewhere. */
+  if (!out_of_nodes && cycle_cuts == cycle_cuts_before) {
+    if (options.exact_visited) {
+      exact.insert(key);
+    } else {
+      visited.insert(
+          visited_key(state, remaining, context, options.pruning));
+    }
+  }
+
+  return best;
+}
+
+solver_result_t solver_t::solve(
+    const packed_state_t & state, uint64_t deadline_us)
+{
+  static metric_counter_t & nodes_total = metrics_counter(
+      "solver_nodes_total", "Positions visited by the solver");
+  static const metric_counter_table_t<NUM_SOLVER_OUTCOMES> searches(
+      "solver_searches_total",
+      "Solver searches, by outcome",
+      "outcome",
+      OUTCOME_NAMES);
+  solver_result_t found;
+
+  if (options.goal == SOLVER_GOAL_WIN) {
+    for (uint32_t deck = 0 ; deck < 7 ; deck++) {
+      for (uint32_t depth = 0 ; depth < state.num_down[deck] ; depth++) {
+        if (state.cards[deck][depth] == SOLVER_UNKNOWN_CARD) {
+          throw SolverException();
+        }
+      }
+    }
+  }
+
+  /* Old history still says something about which moves are good, less so
+   * than this search will.
+   */
+  for (uint32_t i = 0 ; i < SOLVER_NUM_PACKED_MOVES ; i++) {
+    history[i] /= 2;
+  }
+
+  memset(killers, 0, sizeof(killers));
+  root = state;
+  nodes = 0;
+  out_of_nodes = false;
+  cancelled = false;
+  this->deadline_us = deadline_us;
+  result = &found;
+  found.outcome = SOLVER_EXHAUSTED;
+  found.num_moves = 0;
+  found.depth = 0;
+
+  const uint32_t down = packed_num_down(state);
+  reveals_at_goal = down > options.reveals ? down - options.reveals : 0;
+
+  for (uint32_t depth = 0 ; depth <= options.max_depth ; depth++) {
+    visited.clear();
+    exact.clear();
+    cycle_cuts = 0;
+    cut_off = false;
+    found.depth = depth;
+
+    if (search(root, 0, depth) == FOUND) {
+      found.outcome = SOLVER_FOUND;
+      break;
+    }
+
+    if (out_of_nodes) {
+      found.outcome = cancelled ? SOLVER_CANCELLED : SOLVER_OUT_OF_NODES;
+      break;
+    }
+
+    if (!cut_off) {
+      break;
+    }
+  }
+
+  found.nodes = nodes;
+  nodes_total.inc(nodes);
+  searches[found.outcome].inc();
+
+  return found;
+}
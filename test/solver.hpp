@@ -0,0 +1,247 @@
+#ifndef SOLVER_HPP
+#define SOLVER_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+#include <exception>
+#include <string>
+#include <unordered_set>
+
+#include "game.hpp"
+#include "belief.hpp"
+#include "bloom.hpp"
+
+/* Search over deals where every card that matters is known: the stock pile
+ * (known after strategy_init) and, optionally, the face down cards (eg. a
+ * deal sampled from belief_t).
+ *
+ * The stock and waste pile is searched as a set: the game deals one card
+ * at a time with unlimited passes, so any card in it can be brought on top
+ * of the waste, and the order only changes how many draws that takes (see
+ * stock_model_t::distance_to). Cards are not taken back from foundations.
+ *
+ * The search is an iterative deepening depth first search. Moves are
+ * ordered by, in turn: the killer moves of the ply, static priorities
+ * after Rules 0 to 2 of calculate_obvious_move (aces and deuces home,
+ * then moves that turn over a face down card, then the rest), and a
+ * history table of how often a move led the search somewhere good. Good
+ * ordering is what lets a search finish in milliseconds rather than
+ * seconds; `bench --solver-corpus` reports node counts with and without
+ * it. Moves that can't matter are left out by the rules of prune.hpp.
+ */
+
+/* Face down cards plus a full run of KING to ACE. */
+const uint32_t SOLVER_MAX_COLUMN = 19;
+const uint32_t SOLVER_MAX_DEPTH = 64;
+
+/* At most two cards fit on a column, one on a foundation, and a king on an
+ * empty column (searched as one), so positions have far fewer moves.
+ */
+const uint32_t SOLVER_MAX_MOVES = 64;
+
+/* A face down card that isn't known. Turning one over ends the line. */
+const uint8_t SOLVER_UNKNOWN_CARD = 0xff;
+
+/* Move sources are columns 0 to 6 and the pile; destinations are columns
+ * 0 to 6 and the card's foundation.
+ */
+const uint32_t SOLVER_PILE = 7;
+const uint32_t SOLVER_FOUNDATION = 8;
+
+/* [source] << 10 | [destination] << 6 | card index. Moving a run out of a
+ * column is named after its bottom card.
+ */
+typedef uint16_t solver_move_t;
+
+const uint32_t SOLVER_NUM_PACKED_MOVES = 1 << 14;
+
+static inline solver_move_t solver_pack_move(
+    uint32_t source, uint32_t destination, uint32_t card)
+{
+  return solver_move_t((source << 10) | (destination << 6) | card);
+}
+
+static inline uint32_t solver_move_source(solver_move_t move) {
+  return move >> 10;
+}
+
+static inline uint32_t solver_move_destination(solver_move_t move) {
+  return (move >> 6) & 0xf;
+}
+
+static inline uint32_t solver_move_card(solver_move_t move) {
+  return move & 0x3f;
+}
+
+std::string solver_move_to_string(solver_move_t move);
+
+/* Cards are card indices (see card_index). */
+static inline uint32_t solver_card_number(uint32_t card) {
+  return card % 13 + 1;
+}
+
+static inline uint32_t solver_card_suite(uint32_t card) {
+  return card / 13;
+}
+
+/* [card] can go on top of [onto] in the tableau. */
+static inline bool solver_stacks_on(uint32_t card, uint32_t onto) {
+  return solver_card_number(card) + 1 == solver_card_number(onto)
+    && solver_card_suite(card) % 2 != solver_card_suite(onto) % 2;
+}
+
+struct packed_state_t {
+  uint8_t cards[7][SOLVER_MAX_COLUMN];  /* Bottom up, face down first. */
+  uint8_t num_cards[7];
+  uint8_t num_down[7];
+  uint8_t foundation[4];  /* Top number of each suite, 0 if empty. */
+  uint64_t pile;          /* Bit [card_index] of the stock and waste. */
+  uint64_t hash;          /* Zobrist, kept up to date by moves. */
+};
+
+/* [card] can be played onto its foundation. */
+static inline bool packed_goes_home(
+    const packed_state_t & state, uint32_t card) {
+  return uint32_t(state.foundation[solver_card_suite(card)]) + 1
+    == solver_card_number(card);
+}
+
+/* Thrown when a state can't be packed or searched as asked. */
+class SolverException : public std::exception {
+};
+
+/* [pile] as in stock_model_t::mask. Face down cards are unknown unless
+ * [sample] deals them.
+ */
+packed_state_t packed_state_of(
+    const game_state_t & state,
+    uint64_t pile,
+    const belief_sample_t *sample);
+
+uint32_t packed_num_down(const packed_state_t & state);
+bool packed_is_won(const packed_state_t & state);
+
+/* Fills [moves] (SOLVER_MAX_MOVES at least) with the legal moves. */
+uint32_t solver_generate_moves(
+    const packed_state_t & state, solver_move_t *moves);
+
+/* Plays a legal move. Returns true if it turned a face down card over. */
+bool solver_apply_move(packed_state_t *state, solver_move_t move);
+
+enum solver_goal_t {
+  SOLVER_GOAL_REVEAL,  /* Turn over [reveals] face down cards. */
+  SOLVER_GOAL_WIN,     /* Every card home. Needs every card known. */
+};
+
+enum solver_ordering_t {
+  SOLVER_ORDER_NONE = 0,
+  SOLVER_ORDER_STATIC = 1,
+  SOLVER_ORDER_KILLERS = 2,
+  SOLVER_ORDER_HISTORY = 4,
+  SOLVER_ORDER_ALL = 7,
+};
+
+struct solver_options_t {
+  solver_goal_t goal;
+  uint32_t reveals;
+  uint32_t max_depth;
+  uint64_t max_nodes;  /* Over all iterations. */
+  uint32_t ordering;   /* Or of solver_ordering_t. */
+  uint32_t pruning;    /* Or of prune_rule_t, see prune.hpp. */
+
+  /* Remembers the states searched exactly, rather than in a Bloom filter
+   * whose false positives drop subtrees: for checking the search against
+   * itself, at the cost of memory.
+   */
+  bool exact_visited;
+
+  /* Stops the search when set, eg. by another thread. NULL for never. */
+  const std::atomic<bool> *cancel;
+};
+
+solver_options_t solver_default_options();
+
+enum solver_outcome_t {
+  SOLVER_FOUND,
+  SOLVER_EXHAUSTED,     /* No line within [max_depth]. */
+  SOLVER_OUT_OF_NODES,
+  SOLVER_CANCELLED,     /* Or past the deadline. */
+  NUM_SOLVER_OUTCOMES
+};
+
+const char *solver_outcome_name(solver_outcome_t outcome);
+
+struct solver_result_t {
+  solver_outcome_t outcome;
+  uint32_t num_moves;
+  solver_move_t moves[SOLVER_MAX_DEPTH];
+  uint64_t nodes;
+  uint32_t depth;  /* Last depth limit searched. */
+};
+
+/* A state searched with [remaining] moves to go, after [previous] as in
+ * prune_context_t: what the exact visited set tells apart.
+ */
+struct solver_visited_t {
+  packed_state_t state;
+  uint32_t remaining;
+  solver_move_t previous;
+  bool previous_revealed;
+
+  bool operator==(const solver_visited_t & other) const;
+};
+
+struct solver_visited_hash_t {
+  size_t operator()(const solver_visited_t & visited) const;
+};
+
+/* Keeps its tables (history, killers, visited states) between searches,
+ * so it is meant to be reused. Not thread safe: one solver per thread.
+ */
+class solver_t {
+private:
+  solver_options_t options;
+  uint32_t history[SOLVER_NUM_PACKED_MOVES];
+  solver_move_t killers[SOLVER_MAX_DEPTH][2];
+  /* (state, moves left, prune context) of the subtrees searched in this
+   * iteration without a cycle cut; see search().
+   */
+  bloom_filter_t visited;
+  std::unordered_set<solver_visited_t, solver_visited_hash_t> exact;
+  uint64_t cycle_cuts;
+  packed_state_t root;
+  uint64_t nodes;
+  uint32_t reveals_at_goal;
+  uint64_t path[SOLVER_MAX_DEPTH + 1];  /* Hashes from the root. */
+  solver_move_t line[SOLVER_MAX_DEPTH];  /* Moves from the root. */
+  bool line_revealed[SOLVER_MAX_DEPTH];
+  bool cut_off;       /* Some line ran into the depth limit. */
+  bool out_of_nodes;  /* Or cancelled. */
+  bool cancelled;
+  uint64_t deadline_us;
+  solver_result_t *result;
+
+  solver_t(const solver_t &);
+  solver_t & operator=(const solver_t &);
+
+  int32_t search(
+      const packed_state_t & state, uint32_t ply, uint32_t remaining);
+  bool is_goal(const packed_state_t & state) const;
+  void order_moves(
+      const packed_state_t & state,
+      uint32_t ply,
+      solver_move_t *moves,
+      uint32_t num_moves) const;
+  void credit(solver_move_t move, uint32_t ply, uint32_t remaining);
+
+public:
+  explicit solver_t(const solver_options_t & options);
+
+  /* Gives up past [deadline_us] (on the metrics_now_us() clock), unless
+   * it is 0.
+   */
+  solver_result_t solve(const packed_state_t & state, uint64_t deadline_us = 0);
+};
+
+#endif
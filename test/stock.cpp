@@ -0,0 +1,157 @@
+#include <string.h>
+
+#include "stock.hpp"
+
+stock_model_t::stock_model_t()
+{
+  clear();
+}
+
+void stock_model_t::clear()
+{
+  memset(tree, 0, sizeof(tree));
+  memset(position_of, -1, sizeof(position_of));
+  num_positions = 0;
+  num_cards = 0;
+  card_mask = 0;
+}
+
+void stock_model_t::add(uint32_t position, int delta)
+{
+  for (uint32_t i = position + 1 ; i <= STOCK_CAPACITY ; i += i & -i) {
+    tree[i] += delta;
+  }
+}
+
+uint32_t stock_model_t::prefix(uint32_t position) const
+{
+  uint32_t sum = 0;
+
+  for (uint32_t i = position ; i > 0 ; i -= i & -i) {
+    sum += tree[i];
+  }
+
+  return sum;
+}
+
+void stock_model_t::push_back(const card_t & card)
+{
+  if (num_positions == STOCK_CAPACITY || contains(card)) {
+    return;
+  }
+
+  cards[num_positions] = card;
+  position_of[card_index(card)] = num_positions;
+  add(num_positions, 1);
+  num_positions++;
+  num_cards++;
+  card_mask |= uint64_t(1) << card_index(card);
+}
+
+void stock_model_t::remove(const card_t & card)
+{
+  const int8_t position = position_of[card_index(card)];
+
+  if (position < 0) {
+    return;
+  }
+
+  position_of[card_index(card)] = -1;
+  add(position, -1);
+  num_cards--;
+  card_mask &= ~(uint64_t(1) << card_index(card));
+}
+
+bool stock_model_t::contains(const card_t & card) const
+{
+  return position_of[card_index(card)] >= 0;
+}
+
+uint32_t stock_model_t::rank(const card_t & card) const
+{
+  return prefix(position_of[card_index(card)]);
+}
+
+card_t stock_model_t::select(uint32_t rank) const
+{
+  /* Descends the tree for the last position with at most [rank] cards
+   * before it.
+   */
+  uint32_t position = 0;
+  uint32_t step = 1;
+
+  while (step * 2 <= STOCK_CAPACITY) {
+    step *= 2;
+  }
+
+  for ( ; step > 0 ; step /= 2) {
+    if (position + step <= STOCK_CAPACITY && tree[position + step] <= rank) {
+      position += step;
+      rank -= tree[position];
+    }
+  }
+
+  return cards[position];
+}
+
+stock_distance_t stock_model_t::distance_to(
+    const card_t & card, const game_state_t & state) const
+{
+  /* Both counted from 1: the card is dealt [target]-th in a pass and the
+   * waste pile holds the first [waste] cards of the current pass.
+   */
+  const uint32_t target = rank(card) + 1;
+  const uint32_t waste =
+    state.remaining_pile_size - state.stock_pile_size;
+  stock_distance_t distance = { 0, false, 0 };
+
+  if (target >= waste) {
+    distance.draws_before_reset = target - waste;
+  } else {
+    distance.draws_before_reset = state.stock_pile_size;
+    distance.reset = true;
+    distance.draws_after_reset = target;
+  }
+
+  return distance;
+}
+
+bool stock_model_t::consistent_with(const game_state_t & state) const
+{
+  const uint32_t waste =
+    state.remaining_pile_size - state.stock_pile_size;
+
+  if (state.remaining_pile_size != num_cards) {
+    return false;
+  }
+
+  if (waste == 0) {
+    return !state.waste_pile_top.is_some();
+  }
+
+  return state.waste_pile_top.is_some()
+    && select(waste - 1) == state.waste_pile_top.get();
+}
+
+stock_model_t::const_iterator::const_iterator(
+    const stock_model_t *model, uint32_t position)
+  : model(model), position(position)
+{
+  skip_removed();
+}
+
+void stock_model_t::const_iterator::skip_removed()
+{
+  while (position < model->num_positions
+      && model->position_of[card_index(model->cards[position])]
+        != int8_t(position)) {
+    position++;
+  }
+}
+
+stock_model_t::const_iterator & stock_model_t::const_iterator::operator++()
+{
+  position++;
+  skip_removed();
+  return *this;
+}
@@ -0,0 +1,107 @@
+#ifndef STOCK_HPP
+#define STOCK_HPP
+
+#include <stdint.h>
+
+#include <iterator>
+
+#include "game.hpp"
+
+/* The stock and waste pile, as learnt by the opening sweep.
+ *
+ * Cards keep the position they were first drawn at (0 to 23). A Fenwick
+ * tree over which positions still hold a card gives the order of a card
+ * among those left, and the other way round, in O(log n), so cards can be
+ * taken off the pile anywhere without shifting the others.
+ *
+ * The game deals from the pile in that order, skipping cards that were
+ * played, and [game_state_t] says how far into the current pass it is:
+ * remaining_pile_size - stock_pile_size cards are face up in the waste,
+ * the last of those on top.
+ */
+
+const uint32_t STOCK_CAPACITY = 24;
+
+/* What to do to get a card on top of the waste pile: draw
+ * [draws_before_reset], reset if [reset], then draw [draws_after_reset].
+ */
+struct stock_distance_t {
+  uint32_t draws_before_reset;
+  bool reset;
+  uint32_t draws_after_reset;
+
+  uint32_t gestures() const {
+    return draws_before_reset + (reset ? 1 : 0) + draws_after_reset;
+  }
+};
+
+class stock_model_t {
+private:
+  card_t cards[STOCK_CAPACITY];
+  uint8_t tree[STOCK_CAPACITY + 1];     /* Fenwick tree, 1-based. */
+  int8_t position_of[NUM_CARDS];        /* -1 if not in the pile. */
+  uint32_t num_positions;               /* Positions ever used. */
+  uint32_t num_cards;                   /* Positions still holding a card. */
+  uint64_t card_mask;                   /* Bit [card_index] of those. */
+
+  void add(uint32_t position, int delta);
+
+  /* Cards at positions [0, position). */
+  uint32_t prefix(uint32_t position) const;
+
+public:
+  stock_model_t();
+
+  void clear();
+
+  /* Records [card] as drawn next, the first time round. */
+  void push_back(const card_t & card);
+
+  /* Takes [card] off the pile, when it's played. Does nothing if it is not
+   * in the pile.
+   */
+  void remove(const card_t & card);
+
+  bool contains(const card_t & card) const;
+  uint32_t size() const { return num_cards; }
+  bool empty() const { return num_cards == 0; }
+  uint64_t mask() const { return card_mask; }
+
+  /* Order of [card] among the cards left, 0 being dealt first. */
+  uint32_t rank(const card_t & card) const;
+
+  /* The card dealt [rank]-th, counting from 0, among the cards left. */
+  card_t select(uint32_t rank) const;
+
+  /* How to get [card] on top of the waste pile from [state]. */
+  stock_distance_t distance_to(
+      const card_t & card, const game_state_t & state) const;
+
+  /* True if the pile agrees with the pile sizes and waste top of [state]. */
+  bool consistent_with(const game_state_t & state) const;
+
+  /* Iterates over the cards left, in the order they are dealt. */
+  class const_iterator
+    : public std::iterator<std::forward_iterator_tag, card_t> {
+  private:
+    const stock_model_t *model;
+    uint32_t position;
+
+    void skip_removed();
+
+  public:
+    const_iterator(const stock_model_t *model, uint32_t position);
+    const card_t & operator*() const { return model->cards[position]; }
+    const_iterator & operator++();
+    bool operator!=(const const_iterator & other) const {
+      return position != other.position;
+    }
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const {
+    return const_iterator(this, num_positions);
+  }
+};
+
+#endif
@@ -10,12 +10,66 @@
 #include "strategy.hpp"
 #include "game.hpp"
 #include "interact.hpp"
+#include "vision.hpp"
+#include "cycle.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "belief.hpp"
+#include "stock.hpp"
+#include "solver.hpp"
+#include "engine.hpp"
+#include "peek.hpp"
+#include "recorder.hpp"
 
 namespace {
 
-/* TODO(fyquah): Globals? Ewwwwww. */
-static bool glob_is_stock_pile_explored;
-static std::vector<card_t> glob_stock_pile;
+/* Work budgets, in iterations, of the strategy loops. These are far more
+ * than a won game needs; hitting one means the loop is not going anywhere.
+ */
+const uint32_t STEP_BUDGET = 1000;
+const uint32_t WRAP_UP_TRANSFER_BUDGET = 100;
+const uint32_t FINISH_GAME_BUDGET = 2000;
+
+/* TODO(fyquah): Globals? Ewwwwww.
+ *
+ * Per thread, so that a copy of the game can be played on a simulator
+ * alongside the live one (see portfolio.hpp).
+ */
+static thread_local bool glob_is_stock_pile_explored;
+static thread_local stock_model_t glob_stock_pile;
+static thread_local cycle_guard_t glob_step_guard(
+    "strategy_step", STEP_BUDGET);
+static thread_local uint32_t glob_moves_to_skip;
+static thread_local belief_t glob_belief;
+
+/* A copy of the game, picked up with strategy_resume: its decisions are
+ * not counted as the bot's.
+ */
+static thread_local bool glob_is_copy;
+
+/* NULL to play by the rules alone. */
+static thread_local std::unique_ptr<decision_engine_t> glob_engine;
+static thread_local uint32_t glob_engine_deadline_ms;
+
+/* The decisions counter of [glob_engine], registered with it. */
+static thread_local metric_counter_t *glob_engine_decisions;
+
+/* Peeks under Rule 2 moves (see peek.hpp), and the gestures they took in
+ * this game.
+ */
+static thread_local peek_options_t glob_peek = peek_default_options();
+static thread_local uint64_t glob_peek_gestures;
+
+/* Set by whoever raced this copy of the game, to stop it; NULL for never. */
+static thread_local const std::atomic<bool> *glob_cancel;
+
+/* Once cancelled, Rule 3 finds no paths and takes no candidates, so that
+ * strategy_step returns without a move in short order.
+ */
+static bool is_cancelled()
+{
+  return glob_cancel != NULL && glob_cancel->load(std::memory_order_relaxed);
+}
 
 enum location_tag_t
 {
@@ -24,11 +78,16 @@ enum location_tag_t
   LOC_FOUNDATION = 2
 };
 
+/* MOVE_NO_INDEX for locations without one, rather than throwing: the dry
+ * run of planned paths asks for them on every step.
+ */
+typedef Result<uint32_t, move_error_t> location_index_t;
+
 class Location
 {
 public:
-  virtual uint32_t index () = 0;
-  virtual uint32_t sub_index () = 0;
+  virtual location_index_t index () = 0;
+  virtual location_index_t sub_index () = 0;
   virtual location_tag_t tag () = 0;
   virtual std::string to_string() = 0;
 };
@@ -36,14 +95,14 @@ public:
 class WastePile : public Location
 {
 public:
-  uint32_t index ()
+  location_index_t index ()
   {
-    throw std::exception();
+    return location_index_t::fail(MOVE_NO_INDEX);
   }
 
-  uint32_t sub_index ()
+  location_index_t sub_index ()
   {
-    throw std::exception();
+    return location_index_t::fail(MOVE_NO_INDEX);
   }
 
   location_tag_t tag()
@@ -67,14 +126,14 @@ public:
   Tableau(uint32_t index_, uint32_t sub_index_)
     : index_(index_), sub_index_(sub_index_) {}
 
-  uint32_t index()
+  location_index_t index()
   {
-    return index_;
+    return location_index_t::ok(index_);
   }
 
-  uint32_t sub_index()
+  location_index_t sub_index()
   {
-    return sub_index_;
+    return location_index_t::ok(sub_index_);
   }
 
   location_tag_t tag()
@@ -97,14 +156,14 @@ private:
 public:
   Foundation(uint32_t index_) : index_(index_) {}
 
-  uint32_t index()
+  location_index_t index()
   {
-    return index_;
+    return location_index_t::ok(index_);
   }
 
-  uint32_t sub_index()
+  location_index_t sub_index()
   {
-    throw std::exception();
+    return location_index_t::fail(MOVE_NO_INDEX);
   }
 
   location_tag_t tag()
@@ -147,12 +206,7 @@ static void update_glob_stock_pile(const game_state_t & state, Move move)
   if (move.from.get()->tag() == LOC_WASTE_PILE) {
     card_t card = state.waste_pile_top.get();
 
-    glob_stock_pile.erase(
-        std::remove(
-          glob_stock_pile.begin(),
-          glob_stock_pile.end(),
-          card),
-        glob_stock_pile.end());
+    glob_stock_pile.remove(card);
   }
 }
 
@@ -166,7 +220,7 @@ static bool possible_to_play_deuce(
     && card.number == DEUCE;
 
   if (ret) {
-    std::cout
+    chatter()
       << "Possible to promote "
       << card.to_string()
       << " to foundation"
@@ -195,11 +249,65 @@ static inline std::shared_ptr<Move> make_move(
   return std::make_shared<Move>(src, dest);
 }
 
+/* The moves of Rule 2: runs off face down cards that go on another
+ * column, as (number of face down cards, (source, destination)).
+ */
+typedef std::pair<uint32_t, std::pair<uint32_t, uint32_t>>
+  rule_2_candidate_t;
+
+static std::vector<rule_2_candidate_t> rule_2_candidates(
+    const game_state_t & state)
+{
+  const tableau_deck_t *tbl_deck = state.tableau;
+  std::vector<rule_2_candidate_t> downcard_freeing_candidates;
+
+  for (int i = 0 ; i < 7 ; i++) {
+    /* This implies cards.size() != 0 */
+    if (tbl_deck[i].num_down_cards == 0) {
+      continue;
+    }
+
+    card_t src = tbl_deck[i].cards.at(0);
+
+    for (int j = 0 ; j < 7 ; j++) {
+      if (i == j) {
+        continue;
+      }
+
+      if (tbl_deck[j].cards.size() == 0) {
+
+        if (src.number == KING) {
+          downcard_freeing_candidates.push_back(
+              std::make_pair(
+                tbl_deck[i].num_down_cards,
+                std::make_pair(i, j))
+          );
+        }
+
+      } else {
+        card_t dest = tbl_deck[j].cards.back();
+  
+        if (src.number == dest.number- 1 &&
+            suite_color(src.suite) != suite_color(dest.suite)) {
+          downcard_freeing_candidates.push_back(
+              std::make_pair(
+                tbl_deck[i].num_down_cards,
+                std::make_pair(i, j))
+          );
+        }
+      }
+    }
+  }
+
+  return downcard_freeing_candidates;
+}
+
 /* Obvious moves are moves that strictly lead the game to a better
  * state.
  */
 std::shared_ptr<Move> calculate_obvious_move(const game_state_t & state)
 {
+  trace_scope_t scope(PHASE_OBVIOUS_MOVE);
   std::vector<Move> ret;
   Option<card_t> waste_pile_top = state.waste_pile_top;
   const tableau_deck_t *tbl_deck = state.tableau;
@@ -253,46 +361,8 @@ std::shared_ptr<Move> calculate_obvious_move(const game_state_t & state)
    * one with the greatest number of hidden cards. (except for promoting
    * to foundation. That is a little risky)
    */
-  std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t>>>
-    downcard_freeing_candidates;
-
-  for (int i = 0 ; i < 7 ; i++) {
-    /* This implies cards.size() != 0 */
-    if (tbl_deck[i].num_down_cards == 0) {
-      continue;
-    }
-
-    card_t src = tbl_deck[i].cards.at(0);
-
-    for (int j = 0 ; j < 7 ; j++) {
-      if (i == j) {
-        continue;
-      }
-
-      if (tbl_deck[j].cards.size() == 0) {
-
-        if (src.number == KING) {
-          downcard_freeing_candidates.push_back(
-              std::make_pair(
-                tbl_deck[i].num_down_cards,
-                std::make_pair(i, j))
-          );
-        }
-
-      } else {
-        card_t dest = tbl_deck[j].cards.back();
-  
-        if (src.number == dest.number- 1 &&
-            suite_color(src.suite) != suite_color(dest.suite)) {
-          downcard_freeing_candidates.push_back(
-              std::make_pair(
-                tbl_deck[i].num_down_cards,
-                std::make_pair(i, j))
-          );
-        }
-      }
-    }
-  }
+  const std::vector<rule_2_candidate_t> downcard_freeing_candidates =
+    rule_2_candidates(state);
 
   if (downcard_freeing_candidates.size() != 0) {
     const auto p = std::max_element(
@@ -302,18 +372,18 @@ std::shared_ptr<Move> calculate_obvious_move(const game_state_t & state)
     uint32_t src = p->second.first;
     uint32_t dest = p->second.second;
 
-    std::cout << "Moving visible tableau from "
+    chatter() << "Moving visible tableau from "
       << src << "("<< state.tableau[src].cards.back().to_string() << ")"
       << " -> "
       << dest << "(";
 
     if (state.tableau[dest].cards.size() == 0) {
-      std::cout << "<NONE>";
+      chatter() << "<NONE>";
     } else {
-      std::cout << state.tableau[dest].cards.at(0).to_string();
+      chatter() << state.tableau[dest].cards.at(0).to_string();
     }
 
-    std::cout << ") to release more hidden cards\n";
+    chatter() << ") to release more hidden cards\n";
 
     return make_move(
         loc_tableau(src, 0),
@@ -333,23 +403,24 @@ static game_state_t perform_move(
   Location *to = move.get()->to.get();
 
   if (from->tag() == LOC_WASTE_PILE && to->tag() == LOC_TABLEAU) {
-    return move_from_visible_pile_to_tableau(state, to->index());
+    return move_from_visible_pile_to_tableau(state, to->index().get());
 
   } else if (from->tag() == LOC_WASTE_PILE && to->tag() == LOC_FOUNDATION) {
-    return move_from_visible_pile_to_foundation(state, to->index());
+    return move_from_visible_pile_to_foundation(state, to->index().get());
 
   } else if (from->tag() == LOC_TABLEAU && to->tag() == LOC_FOUNDATION) {
-    return move_from_tableau_to_foundation(state, from->index(), to->index());
+    return move_from_tableau_to_foundation(
+        state, from->index().get(), to->index().get());
 
   } else if (from->tag() == LOC_TABLEAU && to->tag() == LOC_TABLEAU) {
-    uint32_t src_deck = from->index();
+    uint32_t src_deck = from->index().get();
     const tableau_position_t position = {
       .deck       = src_deck,
       .num_hidden = state.tableau[src_deck].num_down_cards,
-      .position   = uint32_t(from->sub_index())
+      .position   = from->sub_index().get()
     };
 
-    return move_from_column_to_column(state, position, to->index());
+    return move_from_column_to_column(state, position, to->index().get());
   }
 
 
@@ -363,9 +434,15 @@ game_state_t strategy_init(const game_state_t & initial_state)
   /* Due to the way the game is scored, it is okay for us to shuffle through
    * the initial cards to learn what is in the deck.
    */
+  trace_scope_t scope(PHASE_OPENING_SWEEP);
   game_state_t state = initial_state;
 
   glob_is_stock_pile_explored = true;
+  glob_stock_pile.clear();
+  glob_step_guard.reset();
+  glob_belief = belief_t();
+  glob_is_copy = false;
+  glob_peek_gestures = 0;
 
   for (int i = 0 ; i < 24 ; i++) {
     state = draw_from_stock_pile(state);
@@ -378,23 +455,34 @@ game_state_t strategy_init(const game_state_t & initial_state)
         break;
       }
 
+      update_glob_stock_pile(state, *move.get());
       state = perform_move(state, move);
-
-      if (move.get()->from.get()->tag() == LOC_WASTE_PILE) {
-        glob_stock_pile.pop_back();
-      }
     }
   }
 
   /* Knowledge about state: */
-  for (int i = 0 ; i < glob_stock_pile.size() ; i++) {
-    std::cout << i << " = " << glob_stock_pile[i].to_string() << "\n";
+  uint32_t i = 0;
+  for (card_t card : glob_stock_pile) {
+    chatter() << i++ << " = " << card.to_string() << "\n";
   }
 
+  /* The stock pile is known from here on, so are the unseen cards. */
+  glob_belief.update(state, glob_stock_pile.mask());
+
   /* This gets us to square one */
   return reset_stock_pile(state);
 }
 
+void strategy_resume(const stock_model_t & stock, const belief_t & belief)
+{
+  glob_is_stock_pile_explored = true;
+  glob_stock_pile = stock;
+  glob_step_guard.reset();
+  glob_moves_to_skip = 0;
+  glob_belief = belief;
+  glob_is_copy = true;
+}
+
 class FindException : public std::exception {};
 
 static int find_stock_pile_position(const game_state_t & state)
@@ -405,13 +493,45 @@ static int find_stock_pile_position(const game_state_t & state)
 
   const card_t card = state.waste_pile_top.get();
 
-  for (int i = 0 ; i < glob_stock_pile.size(); i++) {
-    if (card == glob_stock_pile[i]) {
-      return i;
-    }
+  if (!glob_stock_pile.contains(card)) {
+    throw FindException();
+  }
+
+  return glob_stock_pile.rank(card);
+}
+
+/* Draws, resetting the stock pile when needed, until [card] is on top of
+ * the waste pile. The number of draws comes from the stock model, and is
+ * checked against what is recognized on the way.
+ */
+static game_state_t draw_until_on_top(game_state_t state, const card_t & card)
+{
+  if (!glob_stock_pile.contains(card)) {
+    throw FindException();
+  }
+
+  const stock_distance_t distance = glob_stock_pile.distance_to(card, state);
+
+  for (uint32_t i = 0 ; i < distance.draws_before_reset ; i++) {
+    state = draw_from_stock_pile(state);
+  }
+
+  if (distance.reset) {
+    state = reset_stock_pile(state);
+  }
+
+  for (uint32_t i = 0 ; i < distance.draws_after_reset ; i++) {
+    state = draw_from_stock_pile(state);
+  }
+
+  if (!state.waste_pile_top.is_some()
+      || !(state.waste_pile_top.get() == card)) {
+    chatter() << "Stock model is out of sync, expected "
+      << card.to_string() << " on top" << std::endl;
+    throw FindException();
   }
 
-  throw FindException();
+  return state;
 }
 
 static std::vector<std::pair<Move, card_t>> compute_foundation_path(
@@ -419,10 +539,11 @@ static std::vector<std::pair<Move, card_t>> compute_foundation_path(
         const uint32_t src,
         bool * exists)
 {
+    trace_scope_t scope(PHASE_FOUNDATION_PATH);
     std::vector<std::pair<Move, card_t>> ret;
     const tableau_deck_t tbl_deck = state.tableau[src];
 
-    if (tbl_deck.cards.size() == 0) {
+    if (tbl_deck.cards.size() == 0 || is_cancelled()) {
       *exists = false;
       return ret;
     }
@@ -448,7 +569,7 @@ static std::vector<std::pair<Move, card_t>> compute_foundation_path(
       left_in_deck[i] = state.tableau[i].cards.size();
     }
 
-    std::cout << "Computing foundation path to " << deck_card.to_string()
+    chatter() << "Computing foundation path to " << deck_card.to_string()
       << "\n";
 
     for (int looking_for = foundation_card.number + 1 ;
@@ -487,14 +608,14 @@ static std::vector<std::pair<Move, card_t>> compute_foundation_path(
         }
       }
 
-      std::cout << "It cannot be found." << std::endl;
+      chatter() << "It cannot be found." << std::endl;
       *exists = false;
       return ret;
 found:
       continue;
     }
 
-    std::cout << "It exists!" << std::endl;
+    chatter() << "It exists!" << std::endl;
 
     *exists = true;
     return ret;
@@ -534,7 +655,8 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
     /* output */ bool *ptr_exists
 )
 {
-  std::cout
+  trace_scope_t scope(PHASE_JOIN_PATH);
+  chatter()
     << "Computing join path from deck "
     << src_deck << " to deck "
     << dest_deck << std::endl;
@@ -547,6 +669,11 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
   std::vector<std::pair<Move, card_t>> ret;
   int left_in_deck[7];
 
+  if (is_cancelled()) {
+    *ptr_exists = false;
+    return ret;
+  }
+
   if (dest.is_some()) {
     card_t d = dest.get();
 
@@ -559,7 +686,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
       && suite_color(d.suite) == suite_color(src.suite);
 
     if (p1 || p2 || p3) {
-      std::cout << "This is an impossible move. Terminating" << std::endl;
+      chatter() << "This is an impossible move. Terminating" << std::endl;
       *ptr_exists = false;
       return ret;
     }
@@ -620,7 +747,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
             state.tableau[i].cards[0])
       );
       limit = uint32_t(state.tableau[i].cards.back().number) - 1;
-      std::cout << "Special continuation limit = " << limit << std::endl;
+      chatter() << "Special continuation limit = " << limit << std::endl;
       found = true;
       break;
     }
@@ -635,7 +762,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
 
   for (uint32_t tail = limit ; tail > src.number  ; ) {
 
-    std::cout
+    chatter()
       << "=> Looking for pile of cards covering at "
       << tail
       << " for something ("
@@ -655,7 +782,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
 
         card_t node = state.tableau[i].cards[j];
 
-        std::cout << "Src = " << src.to_string()
+        chatter() << "Src = " << src.to_string()
           << "node = " << node.to_string()
           << " | Left in deck = " << left_in_deck[i]
           << std::endl;
@@ -677,7 +804,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
           tail = state.tableau[i].cards[left_in_deck[i] - 1].number - 1;
           left_in_deck[i] = j; 
 
-          std::cout << "---> Found in tableau " << i << '\n';
+          chatter() << "---> Found in tableau " << i << '\n';
           goto found;
         }
       }
@@ -696,7 +823,7 @@ static std::vector<std::pair<Move, card_t>> compute_join_path(
             loc_tableau(dest_deck, 0));
         ret.push_back(std::make_pair(move, node));
 
-        std::cout << "---> Found in deck\n";
+        chatter() << "---> Found in deck\n";
 
         tail --;
         goto found;
@@ -714,6 +841,174 @@ found:
   return ret;
 }
 
+/* A copy of the tableau and foundations to check planned paths on, in
+ * place, without allocating: every card is in one column at most.
+ */
+struct dry_run_t {
+  card_t cards[7][52];  /* Face up cards only. */
+  uint32_t num_cards[7];
+  uint32_t num_down[7];
+  Option<card_t> foundation[4];
+  uint64_t drawn;  /* Waste pile cards already played, by card_index. */
+};
+
+static void dry_run_init(dry_run_t *dry_run, const game_state_t & state)
+{
+  for (uint32_t i = 0 ; i < 7 ; i++) {
+    const std::vector<card_t> & cards = state.tableau[i].cards;
+
+    std::copy(cards.begin(), cards.end(), dry_run->cards[i]);
+    dry_run->num_cards[i] = cards.size();
+    dry_run->num_down[i] = state.tableau[i].num_down_cards;
+  }
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    dry_run->foundation[i] = state.foundation[i];
+  }
+
+  dry_run->drawn = 0;
+}
+
+/* Plays [from] to [to] of a path, carrying [card], with the checks of
+ * interact.cpp but no gestures. Cards from the waste pile must be in the
+ * stock model, and are only played once.
+ */
+static move_error_t dry_run_move(
+    dry_run_t *dry_run, Location *from, Location *to, const card_t & card)
+{
+  const location_index_t to_index = to->index();
+  card_t moving = card;
+  uint32_t position = 0;
+  uint32_t src = 0;
+
+  if (!to_index.is_ok()) {
+    return to_index.error();
+  }
+
+  if (from->tag() == LOC_WASTE_PILE) {
+    const uint64_t bit = uint64_t(1) << card_index(card);
+
+    if (!glob_stock_pile.contains(card) || (dry_run->drawn & bit)) {
+      return MOVE_NO_WASTE_CARD;
+    }
+
+    dry_run->drawn |= bit;
+
+  } else {
+    const location_index_t from_index = from->index();
+    const location_index_t from_sub_index = from->sub_index();
+
+    if (!from_index.is_ok() || !from_sub_index.is_ok()) {
+      return MOVE_NO_INDEX;
+    }
+
+    src = from_index.get();
+
+    if (dry_run->num_cards[src] == 0) {
+      return MOVE_EMPTY_COLUMN;
+    }
+
+    position = to->tag() == LOC_FOUNDATION
+      ? dry_run->num_cards[src] - 1
+      : from_sub_index.get();
+
+    if (position >= dry_run->num_cards[src]) {
+      return MOVE_BAD_POSITION;
+    }
+
+    moving = dry_run->cards[src][position];
+  }
+
+  if (to->tag() == LOC_FOUNDATION) {
+    if (!is_promote_to_foundation_legal(
+          dry_run->foundation[to_index.get()], moving)) {
+      return MOVE_ILLEGAL_PROMOTION;
+    }
+
+    dry_run->foundation[to_index.get()] = Option<card_t>(moving);
+
+  } else {
+    const uint32_t dest = to_index.get();
+    const uint32_t size = dry_run->num_cards[dest];
+    const bool fits = size == 0
+      ? dry_run->num_down[dest] == 0 && moving.number == KING
+      : check_join_compatability(moving, dry_run->cards[dest][size - 1]);
+
+    const uint32_t num_moving = from->tag() == LOC_WASTE_PILE
+      ? 1
+      : dry_run->num_cards[src] - position;
+
+    /* More than 52 only if the stock model is out of sync. */
+    if (!fits
+        || (from->tag() == LOC_TABLEAU && src == dest)
+        || size + num_moving > 52) {
+      return MOVE_ILLEGAL_TRANSFER;
+    }
+
+    if (from->tag() == LOC_WASTE_PILE) {
+      dry_run->cards[dest][dry_run->num_cards[dest]++] = moving;
+    } else {
+      for (uint32_t i = position ; i < dry_run->num_cards[src] ; i++) {
+        dry_run->cards[dest][dry_run->num_cards[dest]++] =
+          dry_run->cards[src][i];
+      }
+    }
+  }
+
+  /* A card turned over is unknown, so its column is left with no face up
+   * cards: nothing can be moved off it or onto it for the rest of the path.
+   */
+  if (from->tag() == LOC_TABLEAU) {
+    dry_run->num_cards[src] = position;
+  }
+
+  return MOVE_OK;
+}
+
+/* Checks [path], then moving [src] to [dest], on a copy of [state] before
+ * execute_path issues any gesture for it: an illegal step part way would
+ * otherwise throw IllegalMoveException with the path half played.
+ */
+static bool is_path_legal(
+    const game_state_t & state,
+    const std::vector<std::pair<Move, card_t>> & path,
+    uint32_t src,
+    Location & dest)
+{
+  dry_run_t dry_run;
+  Tableau src_loc(src, 0);
+
+  dry_run_init(&dry_run, state);
+
+  for (uint32_t i = 0 ; i <= path.size() ; i++) {
+    const bool is_final = i == path.size();
+    Location *from = is_final ? &src_loc : path[i].first.from.get();
+    Location *to = is_final ? &dest : path[i].first.to.get();
+    const move_error_t error = dry_run_move(&dry_run, from, to,
+        is_final ? state.tableau[src].cards.at(0) : path[i].second);
+
+    if (error == MOVE_OK) {
+      continue;
+    }
+
+    chatter() << "Rejecting path at step " << i << ": from "
+      << from->to_string() << " to " << to->to_string() << ", "
+      << move_error_name(error) << std::endl;
+
+    if (!glob_is_copy) {
+      static metric_counter_t & paths_rejected = metrics_counter(
+          "strategy_paths_rejected_total",
+          "Planned paths found illegal before playing them");
+
+      paths_rejected.inc();
+    }
+
+    return false;
+  }
+
+  return true;
+}
+
 static game_state_t execute_path(
     game_state_t state,
     const std::vector<std::pair<Move, card_t>> & path,
@@ -725,24 +1020,11 @@ static game_state_t execute_path(
     Move move = path[i].first;
     card_t card = path[i].second;
 
-    std::cout << "  Step " << i << ": " << move << " "  << card.to_string()
+    chatter() << "  Step " << i << ": " << move << " "  << card.to_string()
       << std::endl;
 
     if (move.from.get()->tag() == LOC_WASTE_PILE) {
-      while (true) {
-        if (!state.waste_pile_top.is_some()) {
-          state = draw_from_stock_pile(state);
-
-        } else if (state.waste_pile_top.get() == card) {
-          break;
-
-        } else if (state.stock_pile_size == 0) {
-          state = reset_stock_pile(state);
-
-        } else {
-          state = draw_from_stock_pile(state);
-        }
-      }
+      state = draw_until_on_top(state, card);
     }
 
     update_glob_stock_pile(state, move);
@@ -754,10 +1036,300 @@ static game_state_t execute_path(
       dest
   );
   state = perform_move(state, final_move);
-  std::cout << "Completed a successful cycle" << std::endl;
+  chatter() << "Completed a successful cycle" << std::endl;
   return state;
 }
 
+/* What strategy_step decides by, besides the decision engine. */
+enum decision_rule_t {
+  DECISION_OBVIOUS = 0,
+  DECISION_3A,
+  DECISION_3B,
+  DECISION_3C,
+  DECISION_3D,
+  DECISION_EAGER,
+  DECISION_NONE,
+  NUM_DECISION_RULES
+};
+
+static const char *const DECISION_RULES[NUM_DECISION_RULES] = {
+  "obvious", "3a", "3b", "3c", "3d", "eager", "none"
+};
+
+static const char *const DECISIONS_NAME = "strategy_decisions_total";
+static const char *const DECISIONS_HELP =
+  "Moves decided by strategy_step, by rule";
+
+static void record_decision(const char *rule, metric_counter_t & decisions)
+{
+  if (glob_is_copy) {
+    return;
+  }
+
+  recorder_record(RECORD_DECISION, recorder_tag(rule));
+  decisions.inc();
+}
+
+static void count_decision(decision_rule_t rule)
+{
+  static const metric_counter_table_t<NUM_DECISION_RULES> decisions(
+      DECISIONS_NAME, DECISIONS_HELP, "rule", DECISION_RULES);
+
+  record_decision(DECISION_RULES[rule], decisions[rule]);
+}
+
+/* Every state strategy_step has seen before was left with a Rule 3 move
+ * (Rules 0 to 2 always make progress, so they cannot lead back to a seen
+ * state). Replaying that move would go around the same cycle again, so on
+ * the n-th visit of a state, the first n candidate moves of Rule 3 are
+ * skipped.
+ */
+static bool take_candidate()
+{
+  if (is_cancelled()) {
+    return false;
+  }
+
+  if (glob_moves_to_skip == 0) {
+    return true;
+  }
+
+  glob_moves_to_skip--;
+  chatter() << "Skipping candidate move to break a cycle" << std::endl;
+  return false;
+}
+
+/* The solver's [move] as a Move, from [state]. */
+static Move move_of_solver_move(const game_state_t & state, solver_move_t move)
+{
+  const uint32_t source = solver_move_source(move);
+  const uint32_t destination = solver_move_destination(move);
+  const card_t card = card_of_index(solver_move_card(move));
+  std::shared_ptr<Location> from = loc_waste_pile();
+  std::shared_ptr<Location> to = loc_foundation(card.suite);
+
+  if (source != SOLVER_PILE) {
+    const std::vector<card_t> & cards = state.tableau[source].cards;
+
+    from = loc_tableau(
+        source, std::find(cards.begin(), cards.end(), card) - cards.begin());
+  }
+
+  if (destination != SOLVER_FOUNDATION) {
+    to = loc_tableau(
+        destination, state.tableau[destination].cards.size() - 1);
+  }
+
+  return Move(from, to);
+}
+
+/* Asks the decision engine for a line, when there is one. Returns an
+ * empty line to leave the decision to the rules.
+ */
+static std::vector<solver_move_t> engine_line(const game_state_t & state)
+{
+  if (glob_engine == NULL || glob_moves_to_skip != 0) {
+    return std::vector<solver_move_t>();
+  }
+
+  engine_context_t context;
+
+  context.stock = &glob_stock_pile;
+  context.belief = &glob_belief;
+
+  return glob_engine->choose(
+      state, context, metrics_now_us() + 1000 * glob_engine_deadline_ms);
+}
+
+/* Plays [move] of the solver's, drawing its card first if it is in the
+ * stock pile.
+ */
+static game_state_t execute_solver_move(
+    game_state_t state, solver_move_t move)
+{
+  Move move_object = move_of_solver_move(state, move);
+
+  if (solver_move_source(move) == SOLVER_PILE) {
+    state = draw_until_on_top(state, card_of_index(solver_move_card(move)));
+  }
+
+  update_glob_stock_pile(state, move_object);
+  return perform_move(state, std::make_shared<Move>(move_object));
+}
+
+namespace {
+
+/* A Rule 2 move competing for a column, when peeking. */
+struct peek_candidate_t {
+  uint32_t src;
+  uint32_t num_down;
+  double value;  /* Of the card it turns over, or the expected value. */
+  bool is_known;
+};
+
+}
+
+static void count_peek(bool kept)
+{
+  static const char *const RESULTS[] = { "kept", "undone" };
+  static const metric_counter_table_t<2> peeks(
+      "strategy_peeks_total",
+      "Face down cards turned over by a move to be seen, by whether the"
+      " move was kept or undone",
+      "result",
+      RESULTS);
+
+  if (glob_is_copy) {
+    return;
+  }
+
+  peeks[kept ? 0 : 1].inc();
+}
+
+static std::shared_ptr<Move> rule_2_move(
+    const game_state_t & state, uint32_t src, uint32_t dest)
+{
+  return make_move(
+      loc_tableau(src, 0),
+      loc_tableau(dest, state.tableau[dest].cards.size() - 1));
+}
+
+/* The candidate to play: the best valued, ties going the way Rule 2
+ * breaks them (most face down cards, then the last column).
+ */
+static uint32_t best_peek_candidate(
+    const std::vector<peek_candidate_t> & candidates)
+{
+  uint32_t best = 0;
+
+  for (uint32_t i = 1 ; i < candidates.size() ; i++) {
+    const peek_candidate_t & a = candidates[i];
+    const peek_candidate_t & b = candidates[best];
+
+    if (a.value != b.value
+        ? a.value > b.value
+        : std::make_pair(a.num_down, a.src)
+          > std::make_pair(b.num_down, b.src)) {
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+/* The unknown candidate most worth a peek, if any is: candidates.size()
+ * otherwise.
+ */
+static uint32_t next_peek_candidate(
+    const game_state_t & state,
+    uint32_t dest,
+    const std::vector<peek_candidate_t> & candidates)
+{
+  uint32_t next = candidates.size();
+  double most = 0;
+
+  for (uint32_t i = 0 ; i < candidates.size() ; i++) {
+    const peek_candidate_t & candidate = candidates[i];
+    double best_other = PEEK_NOTHING;
+
+    if (candidate.is_known) {
+      continue;
+    }
+
+    for (uint32_t j = 0 ; j < candidates.size() ; j++) {
+      if (j != i) {
+        best_other = std::max(best_other, candidates[j].value);
+      }
+    }
+
+    const double information = peek_information_value(
+        state, candidate.src, dest,
+        glob_belief.candidates(candidate.src, candidate.num_down - 1),
+        glob_stock_pile.mask(), best_other);
+
+    if (information > most
+        && peek_is_worth(glob_peek, glob_peek_gestures, information)) {
+      next = i;
+      most = information;
+    }
+  }
+
+  return next;
+}
+
+/* Rule 2's [move], or another run off face down cards going on the same
+ * column, picked by what they turn over: known cards (peeked at before)
+ * by their value, unknown ones by peeking where it is worth it.
+ */
+static game_state_t play_rule_2_peeking(
+    game_state_t state, std::shared_ptr<Move> move)
+{
+  const uint32_t dest = move->to->index().get();
+  const uint64_t pile = glob_stock_pile.mask();
+  std::vector<peek_candidate_t> candidates;
+
+  for (const rule_2_candidate_t & rule_2 : rule_2_candidates(state)) {
+    if (rule_2.second.second != dest) {
+      continue;
+    }
+
+    peek_candidate_t candidate;
+    candidate.src = rule_2.second.first;
+    candidate.num_down = rule_2.first;
+
+    const Option<card_t> known =
+      glob_belief.known(candidate.src, candidate.num_down - 1);
+
+    candidate.is_known = known.is_some();
+    candidate.value = known.is_some()
+      ? peek_card_value(state, candidate.src, dest, known.get(), pile)
+      : peek_expected_value(state, candidate.src, dest,
+          glob_belief.candidates(candidate.src, candidate.num_down - 1),
+          pile);
+    candidates.push_back(candidate);
+  }
+
+  if (candidates.size() < 2) {
+    return perform_move(state, move);
+  }
+
+  while (true) {
+    const uint32_t i = next_peek_candidate(state, dest, candidates);
+
+    if (i == candidates.size()) {
+      break;
+    }
+
+    peek_candidate_t & candidate = candidates[i];
+    uint64_t gestures = interact_num_gestures();
+    const game_state_t peeked =
+      perform_move(state, rule_2_move(state, candidate.src, dest));
+    const card_t card = peeked.tableau[candidate.src].cards.back();
+
+    glob_peek_gestures += interact_num_gestures() - gestures;
+    candidate.is_known = true;
+    candidate.value = peek_card_value(state, candidate.src, dest, card, pile);
+    chatter() << "Peeked under column " << candidate.src << ": "
+      << card.to_string() << ", worth " << candidate.value << std::endl;
+
+    if (best_peek_candidate(candidates) == i
+        && next_peek_candidate(state, dest, candidates) == candidates.size()) {
+      count_peek(true);
+      return peeked;
+    }
+
+    gestures = interact_num_gestures();
+    state = undo_gesture();
+    glob_peek_gestures += interact_num_gestures() - gestures;
+    glob_belief.pin(candidate.src, candidate.num_down - 1, card);
+    count_peek(false);
+  }
+
+  const peek_candidate_t & best = candidates[best_peek_candidate(candidates)];
+
+  return perform_move(state, rule_2_move(state, best.src, dest));
+}
+
 static game_state_t enroute_to_obvious_by_peeking(
     const game_state_t & initial_state,
     bool *moved
@@ -766,7 +1338,8 @@ static game_state_t enroute_to_obvious_by_peeking(
   /* Rule 3a: Try to artifically move one deck to another using the help
    * of the wasted pile.
    */
-  std::cout << "Executing Rule 3(a)" << std::endl;
+  trace_scope_t scope(PHASE_RULE_3A);
+  chatter() << "Executing Rule 3(a)" << std::endl;
   for (int src = 6; src >= 0 ; src--) {
     if (initial_state.tableau[src].num_down_cards == 0) {
       continue;
@@ -780,19 +1353,24 @@ static game_state_t enroute_to_obvious_by_peeking(
       /* Try to find a path that would allow us to move the entire visible
        * stack at [src] to [dest].
        */
-      std::cout << "Searching for " << src << " -> " << dest << "!"  << std::endl;
+      chatter() << "Searching for " << src << " -> " << dest << "!"  << std::endl;
       bool exists;
       std::vector<std::pair<Move, card_t>> path = compute_join_path(
           initial_state, src, dest, &exists);
 
-      if (exists) {
-        std::cout << "Path exists! Executing path..." << std::endl;
+      Tableau dest_loc(dest, initial_state.tableau[dest].cards.size() - 1);
+
+      if (exists
+          && is_path_legal(initial_state, path, src, dest_loc)
+          && take_candidate()) {
+        chatter() << "Path exists! Executing path..." << std::endl;
         *moved = true;
+        count_decision(DECISION_3A);
 
         return execute_path(initial_state, path, src,
-            loc_tableau(dest, initial_state.tableau[dest].cards.size() - 1));
+            std::make_shared<Tableau>(dest_loc));
       } else {
-        std::cout << "Path not found for "
+        chatter() << "Path not found for "
           << src << " " << dest << std::endl;
       }
     }
@@ -802,7 +1380,8 @@ static game_state_t enroute_to_obvious_by_peeking(
    * other piles. This should hopefully open some way more kings to move
    * into an potentially uncover some hidden cards.
    */
-  std::cout << "Executing Rule 3(b)" << std::endl;
+  scope.switch_to(PHASE_RULE_3B);
+  chatter() << "Executing Rule 3(b)" << std::endl;
   for (int src = 6 ; src >= 0 ; src--) {
     const tableau_deck_t tbl_deck = initial_state.tableau[src];
 
@@ -822,11 +1401,16 @@ static game_state_t enroute_to_obvious_by_peeking(
       std::vector<std::pair<Move, card_t>> path = compute_join_path(
           initial_state, src, dest, &exists);
 
-      if (exists) {
+      Tableau dest_loc(dest, initial_state.tableau[dest].cards.size() - 1);
+
+      if (exists
+          && is_path_legal(initial_state, path, src, dest_loc)
+          && take_candidate()) {
         *moved = true;
+        count_decision(DECISION_3B);
         game_state_t state = execute_path(initial_state, path, src,
-            loc_tableau(dest, initial_state.tableau[dest].cards.size() - 1));
-        std::cout << "Made a move with Rule 3(b)" << std::endl;
+            std::make_shared<Tableau>(dest_loc));
+        chatter() << "Made a move with Rule 3(b)" << std::endl;
         return state;
       }
     }
@@ -836,8 +1420,9 @@ static game_state_t enroute_to_obvious_by_peeking(
    * immeadiately give us more new information. (this should cover
    * the case where we need to explicitly promote deuce).
    */
-  std::cout << "Executing Rule 3(c)" << std::endl;
-  std::cout << "Attempting lazy promotion!" << std::endl;
+  scope.switch_to(PHASE_RULE_3C);
+  chatter() << "Executing Rule 3(c)" << std::endl;
+  chatter() << "Attempting lazy promotion!" << std::endl;
   for (int src = 0 ; src < 7 ; src++) {
     const tableau_deck_t tbl_deck = initial_state.tableau[src];
 
@@ -856,8 +1441,13 @@ static game_state_t enroute_to_obvious_by_peeking(
     std::vector<std::pair<Move, card_t>> auxilary_path =
       compute_foundation_path(initial_state, src, &exists);
 
-    if (exists) {
+    Foundation dest_loc(deck_card.suite);
+
+    if (exists
+        && is_path_legal(initial_state, auxilary_path, src, dest_loc)
+        && take_candidate()) {
       *moved = true;
+      count_decision(DECISION_3C);
       return execute_path(initial_state, auxilary_path, src,
           loc_foundation(deck_card.suite));
     }
@@ -865,7 +1455,8 @@ static game_state_t enroute_to_obvious_by_peeking(
 
   /* Rule 3d: Bring any card from visible deck down to the tableau
    */
-  std::cout << "Executing Rule 3(d)" << std::endl;
+  scope.switch_to(PHASE_RULE_3D);
+  chatter() << "Executing Rule 3(d)" << std::endl;
   for (card_t card : glob_stock_pile) {
     game_state_t state = initial_state;
 
@@ -874,31 +1465,14 @@ static game_state_t enroute_to_obvious_by_peeking(
         continue;
       }
 
-      if (check_join_compatability(card, state.tableau[i].cards.back())) {
-
-        while (true) {
-
-          if (!state.waste_pile_top.is_some()) {
-            state = draw_from_stock_pile(state);
-
-          } else if (state.waste_pile_top.get() == card) {
-            break;
-
-          } else if (state.stock_pile_size == 0) {
-            state = reset_stock_pile(state);
+      if (check_join_compatability(card, state.tableau[i].cards.back())
+          && take_candidate()) {
 
-          } else {
-            state = draw_from_stock_pile(state);
-          }
-        }
+        state = draw_until_on_top(state, card);
 
-        glob_stock_pile.erase(
-            std::remove(
-              glob_stock_pile.begin(),
-              glob_stock_pile.end(),
-              card),
-            glob_stock_pile.end());
+        glob_stock_pile.remove(card);
         *moved = true;
+        count_decision(DECISION_3D);
         return move_from_visible_pile_to_tableau(state, i);
       }
     }
@@ -908,7 +1482,8 @@ static game_state_t enroute_to_obvious_by_peeking(
    * increases the foundation piles' size. (At this point, we are probably
    * going to lose anyway ...)
    */
-  std::cout << "Attempting eager promotion!" << std::endl;
+  scope.switch_to(PHASE_EAGER_PROMOTION);
+  chatter() << "Attempting eager promotion!" << std::endl;
   for (int src = 0 ; src < 7 ; src++) {
     const tableau_deck_t tbl_deck = initial_state.tableau[src];
 
@@ -922,12 +1497,14 @@ static game_state_t enroute_to_obvious_by_peeking(
     card_t deck_card = tbl_deck.cards.back();
     Option<card_t> foundation_card = initial_state.foundation[deck_card.suite];
 
-    std::cout << "Deck card = " << deck_card.to_string() << std::endl;
+    chatter() << "Deck card = " << deck_card.to_string() << std::endl;
 
     if (foundation_card.is_some()
-        && foundation_card.get().number == deck_card.number - 1) {
+        && foundation_card.get().number == deck_card.number - 1
+        && take_candidate()) {
       *moved = true;
-      std::cout << "Executing eager promotion" << std::endl;
+      count_decision(DECISION_EAGER);
+      chatter() << "Executing eager promotion" << std::endl;
       auto move = make_move(
           loc_tableau(src, tbl_deck.cards.size() - 1),
           loc_foundation(deck_card.suite)
@@ -968,24 +1545,14 @@ here:
         if (vec.size() == 0) {
           if (card.number == KING) {
             state = move_from_visible_pile_to_tableau(state, i);
-            glob_stock_pile.erase(
-                std::remove(
-                  glob_stock_pile.begin(),
-                  glob_stock_pile.end(),
-                  card),
-                glob_stock_pile.end());
+            glob_stock_pile.remove(card);
             break;
           }
         } else {
           if (suite_color(card.suite) != suite_color(vec.back().suite)
               && card.number == vec.back().number - 1) {
             state = move_from_visible_pile_to_tableau(state, i);
-            glob_stock_pile.erase(
-                std::remove(
-                  glob_stock_pile.begin(),
-                  glob_stock_pile.end(),
-                  card),
-                glob_stock_pile.end());
+            glob_stock_pile.remove(card);
             break;
           }
         }
@@ -1009,14 +1576,24 @@ here:
   }
 
   /* Transfer stacks that don't start with King to other stacks. */
+  cycle_guard_t guard("wrap_up_transfer", WRAP_UP_TRANSFER_BUDGET);
+
   while (true) {
     bool all_starts_with_king = true;
 
+    /* Coming back to the same state means none of the stacks could be
+     * transferred in the last round.
+     */
+    if (guard.visit(state) != 0 || guard.exhausted()) {
+      chatter() << "Giving up on transferring stacks" << std::endl;
+      break;
+    }
+
     for (int i = 0 ; i < 7 ; i++) {
       const auto & cards = state.tableau[i].cards;
 
       if (cards.size() != 0 && cards[0].number != KING) {
-        std::cout << "I should do something about " << i << std::endl;
+        chatter() << "I should do something about " << i << std::endl;
         all_starts_with_king = false;
 
         for (int j = 0 ; j < 7 ; j++) {
@@ -1026,14 +1603,16 @@ here:
 
           bool exists;
 
-          std::cout
+          chatter()
             << "Wrap up join path between "
             << i
             << " and "
             << j << std::endl;
           auto path = compute_join_path(state, i, j, &exists);
 
-          if (!exists) {
+          Tableau dest_loc(j, 0);
+
+          if (!exists || !is_path_legal(state, path, i, dest_loc)) {
             continue;
           }
 
@@ -1041,12 +1620,12 @@ here:
               loc_tableau(i, 0),
               loc_tableau(j, 0)
           );
-          std::cout << "Performing auxilaty steps" << std::endl;
-          std::cout << "Path.size() = " << path.size() << std::endl;
+          chatter() << "Performing auxilaty steps" << std::endl;
+          chatter() << "Path.size() = " << path.size() << std::endl;
           state = execute_path(state, path, i, loc_tableau(j, 0));
-          std::cout << "Performing actual transfer" << std::endl;
-          std::cout << state << std::endl;
-          std::cout << "Move done!" << std::endl;
+          chatter() << "Performing actual transfer" << std::endl;
+          chatter() << state << std::endl;
+          chatter() << "Move done!" << std::endl;
           break;
         }
       }
@@ -1076,7 +1655,7 @@ static game_state_t strategy_actually_finish_game(const game_state_t & state)
 {
   if (state.remaining_pile_size == 0) {
     game_state_t finished_state;
-    click_card(300, 870);
+    click_card(FINISH_BUTTON.first, FINISH_BUTTON.second);
 
     for (int i = 0 ; i < 7 ; i++) {
       tableau_deck_t deck;
@@ -1113,7 +1692,7 @@ static game_state_t strategy_actually_finish_game(const game_state_t & state)
     card_t card = state.tableau[i].cards.back();
 
     if (is_promote_to_foundation_legal(state.foundation[card.suite], card)) {
-      std::cout << "Promoting " << card.to_string() << "\n";
+      chatter() << "Promoting " << card.to_string() << "\n";
       return move_from_tableau_to_foundation(state, i, card.suite);
     }
   }
@@ -1136,11 +1715,11 @@ static game_state_t strategy_actually_finish_game(const game_state_t & state)
 static game_state_t do_wrap_up_work(game_state_t state)
 {
   for (const card_t card : glob_stock_pile) {
-    std::cout << card.to_string() << ", ";
+    chatter() << card.to_string() << ", ";
   }
-  std::cout << std::endl;
+  chatter() << std::endl;
   for (int i = 0 ; i < 10 ; i++) {
-    std::cout << "Wrap up iter " << i << std::endl;
+    chatter() << "Wrap up iter " << i << std::endl;
     state = strategy_wrap_up(state);
   }
   return state;
@@ -1163,7 +1742,17 @@ game_state_t strategy_term(game_state_t state) {
 
     state = do_wrap_up_work(state);
 
+    /* A state repeats only after a full round of the stock pile without
+     * any promotion, at which point we are stuck.
+     */
+    cycle_guard_t guard("finish_game", FINISH_GAME_BUDGET);
+
     while (!is_game_finisished(state)) {
+      if (guard.visit(state) != 0 || guard.exhausted()) {
+        chatter() << "Unable to finish the game" << std::endl;
+        break;
+      }
+
       state = strategy_actually_finish_game(state);
 
       if (state.remaining_pile_size == 0) {
@@ -1172,54 +1761,153 @@ game_state_t strategy_term(game_state_t state) {
     }
   }
 
+  static const char *const RESULTS[] = { "won", "lost" };
+  static const metric_counter_table_t<2> games(
+      "strategy_games_total",
+      "Games played to the end, by result",
+      "result",
+      RESULTS);
+
+  games[is_game_finisished(state) ? 0 : 1].inc();
+
   return state;
 }
 
 game_state_t strategy_step(const game_state_t & start_state, bool *moved)
 {
-  std::cout << "\n=====> CYCLE BEGINS" << std::endl;
-  std::cout << start_state << std::endl;
+  chatter() << "\n=====> CYCLE BEGINS" << std::endl;
+  chatter() << start_state << std::endl;
 
   if (no_hidden_cards_left(start_state)) {
     *moved = false;
     return start_state;
   }
 
+  glob_moves_to_skip = glob_step_guard.visit(start_state);
+  glob_belief.update(start_state, glob_stock_pile.mask());
+
+  if (!glob_stock_pile.consistent_with(start_state)) {
+    static metric_counter_t & stock_mismatches = metrics_counter(
+        "strategy_stock_model_mismatches_total",
+        "Steps where the stock model disagreed with the game state");
+
+    stock_mismatches.inc();
+    chatter() << "Stock model disagrees with the game state" << std::endl;
+  }
+
+  if (glob_step_guard.exhausted()) {
+    *moved = false;
+    return start_state;
+  }
+
   /* Rule 0 to 2 (the base rules) are in the obvious_move function. */
   game_state_t state = start_state;
   std::shared_ptr<Move> move = calculate_obvious_move(state);
 
   if (move != NULL) {
     *moved = true;
+    count_decision(DECISION_OBVIOUS);
     Move move_object = *move.get();
     update_glob_stock_pile(state, move_object);
+
+    /* Only Rule 2 moves runs between columns. */
+    if (glob_peek.enabled
+        && move->from->tag() == LOC_TABLEAU
+        && move->to->tag() == LOC_TABLEAU) {
+      return play_rule_2_peeking(state, move);
+    }
+
     return perform_move(state, move);
   }
 
+  /* The decision engine, if any, goes before the Rule 3 heuristics. */
+  const std::vector<solver_move_t> line = engine_line(state);
+
+  if (!line.empty()) {
+    *moved = true;
+    record_decision(glob_engine->name(), *glob_engine_decisions);
+
+    for (solver_move_t search_move : line) {
+      state = execute_solver_move(state, search_move);
+    }
+
+    return state;
+  }
+
   /* Rule 3: If there is no obvious way to do rule 0 to 2, let's cheat
    * by looking at the stock_pile to try to do rule rule 0 to 2.
    */
   state = enroute_to_obvious_by_peeking(state, moved);
-  std::cout << "Rule 3 : moved = " << *moved << std::endl;
+  chatter() << "Rule 3 : moved = " << *moved << std::endl;
   if (*moved) {
     *moved = true;
     return state;
   }
 
-  std::cout << "DID NOT MOVE!" << std::endl;
+  chatter() << "DID NOT MOVE!" << std::endl;
+  count_decision(DECISION_NONE);
   for (card_t c : glob_stock_pile) {
-    std::cout << "- " << c.to_string() << "\n";
+    chatter() << "- " << c.to_string() << "\n";
   }
   *moved = false;
   return state;
 }
 
+const belief_t & strategy_belief()
+{
+  return glob_belief;
+}
+
+const stock_model_t & strategy_stock_pile()
+{
+  return glob_stock_pile;
+}
+
+void strategy_set_engine(
+    std::unique_ptr<decision_engine_t> engine, uint32_t deadline_ms)
+{
+  glob_engine = std::move(engine);
+  glob_engine_deadline_ms = deadline_ms;
+  glob_engine_decisions = glob_engine == NULL ? NULL : &metrics_counter(
+      DECISIONS_NAME,
+      DECISIONS_HELP,
+      std::string("rule=\"") + glob_engine->name() + "\"");
+}
+
+void strategy_set_cancel(const std::atomic<bool> *cancel)
+{
+  glob_cancel = cancel;
+}
+
+void strategy_set_peek_options(const peek_options_t & options)
+{
+  glob_peek = options;
+}
+
+uint64_t strategy_peek_gestures()
+{
+  return glob_peek_gestures;
+}
+
 void strategy_print_internal_state()
 {
-  if (glob_stock_pile.size() == 0) {
-    std::cout << "<STOCK PILE IS EMPTY!>" << std::endl;
+  cycle_print_stats(chatter());
+
+  chatter() << "Face down cards: " << glob_belief.num_hidden_slots()
+    << " slots, " << glob_belief.num_unseen_cards() << " unseen cards";
+
+  try {
+    chatter() << ", " << belief_count_to_string(glob_belief.count())
+      << " possible deals\n";
+  } catch (BeliefException & e) {
+    chatter() << "\n";
   }
-  for (int i = 0 ; i < glob_stock_pile.size() ; i++) {
-    std::cout << i << ": " << glob_stock_pile[i].to_string() << "\n";
+
+  if (glob_stock_pile.empty()) {
+    chatter() << "<STOCK PILE IS EMPTY!>" << std::endl;
+  }
+  uint32_t i = 0;
+  for (card_t card : glob_stock_pile) {
+    chatter() << i++ << ": " << card.to_string() << "\n";
   }
 }
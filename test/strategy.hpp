@@ -1,11 +1,46 @@
 #ifndef STRATEGY_HPP
 #define STRATEGY_HPP
 
+#include <atomic>
+
 #include "game.hpp"
+#include "belief.hpp"
+#include "stock.hpp"
+#include "engine.hpp"
+#include "peek.hpp"
 
 game_state_t strategy_init(const game_state_t & state);
+
+/* Picks up a game in the middle on the calling thread, knowing what
+ * strategy_init would have learnt: [stock] and [belief].
+ */
+void strategy_resume(const stock_model_t & stock, const belief_t & belief);
 game_state_t strategy_step(const game_state_t & state, bool *moved);
 game_state_t strategy_term(game_state_t state);
 void strategy_print_internal_state();
 
+/* What the face down cards can be, as of the last step. */
+const belief_t & strategy_belief();
+
+/* The stock and waste pile, as far as it is known. */
+const stock_model_t & strategy_stock_pile();
+
+/* Where strategy_step asks for a move before the Rule 3 heuristics, with
+ * [deadline_ms] per decision. NULL plays by the rules alone.
+ */
+void strategy_set_engine(
+    std::unique_ptr<decision_engine_t> engine, uint32_t deadline_ms);
+
+/* Stops strategy_step on the calling thread without a Rule 3 move once
+ * [cancel] is set, eg. by a portfolio race (see portfolio.hpp). NULL, the
+ * default, never stops it.
+ */
+void strategy_set_cancel(const std::atomic<bool> *cancel);
+
+/* Peeking under Rule 2 moves, on the calling thread; off by default. */
+void strategy_set_peek_options(const peek_options_t & options);
+
+/* Gestures peeks took in the game so far, undos included. */
+uint64_t strategy_peek_gestures();
+
 #endif
@@ -0,0 +1,297 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <atomic>
+
+#include "trace.hpp"
+
+namespace {
+
+const uint32_t NUM_COUNTERS = 4;
+
+struct phase_totals_t {
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> wall_ns;
+  std::atomic<uint64_t> counters[NUM_COUNTERS];
+};
+
+static phase_totals_t totals[NUM_TRACE_PHASES];
+static std::atomic<bool> perf_enabled(false);
+
+/* Some count was scaled up for time the group was off the PMU. */
+static std::atomic<bool> perf_multiplexed(false);
+static thread_local trace_phase_t current_phase = PHASE_OTHER;
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/* Counters are per thread: perf events opened with pid = 0 only count the
+ * thread that opened them. The group is opened lazily in every thread
+ * that enters a phase, and closed when the thread exits.
+ */
+struct perf_group_t {
+  bool opened;
+  int fds[NUM_COUNTERS];
+
+  ~perf_group_t() {
+    for (uint32_t i = 0 ; opened && i < NUM_COUNTERS ; i++) {
+      if (fds[i] >= 0) {
+        close(fds[i]);
+      }
+    }
+  }
+};
+
+static thread_local perf_group_t group;
+
+#ifdef LINUX
+
+static int open_counter(uint64_t config, int leader)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = (leader == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP
+    | PERF_FORMAT_TOTAL_TIME_ENABLED
+    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+static bool open_group()
+{
+  const uint64_t configs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+
+  group.opened = true;
+
+  for (uint32_t i = 0 ; i < NUM_COUNTERS ; i++) {
+    group.fds[i] = -1;
+  }
+
+  for (uint32_t i = 0 ; i < NUM_COUNTERS ; i++) {
+    group.fds[i] = open_counter(configs[i], i == 0 ? -1 : group.fds[0]);
+
+    if (group.fds[i] < 0) {
+      return false;
+    }
+  }
+
+  ioctl(group.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+static bool read_counters(uint64_t *values)
+{
+  if (!group.opened) {
+    open_group();
+  }
+
+  if (group.fds[NUM_COUNTERS - 1] < 0) {
+    return false;
+  }
+
+  /* Number of counters, time enabled, time running, then the values. */
+  uint64_t buffer[3 + NUM_COUNTERS];
+
+  if (read(group.fds[0], buffer, sizeof(buffer)) != sizeof(buffer)) {
+    return false;
+  }
+
+  const uint64_t enabled = buffer[1];
+  const uint64_t running = buffer[2];
+
+  /* With more events than hardware counters, the kernel multiplexes the
+   * group: counts are then estimated over the whole time enabled.
+   */
+  for (uint32_t i = 0 ; i < NUM_COUNTERS ; i++) {
+    values[i] = buffer[3 + i];
+
+    if (running != 0 && running < enabled) {
+      values[i] = uint64_t(double(values[i]) * enabled / running);
+    }
+  }
+
+  if (running < enabled) {
+    perf_multiplexed = true;
+  }
+
+  return true;
+}
+
+#else
+
+static bool open_group()
+{
+  errno = ENOSYS;
+  return false;
+}
+
+static bool read_counters(uint64_t *)
+{
+  return false;
+}
+
+#endif
+
+}
+
+const char *trace_phase_name(trace_phase_t phase)
+{
+  const char *names[] = {
+    "other",
+    "opening_sweep",
+    "obvious_move",
+    "rule_3a",
+    "rule_3b",
+    "rule_3c",
+    "rule_3d",
+    "eager_promotion",
+    "join_path",
+    "foundation_path",
+    "recognition",
+    "beam_search",
+  };
+  return names[phase];
+}
+
+bool trace_enable_perf_counters()
+{
+  if (!group.opened && !open_group()) {
+    std::cout << "Hardware performance counters unavailable ("
+      << strerror(errno) << "), tracing phases with wall time only. "
+      << "See /proc/sys/kernel/perf_event_paranoid." << std::endl;
+    return false;
+  }
+
+  perf_enabled = true;
+  return true;
+}
+
+void trace_begin_game()
+{
+  for (uint32_t i = 0 ; i < NUM_TRACE_PHASES ; i++) {
+    totals[i].calls = 0;
+    totals[i].wall_ns = 0;
+
+    for (uint32_t j = 0 ; j < NUM_COUNTERS ; j++) {
+      totals[i].counters[j] = 0;
+    }
+  }
+
+  perf_multiplexed = false;
+}
+
+void trace_print_game_report(std::ostream & out)
+{
+  char line[200];
+
+  snprintf(line, sizeof(line), "%-16s %8s %10s %14s %14s %6s %12s %12s\n",
+      "phase", "calls", "wall ms", "cycles", "instructions", "IPC",
+      "cache miss", "branch miss");
+  out << ">> Phase report\n" << line;
+
+  for (uint32_t i = 1 ; i < NUM_TRACE_PHASES ; i++) {
+    const phase_totals_t & t = totals[i];
+    const uint64_t cycles = t.counters[0];
+    const uint64_t instructions = t.counters[1];
+
+    if (t.calls == 0) {
+      continue;
+    }
+
+    snprintf(line, sizeof(line),
+        "%-16s %8lu %10.1f %14lu %14lu %6.2f %12lu %12lu\n",
+        trace_phase_name(trace_phase_t(i)),
+        (unsigned long) t.calls,
+        double(t.wall_ns) / 1e6,
+        (unsigned long) cycles,
+        (unsigned long) instructions,
+        cycles ? double(instructions) / double(cycles) : 0.0,
+        (unsigned long) t.counters[2],
+        (unsigned long) t.counters[3]);
+    out << line;
+  }
+
+  if (!perf_enabled) {
+    out << "(hardware counters disabled)\n";
+  } else if (perf_multiplexed) {
+    out << "(counters were multiplexed, counts are scaled estimates)\n";
+  }
+  out << "<< End of phase report\n";
+}
+
+trace_phase_t trace_current_phase()
+{
+  return current_phase;
+}
+
+void trace_scope_t::begin(trace_phase_t p)
+{
+  phase = p;
+  parent = current_phase;
+  current_phase = p;
+  has_counters = perf_enabled && read_counters(start_counters);
+  start_ns = now_ns();
+}
+
+void trace_scope_t::end()
+{
+  phase_totals_t & t = totals[phase];
+  uint64_t end_counters[NUM_COUNTERS];
+
+  t.wall_ns.fetch_add(now_ns() - start_ns, std::memory_order_relaxed);
+  t.calls.fetch_add(1, std::memory_order_relaxed);
+
+  /* Scaled counts are estimates, which may go back a little. */
+  if (has_counters && read_counters(end_counters)) {
+    for (uint32_t i = 0 ; i < NUM_COUNTERS ; i++) {
+      if (end_counters[i] > start_counters[i]) {
+        t.counters[i].fetch_add(
+            end_counters[i] - start_counters[i], std::memory_order_relaxed);
+      }
+    }
+  }
+
+  current_phase = parent;
+}
+
+trace_scope_t::trace_scope_t(trace_phase_t phase)
+{
+  begin(phase);
+}
+
+trace_scope_t::~trace_scope_t()
+{
+  end();
+}
+
+void trace_scope_t::switch_to(trace_phase_t next)
+{
+  end();
+  begin(next);
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+
+#include <iostream>
+
+/* Named phases of the bot, for attributing work (time, hardware counters)
+ * to the parts of the strategy and vision code doing it.
+ *
+ * Phases nest, and are inclusive: time spent computing a join path for
+ * Rule 3(a) is counted in both PHASE_JOIN_PATH and PHASE_RULE_3A.
+ */
+enum trace_phase_t {
+  PHASE_OTHER = 0,  /* Anything outside of a traced phase. */
+  PHASE_OPENING_SWEEP,
+  PHASE_OBVIOUS_MOVE,
+  PHASE_RULE_3A,
+  PHASE_RULE_3B,
+  PHASE_RULE_3C,
+  PHASE_RULE_3D,
+  PHASE_EAGER_PROMOTION,
+  PHASE_JOIN_PATH,
+  PHASE_FOUNDATION_PATH,
+  PHASE_RECOGNITION,
+  PHASE_BEAM_SEARCH,
+  NUM_TRACE_PHASES
+};
+
+const char *trace_phase_name(trace_phase_t phase);
+
+/* Turns on hardware performance counters (cycles, instructions, cache
+ * misses, branch misses) through perf_event_open(2). Counting is user
+ * space only, so it works with the default perf_event_paranoid. When perf
+ * events are unavailable (restricted, not Linux, in a VM without a PMU),
+ * this prints why and phases carry on with call counts and wall time only.
+ *
+ * Returns whether counters are available.
+ */
+bool trace_enable_perf_counters();
+
+/* Per-game aggregation. */
+void trace_begin_game();
+void trace_print_game_report(std::ostream & out);
+
+/* The innermost phase the calling thread is in. */
+trace_phase_t trace_current_phase();
+
+/* Attributes everything until it goes out of scope to [phase]. */
+class trace_scope_t {
+private:
+  trace_phase_t phase;
+  trace_phase_t parent;
+  uint64_t start_ns;
+  uint64_t start_counters[4];
+  bool has_counters;
+
+  void begin(trace_phase_t phase);
+  void end();
+
+  trace_scope_t(const trace_scope_t &);
+  trace_scope_t & operator=(const trace_scope_t &);
+
+public:
+  explicit trace_scope_t(trace_phase_t phase);
+  ~trace_scope_t();
+
+  /* Ends the current phase and starts [next], for consecutive phases in
+   * the same block.
+   */
+  void switch_to(trace_phase_t next);
+};
+
+#endif
@@ -1,6 +1,13 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <assert.h>
+#include <stdint.h>
+
+#include <exception>
+#include <iostream>
+#include <streambuf>
+
 /* This option is meant for light-weight objects that can be allocated on
  * the stack.
  */
@@ -26,6 +33,9 @@ public:
     return is_some_;
   }
 
+  /* Throws if there is nothing. The check_ functions of interact.hpp test
+   * is_some() first, so only the live loop can unwind here.
+   */
   const T & get() const {
     if (!is_some_) {
       throw std::exception();
@@ -35,4 +45,92 @@ public:
   }
 };
 
+/* Either a value, or why there is none: [E] is an error code enum whose 0
+ * means success. Returned instead of throwing by code that search runs
+ * many times over; the live loop turns errors into exceptions.
+ */
+template <typename T, typename E>
+class Result {
+private:
+  E error_;
+  T obj;
+
+  Result(E error, const T & t) : error_(error), obj(t) {}
+
+public:
+  static Result<T, E> ok(const T & t) {
+    return Result<T, E>(E(), t);
+  }
+
+  static Result<T, E> fail(E error) {
+    assert(error != E());
+    return Result<T, E>(error, T());
+  }
+
+  bool is_ok() const {
+    return error_ == E();
+  }
+
+  E error() const {
+    return error_;
+  }
+
+  /* Only when is_ok(). */
+  const T & get() const {
+    assert(is_ok());
+    return obj;
+  }
+};
+
+/* splitmix64: reproducible across platforms and standard libraries, and
+ * good enough for deals, samples and hash keys.
+ */
+inline uint64_t splitmix64_next(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+class null_buffer_t : public std::streambuf {
+protected:
+  int overflow(int c) { return c; }
+};
+
+inline bool & is_chatter_quiet()
+{
+  static thread_local bool quiet = false;
+  return quiet;
+}
+
+/* Where the bot says what it is up to: std::cout, unless the calling
+ * thread is quiet (see quiet_scope_t).
+ */
+inline std::ostream & chatter()
+{
+  static thread_local null_buffer_t null_buffer;
+  static thread_local std::ostream null_stream(&null_buffer);
+
+  return is_chatter_quiet() ? null_stream : std::cout;
+}
+
+/* Quiets chatter() on the calling thread while in scope, eg. for engines
+ * playing copies of the game, whose output would interleave with the live
+ * game's.
+ */
+class quiet_scope_t {
+private:
+  bool was_quiet;
+
+public:
+  quiet_scope_t() : was_quiet(is_chatter_quiet()) {
+    is_chatter_quiet() = true;
+  }
+
+  ~quiet_scope_t() {
+    is_chatter_quiet() = was_quiet;
+  }
+};
+
 #endif
@@ -1,5 +1,6 @@
 #include <unistd.h>
 #include <algorithm>
+#include <mutex>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -7,6 +8,9 @@
 
 #include "vision.hpp"
 #include "utils.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "recorder.hpp"
 
 static const char* number_filenames[14] = {
   "",  /* 1-index, so 0 is a dnummy */
@@ -37,6 +41,14 @@ static robot_h robot;
 static cv::Mat number_templates[14];
 static cv::Mat suite_templates[4];
 
+/* Scores above this mean the anchor is not there. */
+static const double ANCHOR_MATCH_THRESHOLD = 0.05;
+static const uint64_t ANCHOR_CHECK_PERIOD_US = 1000000;
+
+static std::mutex anchor_mutex;
+static cv::Mat anchor_template;
+static uint64_t last_anchor_check;
+
 static cv::Rect make_crop(uint32_t width, uint32_t height)
 {
   uint32_t offset_x = 2;
@@ -50,6 +62,20 @@ static cv::Rect make_crop(uint32_t width, uint32_t height)
   return roi;
 }
 
+/* [absolute] captures ignore the robot's origin offset. */
+static cv::Mat capture_gray(const rectangle_t & rect, bool absolute)
+{
+  cv::Mat image = cv::Mat(rect.height, rect.width, CV_8UC1);
+
+  if (absolute) {
+    robot_screenshot_absolute(robot, rect, ROBOT_PIXEL_GRAY8, 0, image.data);
+  } else {
+    robot_screenshot_format(robot, rect, ROBOT_PIXEL_GRAY8, 0, image.data);
+  }
+
+  return image;
+}
+
 static void simple_threshold(cv::InputArray src, cv::OutputArray dest)
 {
   cv::threshold(
@@ -89,57 +115,269 @@ void vision_init(robot_h arg_robot)
   robot_mouse_move(robot, TOP_LEFT_CORNER.first, TOP_LEFT_CORNER.second);
   robot_mouse_press(robot, ROBOT_BUTTON1_MASK);
   robot_mouse_release(robot, ROBOT_BUTTON1_MASK);
+
+  anchor_template = capture_gray(ANCHOR, false);
+  last_anchor_check = metrics_now_us();
 }
 
-static number_t recognize_number(uint32_t *pixels)
+/* Returns the best score of the anchor in [image], and where it is. */
+static double match_anchor(const cv::Mat & image, cv::Point *location)
 {
-  const uint32_t height = CARD_NUMBER_HEIGHT;
-  const uint32_t width = CARD_NUMBER_WIDTH;
-  double results[14];
-  cv::Mat image = cv::Mat(height, width, CV_8UC4, pixels);
+  cv::Mat matched;
+  double min_val;
 
-  cv::cvtColor(image, image, CV_RGBA2GRAY);
-  simple_threshold(image, image);
+  cv::matchTemplate(image, anchor_template, matched, CV_TM_SQDIFF_NORMED);
+  cv::minMaxLoc(matched, &min_val, NULL, location, NULL);
+  return min_val;
+}
+
+bool vision_track_window()
+{
+  static metric_counter_t & reanchors = metrics_counter(
+      "vision_reanchors_total",
+      "Times the game window was found to have moved");
+  std::lock_guard<std::mutex> lock(anchor_mutex);
+  const uint64_t now = metrics_now_us();
+
+  if (anchor_template.empty()
+      || now - last_anchor_check < ANCHOR_CHECK_PERIOD_US) {
+    return true;
+  }
+
+  last_anchor_check = now;
 
-  for (int i = 1 ; i < 14 ; i++) {
+  if (match_anchor(capture_gray(ANCHOR, false), NULL)
+      <= ANCHOR_MATCH_THRESHOLD) {
+    return true;
+  }
+
+  /* Search around where the anchor was last seen, on screen. */
+  int dx, dy;
+  robot_get_origin_offset(&dx, &dy);
+
+  const int64_t x = std::max<int64_t>(
+      0, int64_t(ANCHOR.x) + dx - ANCHOR_SEARCH_RADIUS);
+  const int64_t y = std::max<int64_t>(
+      0, int64_t(ANCHOR.y) + dy - ANCHOR_SEARCH_RADIUS);
+  const rectangle_t search =
+    { .x = uint32_t(x),
+      .y = uint32_t(y),
+      .height = ANCHOR.height + 2 * ANCHOR_SEARCH_RADIUS,
+      .width = ANCHOR.width + 2 * ANCHOR_SEARCH_RADIUS };
+  cv::Point location;
+
+  if (match_anchor(capture_gray(search, true), &location)
+      > ANCHOR_MATCH_THRESHOLD) {
+    std::cout << "Lost the game window around offset ("
+      << dx << ", " << dy << ")" << std::endl;
+    return false;
+  }
+
+  dx = int(x + location.x - ANCHOR.x);
+  dy = int(y + location.y - ANCHOR.y);
+  robot_set_origin_offset(dx, dy);
+  reanchors.inc();
+
+  std::cout << "Game window moved, origin offset is now ("
+    << dx << ", " << dy << ")" << std::endl;
+  return true;
+}
+
+/* Templates are cropped 2 px on every side (see [make_crop]), so a full
+ * search scores each of them at 5x5 offsets of the capture. Cards of a slot
+ * are drawn at the same place every time though, so once full searches of
+ * a slot keep agreeing on the offset, only that offset is scored, unless
+ * the best template doesn't stand out there.
+ */
+struct alignment_t {
+  cv::Point offset;
+  uint32_t agreements;  /* Full searches in a row that found [offset]. */
+};
+
+/* Full searches agreeing before a slot is scored at its offset only. */
+static const uint32_t ALIGNMENT_AGREEMENTS = 3;
+
+/* Scores are SQDIFF_NORMED, lower is better. At the offset, the runner up
+ * has to score this much worse than the best, otherwise it is a full
+ * search after all.
+ */
+static const double ALIGNED_MIN_MARGIN = 0.1;
+
+/* Slots cards are recognized in, each with its alignment. Tableau cards are
+ * told apart by depth only, decks being drawn the same.
+ */
+static const uint32_t SLOT_FOUNDATION = 0;
+static const uint32_t SLOT_VISIBLE_PILE = 1;
+static const uint32_t SLOT_TABLEAU = 2;
+static const uint32_t MAX_TABLEAU_HIDDEN = 7;
+static const uint32_t MAX_TABLEAU_POSITION = 13;
+static const uint32_t NUM_SLOTS =
+  SLOT_TABLEAU + MAX_TABLEAU_HIDDEN * MAX_TABLEAU_POSITION;
+
+/* A card at a depth no deal can reach is matched with a full search. */
+static const uint32_t SLOT_NONE = NUM_SLOTS;
+
+static std::mutex alignment_mutex;
+static alignment_t number_alignments[NUM_SLOTS];
+static alignment_t suite_alignments[NUM_SLOTS];
+
+static const char *const SEARCH_MODES[] = { "anchored", "full" };
+
+static void count_template_search(bool anchored)
+{
+  static const metric_counter_table_t<2> searches(
+      "vision_template_searches_total",
+      "Template matching of a number or suite, by how it was searched",
+      "mode",
+      SEARCH_MODES);
+
+  searches[anchored ? 0 : 1].inc();
+}
+
+/* Returns the index of the template in [begin, end) that best matches the
+ * (thresholded) [image], and its [score], learning the slot's
+ * [alignments].
+ */
+static uint32_t best_template(
+    const cv::Mat & image,
+    const cv::Mat *templates,
+    uint32_t begin,
+    uint32_t end,
+    alignment_t *alignments,
+    uint32_t slot,
+    double *score)
+{
+  double scores[14];
+  cv::Point locations[14];
+  alignment_t alignment = { cv::Point(), 0 };
+
+  if (slot != SLOT_NONE) {
+    std::lock_guard<std::mutex> lock(alignment_mutex);
+    alignment = alignments[slot];
+  }
+
+  if (alignment.agreements >= ALIGNMENT_AGREEMENTS) {
+    for (uint32_t i = begin ; i < end ; i++) {
+      const cv::Rect roi(alignment.offset.x, alignment.offset.y,
+          templates[i].cols, templates[i].rows);
+      cv::Mat matched;
+
+      cv::matchTemplate(image(roi), templates[i], matched, CV_TM_SQDIFF_NORMED);
+      scores[i] = matched.at<float>(0, 0);
+    }
+
+    uint32_t best = std::min_element(scores + begin, scores + end) - scores;
+    double runner_up = 1.0;
+
+    for (uint32_t i = begin ; i < end ; i++) {
+      if (i != best) {
+        runner_up = std::min(runner_up, scores[i]);
+      }
+    }
+
+    if (runner_up - scores[best] >= ALIGNED_MIN_MARGIN) {
+      count_template_search(true);
+      *score = scores[best];
+      return best;
+    }
+  }
+
+  for (uint32_t i = begin ; i < end ; i++) {
     cv::Mat matched;
-    double min_val;
 
-    cv::matchTemplate(image, number_templates[i], matched, CV_TM_SQDIFF_NORMED);
-    cv::minMaxLoc(matched, &results[i]);
+    cv::matchTemplate(image, templates[i], matched, CV_TM_SQDIFF_NORMED);
+    cv::minMaxLoc(matched, &scores[i], NULL, &locations[i], NULL);
+  }
+
+  uint32_t best = std::min_element(scores + begin, scores + end) - scores;
+  count_template_search(false);
+
+  if (slot != SLOT_NONE) {
+    std::lock_guard<std::mutex> lock(alignment_mutex);
+    alignment_t & learnt = alignments[slot];
+
+    if (learnt.offset.x == locations[best].x
+        && learnt.offset.y == locations[best].y) {
+      /* Keeps being scored at the offset if it lost on margin only. */
+      learnt.agreements = std::min(
+          learnt.agreements + 1, ALIGNMENT_AGREEMENTS);
+    } else {
+      learnt.offset = locations[best];
+      learnt.agreements = 1;
+    }
   }
 
-  uint32_t pos = std::min_element(results + 1, results + 14) - results;
-  return number_t(pos);
+  *score = scores[best];
+  return best;
 }
 
-static suite_t recognize_suite(uint32_t *pixels)
+static number_t recognize_number(
+    uint8_t *pixels, uint32_t slot, double *score)
+{
+  const uint32_t height = CARD_NUMBER_HEIGHT;
+  const uint32_t width = CARD_NUMBER_WIDTH;
+  cv::Mat image = cv::Mat(height, width, CV_8UC1, pixels);
+
+  simple_threshold(image, image);
+
+  return number_t(best_template(
+        image, number_templates, 1, 14, number_alignments, slot, score));
+}
+
+static suite_t recognize_suite(
+    uint8_t *pixels, uint32_t slot, double *score)
 {
   const uint32_t height = CARD_SUITE_HEIGHT;
   const uint32_t width = CARD_SUITE_WIDTH;
-  double results[4];
-  cv::Mat image = cv::Mat(height, width, CV_8UC4, pixels);
-  cv::cvtColor(image, image, CV_RGBA2GRAY);
+  cv::Mat image = cv::Mat(height, width, CV_8UC1, pixels);
   simple_threshold(image, image);
 
-  for (int i = 0 ; i < 4 ; i++) {
-    cv::Mat matched;
-    double min_val;
+  return suite_t(best_template(
+        image, suite_templates, 0, 4, suite_alignments, slot, score));
+}
 
-    cv::matchTemplate(image, suite_templates[i], matched, CV_TM_SQDIFF_NORMED);
-    cv::minMaxLoc(matched, &results[i]);
-  }
+enum recognition_slot_t {
+  RECOGNIZED_FOUNDATION = 0,
+  RECOGNIZED_VISIBLE_PILE,
+  RECOGNIZED_TABLEAU,
+  NUM_RECOGNITION_SLOTS
+};
 
-  uint32_t pos = std::min_element(results, results + 4) - results;
-  return suite_t(pos);
+static const char *const RECOGNITION_SLOTS[NUM_RECOGNITION_SLOTS] = {
+  "foundation", "visible_pile", "tableau"
+};
+
+static void count_recognition(recognition_slot_t slot)
+{
+  static const metric_counter_table_t<NUM_RECOGNITION_SLOTS> recognitions(
+      "vision_recognitions_total",
+      "Cards recognized, by slot",
+      "slot",
+      RECOGNITION_SLOTS);
+
+  recognitions[slot].inc();
 }
 
-static card_t recognize_card(uint32_t x, uint32_t y)
+static card_t recognize_card(uint32_t x, uint32_t y, uint32_t slot)
 {
-  uint32_t *number_pixels =
-    new uint32_t[CARD_NUMBER_HEIGHT * CARD_NUMBER_WIDTH];
-  uint32_t *suite_pixels =
-    new uint32_t[CARD_SUITE_HEIGHT * CARD_SUITE_WIDTH];
+  static metric_histogram_t & capture_latency = metrics_histogram(
+      "vision_capture_seconds",
+      "Time to capture the number and suite of a card");
+  static metric_histogram_t & recognition_latency = metrics_histogram(
+      "vision_recognition_seconds",
+      "Time to recognize a card, capture included");
+  trace_scope_t scope(PHASE_RECOGNITION);
+
+  if (!vision_track_window()) {
+    throw RecognizeException();
+  }
+
+  const uint64_t start = metrics_now_us();
+  /* Captured straight to gray: a quarter of the bytes of ARGB, and no
+   * conversion left to do here.
+   */
+  uint8_t number_pixels[CARD_NUMBER_HEIGHT * CARD_NUMBER_WIDTH];
+  uint8_t suite_pixels[CARD_SUITE_HEIGHT * CARD_SUITE_WIDTH];
   const rectangle_t suite_rectangle =
     { .x = x + SUITE_OFFSET,
       .y = y,
@@ -151,13 +389,25 @@ static card_t recognize_card(uint32_t x, uint32_t y)
       .height = CARD_NUMBER_HEIGHT,
       .width = CARD_NUMBER_WIDTH };
 
-  robot_screenshot(robot, number_rectangle, number_pixels);
-  robot_screenshot(robot, suite_rectangle, suite_pixels);
-
-  return {
-    .suite = recognize_suite(suite_pixels),
-    .number = recognize_number(number_pixels)
+  robot_screenshot_format(
+      robot, number_rectangle, ROBOT_PIXEL_GRAY8, 0, number_pixels);
+  robot_screenshot_format(
+      robot, suite_rectangle, ROBOT_PIXEL_GRAY8, 0, suite_pixels);
+  capture_latency.record(metrics_now_us() - start);
+
+  double suite_score;
+  double number_score;
+  card_t card = {
+    .suite = recognize_suite(suite_pixels, slot, &suite_score),
+    .number = recognize_number(number_pixels, slot, &number_score)
   };
+  const uint64_t elapsed = metrics_now_us() - start;
+
+  recognition_latency.record(elapsed);
+  recorder_record(RECORD_RECOGNITION, card_index(card),
+      std::max(suite_score, number_score), elapsed);
+
+  return card;
 }
 
 card_t recognize_foundation_card(const int deck)
@@ -176,12 +426,15 @@ card_t recognize_foundation_card(const int deck)
     throw RecognizeException();
   }
 
-  return recognize_card(pos.first, pos.second);
+  count_recognition(RECOGNIZED_FOUNDATION);
+  return recognize_card(pos.first, pos.second, SLOT_FOUNDATION);
 }
 
 card_t recognize_visible_pile_card()
 {
-  return recognize_card(VISIBLE_PILE.first, VISIBLE_PILE.second);
+  count_recognition(RECOGNIZED_VISIBLE_PILE);
+  return recognize_card(
+      VISIBLE_PILE.first, VISIBLE_PILE.second, SLOT_VISIBLE_PILE);
 }
 
 card_t recognize_tableau_card(const tableau_position_t & position)
@@ -190,7 +443,16 @@ card_t recognize_tableau_card(const tableau_position_t & position)
   int y = TABLEAU.second
     + (position.num_hidden * TABLEAU_UNSEEN_OFFSET)
     + (position.position * TABLEAU_SEEN_OFFSET);
-  return recognize_card(x, y);
+  uint32_t slot = SLOT_NONE;
+
+  if (position.num_hidden < MAX_TABLEAU_HIDDEN
+      && position.position < MAX_TABLEAU_POSITION) {
+    slot = SLOT_TABLEAU
+      + position.num_hidden * MAX_TABLEAU_POSITION + position.position;
+  }
+
+  count_recognition(RECOGNIZED_TABLEAU);
+  return recognize_card(x, y, slot);
 }
 
 void hackish_imshow(const std::string& winname, cv::InputArray mat)
@@ -203,17 +465,15 @@ void hackish_imshow(const std::string& winname, cv::InputArray mat)
 
 void save_visible_pile_number(std::string name)
 {
-  uint32_t *pixels =
-    new uint32_t[CARD_NUMBER_HEIGHT * CARD_NUMBER_WIDTH];
+  uint8_t pixels[CARD_NUMBER_HEIGHT * CARD_NUMBER_WIDTH];
   const rectangle_t rect =
     { .x = uint32_t(VISIBLE_PILE.first),
       .y = uint32_t(VISIBLE_PILE.second),
       .height = CARD_NUMBER_HEIGHT,
       .width = CARD_NUMBER_WIDTH };
 
-  robot_screenshot(robot, rect, pixels);
-  cv::Mat image = cv::Mat(CARD_NUMBER_HEIGHT, CARD_NUMBER_WIDTH, CV_8UC4, pixels);
-  cv::cvtColor(image, image, CV_RGBA2GRAY);
+  robot_screenshot_format(robot, rect, ROBOT_PIXEL_GRAY8, 0, pixels);
+  cv::Mat image = cv::Mat(CARD_NUMBER_HEIGHT, CARD_NUMBER_WIDTH, CV_8UC1, pixels);
   simple_threshold(image, image);
   cv::imwrite(name, image);
 }
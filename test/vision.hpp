@@ -15,6 +15,24 @@
  */
 const auto TOP_LEFT_CORNER = std::make_pair(35, 147);
 
+/* Everything of the game that moves: foundations, piles and the tableau,
+ * down to a full column of cards.
+ */
+const rectangle_t GAME_BOARD = {
+  .x = uint32_t(TOP_LEFT_CORNER.first),
+  .y = uint32_t(TOP_LEFT_CORNER.second),
+  .height = 640,
+  .width = 500
+};
+
+/* A patch of the game window that never changes (the title bar above the
+ * foundations). It is captured on start up and looked for again around
+ * where it was when it stops matching, ie. when the window moved.
+ */
+const rectangle_t ANCHOR =
+  { .x = 35, .y = 117, .height = 24, .width = 120 };
+const uint32_t ANCHOR_SEARCH_RADIUS = 200;
+
 const uint32_t CARD_WIDTH = 30;
 const uint32_t CARD_HEIGHT = 70;
 
@@ -35,6 +53,26 @@ const auto TABLEAU_UNSEEN_OFFSET = 14;  /* Offset between flipped cards. */
 const auto TABLEAU_SEEN_OFFSET = 28;  /* Offset between unflipped cards. */
 const auto SUITE_OFFSET = 30u; /* Offset from beginning of card to suite */
 
+/* The bar under the board: the finish button strategy_actually_finish_game
+ * clicks once every card can go home, and the undo button next to it.
+ * Centres, unlike the cards; see interact_set_undo_button to move the
+ * latter.
+ */
+const auto FINISH_BUTTON = std::make_pair(300, 870);
+const auto UNDO_BUTTON = std::make_pair(200, 870);
+
+/* A row of the board halfway between the bottom of the top row of cards
+ * and the top of the tableau, which cards only cross while being dragged:
+ * plain background whenever the game is showing and settled, so a dialog
+ * over the board shows up there (see screen.hpp).
+ */
+const rectangle_t BOARD_PROBE = {
+  .x = GAME_BOARD.x,
+  .y = uint32_t(FOUNDATION_DECK_0.second + CARD_HEIGHT + TABLEAU.second) / 2,
+  .height = 1,
+  .width = GAME_BOARD.width
+};
+
 const uint32_t CARD_NUMBER_HEIGHT = 30;
 const uint32_t CARD_NUMBER_WIDTH = 25;
 const uint32_t CARD_SUITE_HEIGHT = 28;
@@ -69,6 +107,15 @@ card_t recognize_foundation_card(const int deck);
 card_t recognize_visible_pile_card();
 card_t recognize_tableau_card(const tableau_position_t & position);
 
+/* Checks, at most once a second, that the game window is where the robot's
+ * origin offset says it is, and updates the offset if the window moved by
+ * no more than [ANCHOR_SEARCH_RADIUS]. Returns false when the window can't
+ * be found.
+ *
+ * This is thread safe.
+ */
+bool vision_track_window();
+
 /* For data collection used in template matching */
 void save_visible_pile_number(const std::string name);
 
@@ -0,0 +1,133 @@
+#include <assert.h>
+
+#include "zobrist.hpp"
+
+namespace {
+
+const uint32_t MAX_PILE_SIZE = 24;
+
+struct zobrist_tables_t {
+  uint64_t tableau[7][ZOBRIST_MAX_DEPTH][NUM_CARDS];
+  uint64_t hidden[7][7];
+  uint64_t foundation[4][KING + 1];
+  uint64_t waste[NUM_CARDS + 1];
+  uint64_t pile_size[MAX_PILE_SIZE + 1][MAX_PILE_SIZE + 1];
+  uint64_t pile_card[NUM_CARDS];
+};
+
+static zobrist_tables_t *make_tables()
+{
+  zobrist_tables_t *t = new zobrist_tables_t;
+  uint64_t seed = 0x5eed50117a12e5ULL;
+
+  for (uint32_t i = 0 ; i < 7 ; i++) {
+    for (uint32_t j = 0 ; j < ZOBRIST_MAX_DEPTH ; j++) {
+      for (uint32_t k = 0 ; k < NUM_CARDS ; k++) {
+        t->tableau[i][j][k] = splitmix64_next(&seed);
+      }
+    }
+    for (uint32_t j = 0 ; j < 7 ; j++) {
+      t->hidden[i][j] = splitmix64_next(&seed);
+    }
+  }
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    for (uint32_t j = 0 ; j <= KING ; j++) {
+      t->foundation[i][j] = splitmix64_next(&seed);
+    }
+  }
+
+  for (uint32_t i = 0 ; i <= NUM_CARDS ; i++) {
+    t->waste[i] = splitmix64_next(&seed);
+  }
+
+  for (uint32_t i = 0 ; i <= MAX_PILE_SIZE ; i++) {
+    for (uint32_t j = 0 ; j <= MAX_PILE_SIZE ; j++) {
+      t->pile_size[i][j] = splitmix64_next(&seed);
+    }
+  }
+
+  for (uint32_t i = 0 ; i < NUM_CARDS ; i++) {
+    t->pile_card[i] = splitmix64_next(&seed);
+  }
+
+  return t;
+}
+
+/* Built on first use; function-local statics are thread safe in C++11. */
+static const zobrist_tables_t & tables()
+{
+  static const zobrist_tables_t *t = make_tables();
+  return *t;
+}
+
+}
+
+uint64_t zobrist_tableau_key(uint32_t deck, uint32_t depth, uint32_t card)
+{
+  assert(deck < 7 && depth < ZOBRIST_MAX_DEPTH && card < NUM_CARDS);
+  return tables().tableau[deck][depth][card];
+}
+
+uint64_t zobrist_hidden_key(uint32_t deck, uint32_t num_hidden)
+{
+  assert(deck < 7 && num_hidden < 7);
+  return tables().hidden[deck][num_hidden];
+}
+
+uint64_t zobrist_foundation_key(uint32_t suite, uint32_t number)
+{
+  assert(suite < 4 && number <= KING);
+  return tables().foundation[suite][number];
+}
+
+uint64_t zobrist_waste_key(uint32_t card)
+{
+  assert(card <= ZOBRIST_NO_CARD);
+  return tables().waste[card];
+}
+
+uint64_t zobrist_pile_size_key(
+    uint32_t stock_pile_size,
+    uint32_t remaining_pile_size)
+{
+  assert(stock_pile_size <= MAX_PILE_SIZE);
+  assert(remaining_pile_size <= MAX_PILE_SIZE);
+  return tables().pile_size[stock_pile_size][remaining_pile_size];
+}
+
+uint64_t zobrist_pile_card_key(uint32_t card)
+{
+  assert(card < NUM_CARDS);
+  return tables().pile_card[card];
+}
+
+uint64_t zobrist_hash(const game_state_t & state)
+{
+  uint64_t hash = 0;
+
+  for (uint32_t i = 0 ; i < 4 ; i++) {
+    const Option<card_t> & top = state.foundation[i];
+    hash ^= zobrist_foundation_key(i, top.is_some() ? top.get().number : 0);
+  }
+
+  for (uint32_t i = 0 ; i < 7 ; i++) {
+    const tableau_deck_t & deck = state.tableau[i];
+
+    hash ^= zobrist_hidden_key(i, deck.num_down_cards);
+
+    for (uint32_t j = 0 ; j < deck.cards.size() ; j++) {
+      hash ^= zobrist_tableau_key(
+          i, deck.num_down_cards + j, card_index(deck.cards[j]));
+    }
+  }
+
+  hash ^= zobrist_waste_key(
+      state.waste_pile_top.is_some()
+      ? card_index(state.waste_pile_top.get())
+      : ZOBRIST_NO_CARD);
+  hash ^= zobrist_pile_size_key(
+      state.stock_pile_size, state.remaining_pile_size);
+
+  return hash;
+}
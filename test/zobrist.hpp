@@ -0,0 +1,42 @@
+#ifndef ZOBRIST_HPP
+#define ZOBRIST_HPP
+
+#include <stdint.h>
+
+#include "game.hpp"
+
+/* Zobrist hashing of game states. Every (feature, value) pair of a state
+ * gets a fixed random 64-bit key and the hash of a state is the xor of the
+ * keys of its features, so a hash can be updated incrementally when a
+ * single feature changes.
+ *
+ * Keys are generated from a fixed seed, so hashes are stable across runs
+ * and can be written to logs.
+ */
+
+/* Hidden cards + a full run of KING to ACE. */
+const uint32_t ZOBRIST_MAX_DEPTH = 20;
+
+/* Used in place of a card index where there is no card. */
+const uint32_t ZOBRIST_NO_CARD = NUM_CARDS;
+
+/* [depth] counts from the bottom of the deck, hidden cards included. */
+uint64_t zobrist_tableau_key(uint32_t deck, uint32_t depth, uint32_t card);
+uint64_t zobrist_hidden_key(uint32_t deck, uint32_t num_hidden);
+
+/* [number] is 0 for an empty foundation. */
+uint64_t zobrist_foundation_key(uint32_t suite, uint32_t number);
+uint64_t zobrist_waste_key(uint32_t card);
+uint64_t zobrist_pile_size_key(
+    uint32_t stock_pile_size,
+    uint32_t remaining_pile_size
+);
+
+/* Membership of [card] in the stock / waste pile. [game_state_t] does not
+ * carry the pile contents, so this is only used by states that do.
+ */
+uint64_t zobrist_pile_card_key(uint32_t card);
+
+uint64_t zobrist_hash(const game_state_t & state);
+
+#endif